@@ -6,10 +6,13 @@
 #include <stdio.h>
 #include "defs.h"
 #include "symtab.h"
+#include "intern.h"
 #include <stdbool.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdint.h>
+#include <unistd.h>
+#include <pthread.h>
 
 
 // Error definitions
@@ -41,31 +44,56 @@
 // Max value tha can be stored in a 16 bit value
 #define MAX_16_BIT_VALUE 0xFFFF
 
-// Global PC counter
-static int pc = 0;
-
-static int pc2 = 0;
-
-// Global symtab struct
-static void *symtab;
-
-// Global error tracker
-static int error_count = 0;
-
-// Global variable to track # of ERROR_OPERAND_FORMAT
-static int bad_operand = 0;
-
-// Global variable to track # of ERROR_CONSTANT_INVALID
-static int constant_unfit = 0;
-
-// Global variable to track # of ERROR_OPCODE_UNKOWN
-static int unknown_opcode = 0;
-
-// If value is 1, we are on pass one
-// If value is 2, we are on pass two
-static int pass_counter = 1;
-
-static FILE *file_pointer = NULL; // Initialize to NULL
+// The second pass only runs on several threads when each would have at
+// least this many lines to encode, and never on more than ENCODE_MAX_THREADS
+#define ENCODE_MIN_LINES 32768
+#define ENCODE_MAX_THREADS 16
+
+// The first pass notes the pc every this many records, and the second
+// pass splits the records between threads at those points
+#define RECORD_CHECKPOINT 4096
+
+// All of the assembler's state lives in the AsmContext (see defs.h), so
+// that several assemblies can run at once and a context can be reused.
+
+// One line of input that puts something in the image, packed by the first
+// pass into an array the second pass encodes from instead of re-parsing
+// the source. A symbol operand is the intern ID of its name, which is an
+// index into symbols_by_id once betweenPasses has filled that in.
+typedef struct ir_record {
+  uint8_t opcode; // OPCODE_ value
+  uint8_t format; // Operand format, 1 to 9
+  uint8_t regs; // First register in bits 0-3, second in bits 4-7
+  uint8_t unused;
+  int32_t operand; // Constant or offset, or the symbol's intern ID
+  int32_t lineno; // Context line number when the line was assembled
+} ir_record_t;
+
+// Where the image stood at a record, noted every RECORD_CHECKPOINT records
+typedef struct ir_checkpoint {
+  int address; // pc of the record, fixed by the first pass
+  int code_offset; // Index in the code of the image of its first word
+} ir_checkpoint_t;
+
+// One slice of the records encoded on its own thread by the second pass.
+// The context is a copy of the real one whose image is the slice's part
+// of the code, and whose messages are collected until the slices are
+// merged back in line order.
+typedef struct encode_chunk {
+  AsmContext ctx;
+  asx20_obj obj;
+  int first; // Records first to last - 1
+  int last;
+  char *text;
+  size_t text_length;
+  pthread_t thread;
+} encode_chunk_t;
+
+// A symbol as the second pass finds it, by the intern ID of its name
+typedef struct symbol_ref {
+  struct symbol_info *info;
+  const char *name;
+} symbol_ref_t;
 
 // A linked list used to track each time an imported symbol is referenced
 typedef struct Node {
@@ -87,50 +115,6 @@ typedef struct symbol_info {
   Node_t *reference_address; // A linked list of all addresses when an imported symbol is referenced
 } symbol_info_t;
 
-// Number of opcodes + directives in vmx20 system
-#define OPCODE_ARRAY_LENGTH 30
-
-// Struct used for the below table 
-typedef struct opcode_struct{
-  char *opcode_string;
-  int opcode_value;
-  int format;
-}opcode_struct_t;
-
-// Tables holding all opcodes, their associated hex value and their format number
-static opcode_struct_t opcodes[] = {
-{"halt",    0x00, 1},
-{"load",    0x01, 5},
-{"store",   0x02, 5},
-{"ldimm",   0x03, 4},
-{"ldaddr",  0x04, 5},
-{"ldind",   0x05, 7},
-{"stind",   0x06, 7},
-{"addf",    0x07, 6},
-{"subf",    0x08, 6},
-{"divf",    0x09, 6},
-{"mulf",    0x0A, 6},
-{"addi",    0x0B, 6},
-{"subi",    0x0C, 6},
-{"divi",    0x0D, 6},
-{"muli",    0x0E, 6},
-{"call",    0x0F, 2},
-{"ret",     0x10, 1},
-{"blt",     0x11, 8},
-{"bgt",     0x12, 8},
-{"beq",     0x13, 8},
-{"jmp",     0x14, 2},
-{"cmpxchg", 0x15, 8},
-{"getpid",  0x16, 3},
-{"getpn",   0x17, 3},
-{"push",    0x18, 3},
-{"pop",     0x19, 3},
-{"word",    0x00, 9}, 
-{"alloc",   0x00, 9},
-{"import",  0x00, 2},
-{"export",  0x00, 2}
-};
-
 
 // Function Prototypes
 // Descriptions can be found towards end of file
@@ -140,29 +124,122 @@ static void *create_data_node();
 static void intialize_symbol_info(symbol_info_t *symbol_info, int address, bool referenced, 
                                   bool imported, bool exported, bool defined);
 
-static int find_opcode(char *opcode);          
+static int find_opcode(int opcode);          
+
+static void **symbol_slot(AsmContext *ctx, const char *name);
+static symbol_info_t *reference_symbol(AsmContext *ctx, const char *name);
+
+static void update_pc(AsmContext *ctx, int *pc_counter, INSTR instr);
+
+static void record_line(AsmContext *ctx, INSTR instr);
+static int checkpoint_count(AsmContext *ctx);
+
+static void free_symbols(AsmContext *ctx);
+
+static void emit_word(AsmContext *ctx, uint32_t word);
+static void emit_bss(AsmContext *ctx, uint32_t length);
+
+static void encode_lines(AsmContext *ctx, int first, int last);
+static void encode_record(AsmContext *ctx, const ir_record_t *record);
+static symbol_ref_t *record_symbol(AsmContext *ctx, const ir_record_t *record);
+static void *encode_chunk(void *arg);
+static int encode_thread_count(AsmContext *ctx);
+
+
+
 
-static void update_pc(int *pc_counter, INSTR instr);
 
 
+// this is called to create a context so that the assembler can initialize
+// any internal data structures. a context can be reused for another input
+// by calling resetAssembler.
+AsmContext *createAssembler(void) {
 
+  AsmContext *ctx = calloc(1, sizeof(AsmContext));
+  if(ctx == NULL) {
+    fatal(NULL, "out of memory creating assembler context");
+  }
 
+  ctx->errfp = stderr;
+  ctx->listfp = stdout;
 
+  ctx->intern = internCreate();
+  if(ctx->intern == NULL) {
+    fatal(NULL, "out of memory creating intern table");
+  }
 
+  resetAssembler(ctx);
+  return ctx;
+}
 
-// this is called once so that the assembler can initialize any internal
-// data structures.
-void initAssemble(void) {
+// this is called to release everything the last input left in the
+// context and make it ready for the next one
+void resetAssembler(AsmContext *ctx) {
+
+  if(ctx->symtab != NULL) {
+    free_symbols(ctx);
+    symtabDelete(ctx->symtab);
+  }
+
+  scanClose(ctx);
+  free(ctx->records);
+  free(ctx->checkpoints);
+  free(ctx->symbols_by_id);
+
+  // Forget the identifiers of the last input
+  internClear(ctx->intern);
 
   // Intialize our symbol table
   // Size can be arbitrary
-  symtab = symtabCreate(100);
+  // Its names come out of an arena, freed along with the table
+  ctx->symtab = symtabCreateArena(100);
+  if(ctx->symtab == NULL) {
+    fatal(ctx, "out of memory creating symbol table");
+  }
+
+  ctx->lineno = 1;
+  ctx->scanErrorCount = 0;
+  ctx->parseErrorCount = 0;
+  ctx->pc = 0;
+  ctx->pc2 = 0;
+  ctx->error_count = 0;
+  ctx->bad_operand = 0;
+  ctx->constant_unfit = 0;
+  ctx->unknown_opcode = 0;
+  ctx->pass_counter = 1;
+  ctx->obj = NULL;
+  ctx->code_capacity = 0;
+  ctx->bss_words = 0;
+  ctx->bss_allocs = 0;
+  ctx->bss_capacity = 0;
+  ctx->code_fixed = 0;
+  ctx->records = NULL;
+  ctx->record_count = 0;
+  ctx->record_capacity = 0;
+  ctx->checkpoints = NULL;
+  ctx->checkpoint_capacity = 0;
+  ctx->symbols_by_id = NULL;
+  ctx->symbol_id_count = 0;
+}
+
+// this is called to release a context and everything it owns
+void deleteAssembler(AsmContext *ctx) {
 
+  if(ctx == NULL) {
+    return;
+  }
 
+  resetAssembler(ctx);
+  free_symbols(ctx);
+  symtabDelete(ctx->symtab);
+  internDelete(ctx->intern);
+  free(ctx);
 }
 
 // this is the "guts" of the assembler and is called for each line
-// of the input that contains a label, instruction or directive
+// of the input that contains a label, instruction or directive on the
+// first pass; the lines that go in the image are packed into records
+// that secondPass encodes
 //
 // note that there may be both a label and an instruction or directive
 // present on a line
@@ -175,71 +252,75 @@ void initAssemble(void) {
 // see defs.h for the details on how each instruction format is represented
 // in the INSTR struct.
 //
-void assemble(char *label, INSTR instr) {
+void assemble(AsmContext *ctx, char *label, INSTR instr) {
 
-  if(pass_counter == 1) {
-  // ERROR CHECK: UNKNOWN OPCODE AND INVALID OPERANDS FOR FORMAT
-  if (instr.opcode != NULL) {
+  if(ctx->pass_counter == 1) {
 
-    int valid = 0;
+  // Save the line so the second pass does not need to see the source again
+  record_line(ctx, instr);
 
-    for (int i = 0; i < OPCODE_ARRAY_LENGTH; i++) {
+  // ERROR CHECK: UNKNOWN OPCODE AND INVALID OPERANDS FOR FORMAT
+  if (instr.opcode != OPCODE_NONE) {
 
-      if (strcmp(instr.opcode, opcodes[i].opcode_string) == 0) {
-        valid = 1;  // Found a match
-        
-        // Check if operands match the expected format
-        if (instr.format != opcodes[i].format) {
+    // The scanner found the opcode in the table, or it is unknown
+    int valid = instr.opcode < OPCODE_COUNT;
 
-          //ERROR CHECK: OPCODE HAS THE INCORRECT OPERAND FORMAT
-          error(ERROR_OPERAND_FORMAT);
-          bad_operand++;
-          error_count++;
-        }
+    if (valid) {
 
-        break; // Exit loop once a match is found
+      // Check if operands match the expected format
+      if (instr.format != opcodeTable[instr.opcode].format) {
+
+        //ERROR CHECK: OPCODE HAS THE INCORRECT OPERAND FORMAT
+        error(ctx, ERROR_OPERAND_FORMAT);
+        ctx->bad_operand++;
+        ctx->error_count++;
       }
     }
 
     if (!valid) {
 
       // ERROR CHECK: UNKNOWN OPCODE ENCOUNTERED
-      error(ERROR_OPCODE_UNKNOWN, instr.opcode);
-      unknown_opcode++;
-      error_count++;
+      error(ctx, ERROR_OPCODE_UNKNOWN, instr.mnemonic);
+      ctx->unknown_opcode++;
+      ctx->error_count++;
     }
 }
   // Create a handle that will be used to store symbol information
   symbol_info_t *symbol_info;
 
+  // And the table's slot for it, which holds NULL if it was just installed
+  void **slot;
+
 
 
   if (instr.format == 0 || label) {
 
     // If this is the first time the symbol appears in the asm file...install it
-    if ((symbol_info = symtabLookup(symtab, label)) == NULL) {
+    slot = symbol_slot(ctx, label);
+    if ((symbol_info = *slot) == NULL) {
 
       // Symbol doesnt exist, create a new symbol_info struct for it
       symbol_info = create_data_node();
 
-      intialize_symbol_info(symbol_info, pc, false, false, false, true);
+      intialize_symbol_info(symbol_info, ctx->pc, false, false, false, true);
 
       // Install symbol into our table
-      symtabInstall(symtab, label, symbol_info);
+      *slot = symbol_info;
 
       /*
         
       */
       if (instr.format == 2) {
 
-        if ((symbol_info = symtabLookup(symtab, instr.u.format2.addr)) == NULL) {
+        slot = symbol_slot(ctx, instr.u.format2.addr);
+        if ((symbol_info = *slot) == NULL) {
 
           // Symbol doesnt exist, create a new symbol_info struct for it
           symbol_info = create_data_node();
 
           intialize_symbol_info(symbol_info, -1, true, false, false, false);
 
-          symtabInstall(symtab, instr.u.format2.addr, symbol_info);
+          *slot = symbol_info;
 
           symbol_info->import_reference_count++;
               
@@ -248,7 +329,7 @@ void assemble(char *label, INSTR instr) {
             exit(-1);
           }
 
-          node->address = pc;
+          node->address = ctx->pc;
           node->next = symbol_info->reference_address;
           symbol_info->reference_address = node;
               
@@ -259,14 +340,15 @@ void assemble(char *label, INSTR instr) {
 
         } else if (instr.format == 5) {
 
-            if ((symbol_info = symtabLookup(symtab, instr.u.format5.addr)) == NULL) {
+            slot = symbol_slot(ctx, instr.u.format5.addr);
+            if ((symbol_info = *slot) == NULL) {
 
                 // Symbol doesnt exist, create a new symbol_info struct for it
                 symbol_info = create_data_node();
 
                 intialize_symbol_info(symbol_info, -1, true, false, false, false);
 
-                symtabInstall(symtab, instr.u.format5.addr, symbol_info);
+                *slot = symbol_info;
                 symbol_info->import_reference_count++;
 
                 Node_t *node = malloc(sizeof(Node_t));
@@ -274,7 +356,7 @@ void assemble(char *label, INSTR instr) {
                   exit(-1);
                 }
 
-                node->address = pc;
+                node->address = ctx->pc;
                 node->next = symbol_info->reference_address;
                 symbol_info->reference_address = node;
 
@@ -282,14 +364,15 @@ void assemble(char *label, INSTR instr) {
                 symbol_info->referenced = true;
             }
         } else if (instr.format == 8) {
-            if ((symbol_info = symtabLookup(symtab, instr.u.format8.addr)) == NULL) {
+            slot = symbol_slot(ctx, instr.u.format8.addr);
+            if ((symbol_info = *slot) == NULL) {
                 
                 // Symbol doesnt exist, create a new symbol_info struct for it
                 symbol_info = create_data_node();
 
                 intialize_symbol_info(symbol_info, -1, true, false, false, false);
 
-                symtabInstall(symtab, instr.u.format8.addr, symbol_info);
+                *slot = symbol_info;
                 symbol_info->import_reference_count++;
 
                 Node_t *node = malloc(sizeof(Node_t));
@@ -297,7 +380,7 @@ void assemble(char *label, INSTR instr) {
                   exit(-1);
                 }
 
-                node->address = pc;
+                node->address = ctx->pc;
                 node->next = symbol_info->reference_address;
                 symbol_info->reference_address = node;
             } else {
@@ -308,11 +391,11 @@ void assemble(char *label, INSTR instr) {
     // ERROR: Duplicate symbol definition
     } else if (symbol_info->address != -1) {
 
-        error_count++;
-        error(ERROR_LABEL_DEFINED, label);
+        ctx->error_count++;
+        error(ctx, ERROR_LABEL_DEFINED, label);
 
     } else if (symbol_info->address == -1) {
-        symbol_info->address = pc;
+        symbol_info->address = ctx->pc;
         symbol_info->defined = true;
         symbol_info->import_reference_count++;
 
@@ -321,7 +404,7 @@ void assemble(char *label, INSTR instr) {
           exit(-1);
         }
 
-        node->address = pc;
+        node->address = ctx->pc;
         node->next = symbol_info->reference_address;
         symbol_info->reference_address = node;
         
@@ -329,17 +412,17 @@ void assemble(char *label, INSTR instr) {
 
     if(instr.format == 2) {
 
-      symbol_info = symtabLookup(symtab, instr.u.format2.addr);
+      symbol_info = reference_symbol(ctx, instr.u.format2.addr);
       symbol_info->referenced = true;
 
-      if(strcmp(instr.opcode,"import") == 0) {
+      if(instr.opcode == OPCODE_IMPORT) {
 
         Node_t *node = malloc(sizeof(Node_t));
         if(node == NULL) {
           exit(-1);
         }
 
-        node->address = pc;
+        node->address = ctx->pc;
         node->next = symbol_info->reference_address;
         symbol_info->reference_address = node;
        
@@ -351,13 +434,13 @@ void assemble(char *label, INSTR instr) {
 
     if(instr.format == 5) {
 
-      symbol_info = symtabLookup(symtab, instr.u.format5.addr);
+      symbol_info = reference_symbol(ctx, instr.u.format5.addr);
       symbol_info->referenced = true;
     }
 
     if(instr.format == 8) {
 
-      symbol_info = symtabLookup(symtab, instr.u.format8.addr);
+      symbol_info = reference_symbol(ctx, instr.u.format8.addr);
       symbol_info->referenced = true;
     }
 
@@ -366,17 +449,18 @@ void assemble(char *label, INSTR instr) {
     // We need to decrement the pc counter each time a symbol is defined in this format
     // because of the two possiblities
     if (instr.format == 0) {
-        pc--;
+        ctx->pc--;
     }
 
 
   // Export directive
-  } else if((strcmp(instr.opcode, "export")) == 0) {
+  } else if(instr.opcode == OPCODE_EXPORT) {
 
     
 
-    if(bad_operand < 1) {
-      if((symbol_info = symtabLookup(symtab, instr.u.format2.addr)) == NULL) {
+    if(ctx->bad_operand < 1) {
+      slot = symbol_slot(ctx, instr.u.format2.addr);
+      if((symbol_info = *slot) == NULL) {
 
         // Symbol doesnt exist, create a new symbol_info struct for it
         symbol_info = create_data_node();
@@ -385,14 +469,14 @@ void assemble(char *label, INSTR instr) {
         
         symbol_info->export_count = 1;
       
-        symtabInstall(symtab, instr.u.format2.addr, symbol_info);
+        *slot = symbol_info;
       } else {
         symbol_info->exported = true;
         symbol_info->export_count++;
 
         if(symbol_info->export_count > 1) {
-          error(ERROR_MULTIPLE_EXPORT, instr.u.format2.addr);
-          error_count++;
+          error(ctx, ERROR_MULTIPLE_EXPORT, instr.u.format2.addr);
+          ctx->error_count++;
         }
 
       }
@@ -400,10 +484,11 @@ void assemble(char *label, INSTR instr) {
 
 
   // Import directive  
-  } else if(strcmp(instr.opcode, "import") == 0) {
+  } else if(instr.opcode == OPCODE_IMPORT) {
 
-    if(bad_operand < 1) {
-    if((symbol_info = symtabLookup(symtab, instr.u.format2.addr)) == NULL) {
+    if(ctx->bad_operand < 1) {
+    slot = symbol_slot(ctx, instr.u.format2.addr);
+    if((symbol_info = *slot) == NULL) {
 
       // Symbol doesnt exist, create a new symbol_info struct for it
       symbol_info = create_data_node();
@@ -412,7 +497,7 @@ void assemble(char *label, INSTR instr) {
 
       symbol_info->import_count = 1;
 
-      symtabInstall(symtab, instr.u.format2.addr, symbol_info);
+      *slot = symbol_info;
     } else {
       // Check if the symbol is already marked as imported
       if (!symbol_info->imported) {
@@ -429,21 +514,22 @@ void assemble(char *label, INSTR instr) {
   // So we need to check if symbols either need to be installed or referenced
   } else if(instr.format == 2) {
       
-      if((symbol_info = symtabLookup(symtab, instr.u.format2.addr)) == NULL) {
+      slot = symbol_slot(ctx, instr.u.format2.addr);
+      if((symbol_info = *slot) == NULL) {
 
         // Symbol doesnt exist, create a new symbol_info struct for it
         symbol_info = create_data_node();
 
         intialize_symbol_info(symbol_info, -1, true, false, false, false);
 
-        symtabInstall(symtab, instr.u.format2.addr, symbol_info);
+        *slot = symbol_info;
         symbol_info->import_reference_count++;
         Node_t *node = malloc(sizeof(Node_t));
         if(node == NULL) {
           exit(-1);
         }
 
-        node->address = pc;
+        node->address = ctx->pc;
         node->next = symbol_info->reference_address;
         symbol_info->reference_address = node;
        
@@ -461,7 +547,7 @@ void assemble(char *label, INSTR instr) {
           exit(-1);
         }
 
-        node->address = pc;
+        node->address = ctx->pc;
         node->next = symbol_info->reference_address;
         symbol_info->reference_address = node;
        
@@ -470,7 +556,8 @@ void assemble(char *label, INSTR instr) {
       
     } else if(instr.format == 5) {
 
-      if((symbol_info = symtabLookup(symtab, instr.u.format5.addr)) == NULL) {
+      slot = symbol_slot(ctx, instr.u.format5.addr);
+      if((symbol_info = *slot) == NULL) {
 
         // Symbol doesnt exist, create a new symbol_info struct for it
         symbol_info = create_data_node();
@@ -478,14 +565,14 @@ void assemble(char *label, INSTR instr) {
         intialize_symbol_info(symbol_info, -1, true, false, false, false);
 
 
-        symtabInstall(symtab, instr.u.format5.addr, symbol_info);
+        *slot = symbol_info;
         symbol_info->import_reference_count++;
         Node_t *node = malloc(sizeof(Node_t));
         if(node == NULL) {
           exit(-1);
         }
 
-        node->address = pc;
+        node->address = ctx->pc;
         node->next = symbol_info->reference_address;
         symbol_info->reference_address = node;
        
@@ -501,7 +588,7 @@ void assemble(char *label, INSTR instr) {
           exit(-1);
         }
 
-        node->address = pc;
+        node->address = ctx->pc;
         node->next = symbol_info->reference_address;
         symbol_info->reference_address = node;
        
@@ -511,7 +598,8 @@ void assemble(char *label, INSTR instr) {
 
     } else if(instr.format == 8) {
 
-      if((symbol_info = symtabLookup(symtab, instr.u.format8.addr)) == NULL) {
+      slot = symbol_slot(ctx, instr.u.format8.addr);
+      if((symbol_info = *slot) == NULL) {
 
         
         // Symbol doesnt exist, create a new symbol_info struct for it
@@ -520,7 +608,7 @@ void assemble(char *label, INSTR instr) {
         intialize_symbol_info(symbol_info, -1, true, false, false, false);
 
 
-        symtabInstall(symtab, instr.u.format8.addr, symbol_info);
+        *slot = symbol_info;
         symbol_info->import_reference_count++;
 
         Node_t *node = malloc(sizeof(Node_t));
@@ -528,7 +616,7 @@ void assemble(char *label, INSTR instr) {
           exit(-1);
         }
 
-        node->address = pc;
+        node->address = ctx->pc;
         node->next = symbol_info->reference_address;
         symbol_info->reference_address = node;
        
@@ -544,7 +632,7 @@ void assemble(char *label, INSTR instr) {
           exit(-1);
         }
 
-        node->address = pc;
+        node->address = ctx->pc;
         node->next = symbol_info->reference_address;
         symbol_info->reference_address = node;
        
@@ -554,273 +642,372 @@ void assemble(char *label, INSTR instr) {
 
 
   // Update pc counter for first pass
-  update_pc(&pc, instr);
+  update_pc(ctx, &ctx->pc, instr);
 
 
   // ERROR CHECK: PROGRAM EXCEEDS MAX WORD SIZE
-  if(pc > MAX_WORDS) {
-    error(ERROR_PROGRAM_SIZE);
-    error_count++;
+  if(ctx->pc > MAX_WORDS) {
+    error(ctx, ERROR_PROGRAM_SIZE);
+    ctx->error_count++;
   }
 
   // ERROR CHECK: OFFSET DOES NOT FIT IN 16 BITS
   if(instr.format == 7) {
     if(instr.u.format7.offset >= (1 << 15) || instr.u.format7.offset < -(1 << 15)) {
-      error(ERROR_OFFSET_INVALID, instr.u.format7.offset);
-      error_count++;
+      error(ctx, ERROR_OFFSET_INVALID, instr.u.format7.offset);
+      ctx->error_count++;
     }
   }
 
   // ERROR CHECK: CONSTANT DOES NOT FIT IN 20 BITS
   if(instr.format == 4) {
     if(instr.u.format4.constant >= (1 << 19) || instr.u.format4.constant < -(1 << 19)) {
-      error(ERROR_CONSTANT_INVALID, instr.u.format4.constant);
-      constant_unfit++;
-      error_count++;
+      error(ctx, ERROR_CONSTANT_INVALID, instr.u.format4.constant);
+      ctx->constant_unfit++;
+      ctx->error_count++;
     }
   }
 } // END OF PASS 1 CHECK
 
+  // 
+  if(label || instr.format == 0) {
+    if(instr.format == 0) {
+      ctx->pc2--;
+    }
+  }
+  // Update pc2 counter for the second pass
+  update_pc(ctx, &ctx->pc2, instr);
+}
 
 
 
+// this is called after betweenPasses to drive the second pass
+//
+// the records packed on the first pass are encoded in their original
+// order, with the line number restored so that any messages report the
+// same line numbers they would have when parsing
+//
+// the first pass fixed the address of every record, and the second only
+// reads the symbols, so a large program is split at its checkpoints into
+// runs of records that are encoded on separate threads straight into
+// their own part of the code. their messages are then added in line
+// order, so the output is the same as encoding the records one after
+// the other.
+//
+void secondPass(AsmContext *ctx) {
 
-// SECOND PASS
-if(pass_counter == 2) {
- 
-  if(instr.format == 1) {
-
-
-    /*
-    Halt
-    Ret
-    */
+  int threads = encode_thread_count(ctx);
 
-    int opcode = find_opcode(instr.opcode);
+  if(threads <= 1) {
+    encode_lines(ctx, 0, ctx->record_count);
+    return;
+  }
 
-    int encoding = (opcode & 0xFF); // bits 0-7
+  asx20_obj *obj = ctx->obj;
+  int code_words = ctx->pc - ctx->bss_words;
+  int checkpoints = checkpoint_count(ctx);
 
-  
-    fwrite(&encoding, sizeof(int), 1, file_pointer);
+  encode_chunk_t *chunks = calloc(threads, sizeof(encode_chunk_t));
+  if(chunks == NULL) {
+    fatal(ctx, "out of memory starting second pass");
+  }
 
+  for(int t = 0; t < threads; t++) {
 
-  } else if(instr.format == 2) {
+    encode_chunk_t *chunk = &chunks[t];
 
-    /*
-    call
-    jmp
-    import
-    export
+    // Each chunk starts at a checkpoint, and there are at least as many
+    // checkpoints as threads, so none is empty
+    int first = (int) ((long) checkpoints * t / threads);
+    int last = (int) ((long) checkpoints * (t + 1) / threads);
 
-    We skip encodings for import and export
-    */
-
-    if(strcmp(instr.opcode, "jmp") == 0 || strcmp(instr.opcode, "call") == 0) {
+    chunk->first = first * RECORD_CHECKPOINT;
+    chunk->last = last < checkpoints ?
+      last * RECORD_CHECKPOINT : ctx->record_count;
 
-      symbol_info_t *symbol_info = symtabLookup(symtab, instr.u.format2.addr);
+    int code_start = ctx->checkpoints[first].code_offset;
+    int code_end = last < checkpoints ?
+      ctx->checkpoints[last].code_offset : code_words;
 
-      int opcode = find_opcode(instr.opcode);
+    // The slice of the image this chunk fills, which can't grow
+    chunk->obj.code = obj->code + code_start;
 
+    chunk->ctx = *ctx;
+    chunk->ctx.obj = &chunk->obj;
+    chunk->ctx.code_capacity = code_end - code_start;
+    chunk->ctx.code_fixed = 1;
+    chunk->ctx.bss_capacity = 0;
+    chunk->ctx.pc2 = ctx->checkpoints[first].address;
+    chunk->ctx.error_count = 0;
+    chunk->ctx.errfp = open_memstream(&chunk->text, &chunk->text_length);
+    if(chunk->ctx.errfp == NULL) {
+      fatal(ctx, "can't create stream for second pass messages");
+    }
 
-      int address = 0;
-      if(!symbol_info->imported) {
+    if(pthread_create(&chunk->thread, NULL, encode_chunk, chunk)) {
+      fatal(ctx, "can't create thread for second pass");
+    }
+  }
 
-        int pc_current = pc2 + 1;
-        int pc_new = symbol_info->address;
+  // Merge the chunks back into the image in line order
+  for(int t = 0; t < threads; t++) {
 
-        /*
-        Pc New = Pc Current + Address
-        */
-        address = pc_new - pc_current;
-      }
+    encode_chunk_t *chunk = &chunks[t];
 
-      // ERROR CHECK: ADDRESS DOES NOT FIT IN 20 BITS
-      if(address > 0x7FFFF || address < -0x80000) {
-        error(ERROR_LABEL_SIZE20, instr.u.format2.addr);
-        error_count++;
-      }
+    pthread_join(chunk->thread, NULL);
 
-      int encoding = ((address & 0xFFFFF) << 12) |
-                      (opcode & 0xFF); 
+    fwrite(chunk->text, 1, chunk->text_length, ctx->errfp);
+    free(chunk->text);
+    ctx->error_count += chunk->ctx.error_count;
 
-      fwrite(&encoding, sizeof(int), 1, file_pointer);
+    if(chunk->obj.code_count != chunk->ctx.code_capacity) {
+      bug(ctx, "second pass encoded %d words of records %d to %d, expected %d",
+        chunk->obj.code_count, chunk->first, chunk->last - 1,
+        chunk->ctx.code_capacity);
     }
+    obj->code_count += chunk->obj.code_count;
 
-  } else if(instr.format == 3) {
-
-    int opcode = find_opcode(instr.opcode);
-    int r1 = instr.u.format3.reg;
-
-
-    int encoding = ((r1 & 0xF) << 8) |
-                    (opcode & 0xFF);
+    for(int i = 0; i < chunk->obj.bss_count; i++) {
+      ctx->pc2 = chunk->obj.bss[i].address;
+      emit_bss(ctx, chunk->obj.bss[i].length);
+    }
+    free(chunk->obj.bss);
 
-    fwrite(&encoding, sizeof(int), 1, file_pointer);
+    ctx->pc2 = chunk->ctx.pc2;
+    ctx->lineno = chunk->ctx.lineno;
+  }
 
+  free(chunks);
+}
 
-  } else if(instr.format == 4) {
+/*
+Params: The context being assembled, the first record and one past the last
 
-    int opcode = find_opcode(instr.opcode);
+Encode the records first to last - 1 into the image
+*/
+static void encode_lines(AsmContext *ctx, int first, int last) {
 
+  for(int i = first; i < last; i++) {
+    ctx->lineno = ctx->records[i].lineno;
+    encode_record(ctx, &ctx->records[i]);
+  }
+}
 
-    int encoding = ((instr.u.format4.constant & 0xFFFFF) << 12) |
-                    ((instr.u.format4.reg & 0xF) << 8) |
-                    (opcode & 0xFF);
+/*
+Params: The context being assembled, a record packed by the first pass
 
-    fwrite(&encoding, sizeof(int), 1, file_pointer);
+Encode the record at pc2 and move pc2 past it
+*/
+static void encode_record(AsmContext *ctx, const ir_record_t *record) {
 
+  int opcode = find_opcode(record->opcode);
+  int reg1 = record->regs & 0xF;
+  int reg2 = record->regs >> 4;
 
+  if(record->format == 1) {
 
-  } else if(instr.format == 5) {
+    /*
+    Halt
+    Ret
+    */
+    emit_word(ctx, opcode & 0xFF); // bits 0-7
 
+  } else if(record->format == 2 || record->format == 5) {
 
-    symbol_info_t *symbol_info = symtabLookup(symtab, instr.u.format5.addr);
+    /*
+    call
+    jmp
+    and the format 5 instructions with a register and an address
 
-    int encoding = 0;
-    int opcode = find_opcode(instr.opcode);
-    int register_num = instr.u.format5.reg;
+    Only jmp and call are recorded of the format 2 lines, since import
+    and export put nothing in the code
+    */
+    symbol_ref_t *symbol = record_symbol(ctx, record);
 
     int address = 0;
+    if(!symbol->info->imported) {
 
-    if(!symbol_info->imported) {
-      int pc_current = pc2;
-      pc_current++;
-
-      int pc_new = symbol_info->address;
-
-      address = pc_new - pc_current;
+      /*
+      Pc New = Pc Current + Address
+      */
+      address = symbol->info->address - (ctx->pc2 + 1);
     }
 
-     // ERROR CHECK: ADDRESS DOES NOT FIT IN 20 BITS
-     if(address > 0x7FFFF || address < -0x80000) {
-      error(ERROR_LABEL_SIZE20, instr.u.format5.addr);
-      error_count++;
+    // ERROR CHECK: ADDRESS DOES NOT FIT IN 20 BITS
+    if(address > 0x7FFFF || address < -0x80000) {
+      error(ctx, ERROR_LABEL_SIZE20, symbol->name, address);
+      ctx->error_count++;
     }
 
-    encoding = ((address & 0xFFFFF) << 12) | // Address in upper bits
-           ((register_num & 0xF) << 8) |     // Register in middle 4 bits
-           (opcode & 0xFF);                  // Opcode in lower 8 bits
-
-    fwrite(&encoding, sizeof(int), 1, file_pointer);
-
-
-
-
-  } else if(instr.format == 6) {
-
-    int opcode = find_opcode(instr.opcode);
-
-    int encoding = ((instr.u.format6.reg2 & 0xF) << 12) |  // reg2 in bits 12-15
-                   ((instr.u.format6.reg1 & 0xF) << 8)  |   // reg1 in bits 8-11
-                   (opcode & 0xFF);         // opcode in bits 0-7
-
-    fwrite(&encoding, sizeof(int), 1, file_pointer);
+    int encoding = ((address & 0xFFFFF) << 12) | // Address in upper bits
+                   (reg1 << 8) |                 // Register in middle 4 bits
+                   (opcode & 0xFF);              // Opcode in lower 8 bits
 
+    emit_word(ctx, encoding);
 
-  } else if(instr.format == 7) {
+  } else if(record->format == 3 || record->format == 6) {
 
-    // Get the instructions numeric opcode
-    int opcode = find_opcode(instr.opcode);
+    int encoding = (reg2 << 12) |  // reg2 in bits 12-15, 0 for format 3
+                   (reg1 << 8)  |  // reg1 in bits 8-11
+                   (opcode & 0xFF);
 
-    int reg1 = instr.u.format7.reg1;
-    int reg2 = instr.u.format7.reg2;
+    emit_word(ctx, encoding);
 
-    int encoding = ((instr.u.format7.offset & 0xFFFFF) << 16) | // Address in upper bits
-                    ((reg2 & 0xF) << 12) |  // reg2 in bits 12-15
-                    ((reg1 & 0xF) << 8)  |   // reg1 in bits 8-11
-                    (opcode & 0xFF);         // opcode in bits 0-7
+  } else if(record->format == 4) {
 
+    int encoding = ((record->operand & 0xFFFFF) << 12) |
+                   (reg1 << 8) |
+                   (opcode & 0xFF);
 
-    fwrite(&encoding, sizeof(int), 1, file_pointer);
+    emit_word(ctx, encoding);
 
+  } else if(record->format == 7) {
 
-  } else if(instr.format == 8) {
+    int encoding = ((record->operand & 0xFFFFF) << 16) | // Offset in upper bits
+                   (reg2 << 12) |  // reg2 in bits 12-15
+                   (reg1 << 8)  |  // reg1 in bits 8-11
+                   (opcode & 0xFF);  // opcode in bits 0-7
 
-    symbol_info_t *symbol_info = symtabLookup(symtab, instr.u.format8.addr);
+    emit_word(ctx, encoding);
 
+  } else if(record->format == 8) {
 
-    int opcode = find_opcode(instr.opcode);
-    int reg1 = instr.u.format8.reg1;
-    int reg2 = instr.u.format8.reg2;
+    symbol_ref_t *symbol = record_symbol(ctx, record);
 
     int address = 0;
-      if(!symbol_info->imported) {
-      int pc_current = pc2;
-      pc_current++;
-
-      int pc_new = symbol_info->address;
-
-      address = pc_new - pc_current;
+    if(!symbol->info->imported) {
+      address = symbol->info->address - (ctx->pc2 + 1);
     }
 
-     // ERROR CHECK: ADDRESS DOES NOT FIT IN 16 BITS
-     if(address > 0x7FFF || address < -0x8000) {
-      error(ERROR_LABEL_SIZE16, instr.u.format8.addr);
-      error_count++;
-     }
+    // ERROR CHECK: ADDRESS DOES NOT FIT IN 16 BITS
+    if(address > 0x7FFF || address < -0x8000) {
+      error(ctx, ERROR_LABEL_SIZE16, symbol->name, address);
+      ctx->error_count++;
+    }
 
     int encoding = ((address & 0xFFFFF) << 16) | // Address in upper bits
-                    ((reg2 & 0xF) << 12) |  // reg2 in bits 12-15
-                    ((reg1 & 0xF) << 8)  |   // reg1 in bits 8-11
-                    (opcode & 0xFF);         // opcode in bits 0-7
-
-
-    fwrite(&encoding, sizeof(int), 1, file_pointer);
+                   (reg2 << 12) |  // reg2 in bits 12-15
+                   (reg1 << 8)  |  // reg1 in bits 8-11
+                   (opcode & 0xFF);  // opcode in bits 0-7
 
+    emit_word(ctx, encoding);
 
-  } else if(instr.format == 9) {
+  } else if(record->format == 9) {
 
     /*
     word
     alloc
     */
-    int zero = 0;
-    if(strcmp(instr.opcode, "word") == 0) {
-      fwrite(&instr.u.format9.constant, sizeof(int), 1, file_pointer);
+    if(record->opcode == OPCODE_WORD) {
+      emit_word(ctx, record->operand);
     } else {
-
-      for(int i = 0; i < instr.u.format9.constant; i++) {
-        fwrite(&zero, sizeof(int), 1, file_pointer);
+      if(ctx->options & ASX20_BSS) {
+        emit_bss(ctx, record->operand);
+      } else {
+        for(int i = 0; i < record->operand; i++) {
+          emit_word(ctx, 0);
+        }
       }
+
+      // An alloc takes as many words as it reserves
+      ctx->pc2 += record->operand - 1;
     }
+  }
+
+  ctx->pc2++;
+}
+
+/*
+Params: The context being assembled, a record with a symbol operand
 
+Return: The symbol the record refers to, which the first pass made sure
+        is defined or imported
+*/
+static symbol_ref_t *record_symbol(AsmContext *ctx, const ir_record_t *record) {
+
+  if(record->operand < 0 || record->operand >= ctx->symbol_id_count ||
+     ctx->symbols_by_id[record->operand].info == NULL) {
+    bug(ctx, "second pass found no symbol with intern ID %d", record->operand);
   }
+
+  return &ctx->symbols_by_id[record->operand];
 }
 
+/*
+Params: The encode_chunk_t to encode
+
+Thread body for the second pass: encode one chunk's records with its own
+copy of the context
+*/
+static void *encode_chunk(void *arg) {
 
+  encode_chunk_t *chunk = arg;
 
+  encode_lines(&chunk->ctx, chunk->first, chunk->last);
+  fclose(chunk->ctx.errfp);
+  return NULL;
+}
 
+/*
+Params: The context being assembled
 
+Return: The number of threads to run the second pass on; the context's
+        threads if it is set, otherwise one per online CPU, but
+        never so many that a thread gets fewer than ENCODE_MIN_LINES
+        records, nor more threads than checkpoints
+*/
+static int encode_thread_count(AsmContext *ctx) {
 
-  // 
-  if(label || instr.format == 0) {
-    if(instr.format == 0) {
-      pc2--;
+  int threads = ctx->threads;
+
+  if(threads <= 0) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    threads = cpus > 0 ? (int) cpus : 1;
+    if(threads > ctx->record_count / ENCODE_MIN_LINES) {
+      threads = ctx->record_count / ENCODE_MIN_LINES;
     }
   }
-  // Update pc2 counter for the second pass
-  update_pc(&pc2, instr);
+  if(threads > ENCODE_MAX_THREADS) {
+    threads = ENCODE_MAX_THREADS;
+  }
+  if(threads > checkpoint_count(ctx)) {
+    threads = checkpoint_count(ctx);
+  }
+  return threads;
 }
 
-
-
-// this is called between passes and provides the assembler the file
-// pointer to use for outputing the object file
+// this is called between passes and provides the assembler the image
+// to build the object in; the header, export and import tables are
+// filled in here and the code by the second pass
+//
+// symbols are listed and put in the tables in the order of their names
+// (the sorted view of the symbol table, made once and walked by each
+// step here), never in the table's own order, so the object file and
+// listing for a source are the same byte for byte whatever the symbol
+// table does inside; the object cache of the asx20 driver relies on
+// that
 //
 // it returns the number of errors seen on pass1
 //
-int betweenPasses(FILE *outf) {
+int betweenPasses(AsmContext *ctx, asx20_obj *obj) {
 
-  // Assign the file pointer parameter to a static variable so it can 
-  // be accessed in assemble during our second pass for encodings
-  if (file_pointer == NULL) { 
-    file_pointer = outf; 
+  // Keep the image in the context so it can be accessed in assemble
+  // during our second pass for encodings
+  if (ctx->obj == NULL) { 
+    ctx->obj = obj; 
   }
 
   // Set pc2 to 0 after we finish our first pass
-  if (pass_counter == 1) {
-    pc2 = 0;
+  if (ctx->pass_counter == 1) {
+    ctx->pc2 = 0;
+  }
+
+  // Every step below goes through the symbols in order of their names
+  void *view = symtabSortedView(ctx->symtab);
+  if(view == NULL) {
+    fatal(ctx, "out of memory sorting symbol table");
   }
+  int view_count = symtabSortedCount(view);
 
 
   // Error Checking
@@ -831,67 +1018,53 @@ int betweenPasses(FILE *outf) {
   Due to reasons I hadn't enough time to invesitgate why, I had to make sure that if certain errors happened,
   I never looped through my BST or else a seg fault would happen
   */
-  if(pc  < MAX_WORDS && bad_operand < 1 && constant_unfit < 1 && unknown_opcode < 1) { 
+  if(ctx->pc  < MAX_WORDS && ctx->bad_operand < 1 && ctx->constant_unfit < 1 && ctx->unknown_opcode < 1) { 
     
 
-    // Create dummy error structs to iterate through our symbols
-    void *error_iterator = symtabCreateIterator(symtab);
-    if(error_iterator == NULL) {
-      fprintf(stderr, "ERROR Symtab iterator creation failed.");
-    }
-
-    void *error_BSTroot = symtabCreateBST(error_iterator);
-    if(error_BSTroot == NULL) {
-      fprintf(stderr, "ERROR BST ROOT IS NULL!!\n");
-    }
-    void *error_BSTiterator = symtabCreateBSTIterator(error_BSTroot);
-    if(error_BSTiterator == NULL) {
-      fprintf(stderr, "ERROR BST ITERATOR IS NULL!!\n");
-    }
-
     const char *error_symbol;
     void *error_return_data;
 
 
-    // Go through our symtab tree and check all symbols for possible errors
-    while((error_symbol = symtabBSTNext(error_BSTiterator, &error_return_data)) != NULL) {
-      
+    // Go through our symbols and check all of them for possible errors
+    for(int i = 0; i < view_count; i++) {
+
+      error_symbol = symtabSortedEntry(view, i, &error_return_data);
       symbol_info_t *error_symbol_info = error_return_data;
 
       // ERROR: SYMBOL IS IMPORTED AND EXPORTED
       if(error_symbol_info->imported == true && error_symbol_info->exported == true) {
-        error(ERROR_SYMBOL_IMPORT_EXPORT, error_symbol);
-        error_count++;
+        error(ctx, ERROR_SYMBOL_IMPORT_EXPORT, error_symbol);
+        ctx->error_count++;
       }
 
       // ERROR CHECK: IF SYMBOL IS IMPORTED BUT ALSO DEFINED
       if(error_symbol_info->defined == true && error_symbol_info->imported == true) {
-        error(ERROR_SYMBOL_IMPORT_DEFINED, error_symbol);
-        error_count++;
+        error(ctx, ERROR_SYMBOL_IMPORT_DEFINED, error_symbol);
+        ctx->error_count++;
       }
 
       // ERROR CHECK: IF SYMBOL IS IMPORTED MULTIPLE TIMES
       if(error_symbol_info->import_count > 1) {
-        error(ERROR_MULTIPLE_IMPORT, error_symbol);
-        error_count++;
+        error(ctx, ERROR_MULTIPLE_IMPORT, error_symbol);
+        ctx->error_count++;
       }
 
       // ERROR CHECK: IF SYMBOL IS IMPORTED BUT NOT REFERENCD
       if(error_symbol_info->referenced == false && error_symbol_info->imported == true) {
-        error(ERROR_SYMBOL_IMPORT_NO_REFERENCE, error_symbol);
-        error_count++;
+        error(ctx, ERROR_SYMBOL_IMPORT_NO_REFERENCE, error_symbol);
+        ctx->error_count++;
       }
 
       // ERROR CHECK: IF SYMBOL IS REFERENCED BUT NOT DEFINED OR IMPORTED
       if(error_symbol_info->referenced == true && error_symbol_info->defined == false && error_symbol_info->imported == false) {
-        error(ERROR_LABEL_REFERENCE_NOT_FOUND, error_symbol);
-        error_count++;
+        error(ctx, ERROR_LABEL_REFERENCE_NOT_FOUND, error_symbol);
+        ctx->error_count++;
       }
 
       // ERROR CHECK: IF SYMBOL IS EXPORTED BUT HAS NO DEFINITION
       if(error_symbol_info->exported == true && error_symbol_info->defined == false) {
-        error(ERROR_SYMBOL_EXPORT_NO_DEFINITION, error_symbol);
-        error_count++;
+        error(ctx, ERROR_SYMBOL_EXPORT_NO_DEFINITION, error_symbol);
+        ctx->error_count++;
       }
 
     }
@@ -900,124 +1073,118 @@ int betweenPasses(FILE *outf) {
 
   // If we have no errors, we can proceed with processing all required information
 
-  if(error_count == 0) {
+  if(ctx->error_count == 0) {
 
     int import_symbol_references = 0;
-  
-    // Create our symbol table iterator
-    void *iterator = symtabCreateIterator(symtab);
-    if(iterator == NULL) {
-      fprintf(stderr, "Symtab iterator creation failed.");
-    }
-
-    // Get the root of our BST 
-    void *BSTroot = symtabCreateBST(iterator);
-    if(BSTroot == NULL) {
-      fprintf(stderr, "BST ROOT IS NULL!!\n");
-    }
-
-    // Create our iterator to go through our BST and get all symbols
-    // and associated data
-    void *BSTiterator = symtabCreateBSTIterator(BSTroot);
-    if(BSTiterator == NULL) {
-      fprintf(stderr, "BST ITERATOR IS NULL!!\n");
-    }
-
 
     const char *symbol;
     void *return_data;
     int exported_count = 0;
+    int import_count = 0;
+
+    // The records of the second pass refer to symbols by the intern ID
+    // of their names
+    ctx->symbol_id_count = internCount(ctx->intern);
+    ctx->symbols_by_id = calloc(ctx->symbol_id_count + 1, sizeof(symbol_ref_t));
+    if(ctx->symbols_by_id == NULL) {
+      fatal(ctx, "out of memory indexing symbols for second pass");
+    }
 
 
-    while((symbol = symtabBSTNext(BSTiterator, &return_data)) != NULL) {
+    for(int i = 0; i < view_count; i++) {
 
+      symbol = symtabSortedEntry(view, i, &return_data);
       symbol_info_t *symbol_info = return_data;
 
+      const char *name = internString(ctx->intern, symbol, strlen(symbol));
+      if(name == NULL || internId(name) >= ctx->symbol_id_count) {
+        bug(ctx, "symbol %s was not interned on the first pass", symbol);
+      }
+      ctx->symbols_by_id[internId(name)].info = symbol_info;
+      ctx->symbols_by_id[internId(name)].name = name;
+
 
-      printf("%s",symbol);
+      fprintf(ctx->listfp, "%s",symbol);
 
       if(symbol_info->address != -1) {
-        printf(" %i", symbol_info->address);
+        fprintf(ctx->listfp, " %i", symbol_info->address);
       }
 
       if(symbol_info->referenced == true) {
-        printf(" referenced");
+        fprintf(ctx->listfp, " referenced");
       }
       if(symbol_info->exported == true) {
 
-        printf(" exported");
+        fprintf(ctx->listfp, " exported");
         exported_count++;
 
       }
       if(symbol_info->imported == true) {
-        printf(" imported");
+        fprintf(ctx->listfp, " imported");
         import_symbol_references += symbol_info->import_reference_count;
+
+        for(Node_t *current = symbol_info->reference_address; current != NULL; current = current->next) {
+          import_count++;
+        }
       }
-      printf("\n");
+      fprintf(ctx->listfp, "\n");
     }
 
   
-    int inSymbol_size = exported_count * 5;
-    int outSymbol_size = import_symbol_references * 5;
-    int program_size = pc;
-
-    // Write header of object file
-    fwrite(&inSymbol_size, sizeof(int), 1, outf);
-    fwrite(&outSymbol_size, sizeof(int), 1, outf);
-    fwrite(&program_size, sizeof(int), 1, outf);
-
-
-    /*
-    Go through our BST again and write out
-      1. All exported symbols and their address to obj file
-    */
-
-    // Create our symbol table iterator
-    void *iterator2 = symtabCreateIterator(symtab);
-    if(iterator == NULL) {
-      fprintf(stderr, "Symtab iterator2 creation failed.");
+    // Header of object file; the program size is the number of code
+    // words, which the second pass fills in
+    obj->insymbolWords = exported_count * 5;
+    obj->outsymbolWords = import_symbol_references * 5;
+
+    obj->program_words = ctx->pc;
+
+    // With ASX20_BSS the words reserved by alloc are listed, not stored,
+    // and there is at most one entry per alloc
+    obj->exports = malloc(exported_count * sizeof(asx20_symbol) + 1);
+    obj->imports = malloc(import_count * sizeof(asx20_symbol) + 1);
+    obj->code = malloc((ctx->pc - ctx->bss_words) * sizeof(uint32_t) + 1);
+    if(obj->exports == NULL || obj->imports == NULL || obj->code == NULL) {
+      fatal(ctx, "out of memory allocating object image");
     }
+    ctx->code_capacity = ctx->pc - ctx->bss_words;
 
-    // Get the root of our BST 
-    void *BSTroot2 = symtabCreateBST(iterator2);
-    if(BSTroot == NULL) {
-      fprintf(stderr, "BST ROOT2 IS NULL!!\n");
+    if(ctx->options & ASX20_BSS) {
+      obj->bss = malloc(ctx->bss_allocs * sizeof(asx20_bss) + 1);
+      if(obj->bss == NULL) {
+        fatal(ctx, "out of memory allocating object image");
+      }
+      ctx->bss_capacity = ctx->bss_allocs;
     }
 
-    // Create our iterator to go through our BST and get all symbols
-    // and associated data
-    void *BSTiterator2 = symtabCreateBSTIterator(BSTroot2);
-    if(BSTiterator == NULL) {
-      fprintf(stderr, "BST ITERATOR2 IS NULL!!\n");
-    }
 
+    /*
+    Go through our symbols again and write out
+      1. All exported symbols and their address to the image
+    */
 
     const char *symbol2;
     void *return_data2;
 
-    while((symbol2 = symtabBSTNext(BSTiterator2, &return_data2)) != NULL) {
+    for(int i = 0; i < view_count; i++) {
 
-      
+      symbol2 = symtabSortedEntry(view, i, &return_data2);
       symbol_info_t *symbol_info2 = return_data2;
 
       
-        // Write inSymbols to object file
+        // Add inSymbols to object image
 
         if(symbol_info2->exported == true) {
 
         
 
-          // Buffer for symbol name exactly 16 bytes long
-          char symbol_name_buffer[100] = {0};
-        
-          // Copy symbol name, truncating or padding as necessary
-          strncpy(symbol_name_buffer, symbol2, sizeof(symbol_name_buffer) - 1);
+          asx20_symbol *export = &obj->exports[obj->export_count++];
 
-          // Write the 16-byte symbol name (4 words)
-          fwrite(symbol_name_buffer, sizeof(char), 16, outf);
+          // Copy symbol name, truncated or padded; the table's copy is
+          // already zero padded to 16 characters
+          memcpy(export->name, symbol2, 16);
+          export->name[16] = '\0';
 
-          // Write the address as the 5th word
-          fwrite(&symbol_info2->address, sizeof(uint32_t), 1, outf);
+          export->address = symbol_info2->address;
     
     
         }
@@ -1026,39 +1193,20 @@ int betweenPasses(FILE *outf) {
 
 
     /*
-    Go through our BST again and write out
-      2. All imported symbols and their referenced addresses to obj file
+    Go through our symbols again and write out
+      2. All imported symbols and their referenced addresses to the image
     */
 
-    // Create our symbol table iterator
-    void *iterator3 = symtabCreateIterator(symtab);
-    if(iterator == NULL) {
-      fprintf(stderr, "Symtab iterator3 creation failed.");
-    }
-
-    // Get the root of our BST 
-    void *BSTroot3 = symtabCreateBST(iterator3);
-    if(BSTroot == NULL) {
-      fprintf(stderr, "BST3 ROOT IS NULL!!\n");
-    }
-
-    // Create our iterator to go through our BST and get all symbols
-    // and associated data
-    void *BSTiterator3 = symtabCreateBSTIterator(BSTroot3);
-    if(BSTiterator == NULL) {
-      fprintf(stderr, "BST3 ITERATOR IS NULL!!\n");
-    }
-
-
     const char *symbol3;
     void *return_data3;
 
-    while((symbol3 = symtabBSTNext(BSTiterator3, &return_data3)) != NULL) {
-      
+    for(int i = 0; i < view_count; i++) {
+
+      symbol3 = symtabSortedEntry(view, i, &return_data3);
       symbol_info_t *symbol_info3 = return_data3;
     
 
-      // Write inSymbols to object file
+      // Add outSymbols to object image
       if(symbol_info3->imported == true) {
 
         Node_t *current = symbol_info3->reference_address;
@@ -1066,18 +1214,14 @@ int betweenPasses(FILE *outf) {
         while(current != NULL) {
 
         
-          // Buffer for symbol name exactly 16 bytes long
-          char symbol_name_buffer[100] = {0};
-        
-          // Copy symbol name, truncating or padding as necessary
-          strncpy(symbol_name_buffer, symbol3, sizeof(symbol_name_buffer) - 1);
+          asx20_symbol *import = &obj->imports[obj->import_count++];
 
+          // Copy symbol name, truncated or padded; the table's copy is
+          // already zero padded to 16 characters
+          memcpy(import->name, symbol3, 16);
+          import->name[16] = '\0';
 
-          // Write the 16-byte symbol name (4 words)
-          fwrite(symbol_name_buffer, sizeof(char), 16, outf);
-
-          // Write the address as the 5th word
-          fwrite(&current->address, sizeof(uint32_t), 1, outf);
+          import->address = current->address;
 
           current = current->next;
         }
@@ -1086,11 +1230,13 @@ int betweenPasses(FILE *outf) {
     }
   }
 
+  symtabDeleteSortedView(view);
+
   // Set pass counter to 2 as right before we enter the pass
-  pass_counter = 2;
+  ctx->pass_counter = 2;
 
   // The number of errors encountered on pass 1
-  return error_count;
+  return ctx->error_count;
 }
 
 
@@ -1131,56 +1277,317 @@ static void intialize_symbol_info(symbol_info_t *symbol_info, int address, bool
   symbol_info->export_count = 0;
   symbol_info->import_count = 0;
   symbol_info->import_reference_count = 0;
+  symbol_info->reference_address = NULL;
 
 }
 
 
 /*
-Param: A char pointer to an instructions opcode string
+Param: An instruction's opcode, as the scanner found it
 
-Return: The numeric value associated with the passed in opcode string
+Return: The numeric value associated with the opcode
 */
-static int find_opcode(char *opcode) {
+static int find_opcode(int opcode) {
 
-  int opcode_val = 0;
+  return opcode < OPCODE_COUNT ? opcodeTable[opcode].encoding : 0;
+}                                  
 
-  // Find our symbol in the symbol array and grab its numeric opcode
-  for(int i = 0; i < OPCODE_ARRAY_LENGTH; i++) {
 
-    if(strcmp(opcodes[i].opcode_string, opcode) == 0) {
-      opcode_val = opcodes[i].opcode_value; // Opcode found
-  
+/*
+Params: The context being assembled, a name interned by the scanner
+
+Return: The symbol table's slot for the symbol_info of the name, which
+        holds NULL if the name has just been installed; it must be set
+        before anything else is installed
+
+The hash is the one worked out when the name was interned, so the name
+is not hashed again
+*/
+static void **symbol_slot(AsmContext *ctx, const char *name) {
+
+  void **slot = symtabLookupOrInsert(ctx->symtab, name, internHash(name));
+  if(slot == NULL) {
+    fatal(ctx, "out of memory installing symbol %s", name);
+  }
+
+  return slot;
+}
+
+/*
+Params: The context being assembled, a name interned by the scanner that
+        a line refers to
+
+Return: The symbol_info of the name, installed as a reference to be
+        defined or imported later if it is not installed yet; it isn't
+        when the line defines a label that was referred to before
+*/
+static symbol_info_t *reference_symbol(AsmContext *ctx, const char *name) {
+
+  void **slot = symbol_slot(ctx, name);
+  symbol_info_t *symbol_info = *slot;
+
+  if(symbol_info == NULL) {
+
+    symbol_info = create_data_node();
+
+    intialize_symbol_info(symbol_info, -1, true, false, false, false);
+
+    *slot = symbol_info;
+
+    symbol_info->import_reference_count++;
+
+    Node_t *node = malloc(sizeof(Node_t));
+    if(node == NULL) {
+      exit(-1);
     }
+
+    node->address = ctx->pc;
+    node->next = symbol_info->reference_address;
+    symbol_info->reference_address = node;
   }
 
-  return opcode_val;
-}                                  
+  return symbol_info;
+}
+
+
+/*
+Params: The instruction the parser gave us for a line
+
+Pack the line into a record for the second pass, growing the array as
+needed. Lines with only a label, and import and export, put nothing in
+the image and are not recorded.
+*/
+static void record_line(AsmContext *ctx, INSTR instr) {
+
+  if(instr.format == 0 || instr.opcode == OPCODE_IMPORT ||
+     instr.opcode == OPCODE_EXPORT) {
+    return;
+  }
+
+  if(ctx->record_count == ctx->record_capacity) {
+
+    int new_capacity = ctx->record_capacity ? ctx->record_capacity * 2 : 1024;
+
+    ir_record_t *new_records = realloc(ctx->records, new_capacity * sizeof(ir_record_t));
+    if(new_records == NULL) {
+      fatal(ctx, "out of memory recording line for second pass");
+    }
+
+    ctx->records = new_records;
+    ctx->record_capacity = new_capacity;
+  }
+
+  // Note where the image stands every RECORD_CHECKPOINT records
+  if(ctx->record_count % RECORD_CHECKPOINT == 0) {
+
+    int checkpoint = ctx->record_count / RECORD_CHECKPOINT;
+
+    if(checkpoint == ctx->checkpoint_capacity) {
+
+      int new_capacity = ctx->checkpoint_capacity ? ctx->checkpoint_capacity * 2 : 16;
+
+      ir_checkpoint_t *new_checkpoints = realloc(ctx->checkpoints,
+        new_capacity * sizeof(ir_checkpoint_t));
+      if(new_checkpoints == NULL) {
+        fatal(ctx, "out of memory recording line for second pass");
+      }
+
+      ctx->checkpoints = new_checkpoints;
+      ctx->checkpoint_capacity = new_capacity;
+    }
+
+    ctx->checkpoints[checkpoint].address = ctx->pc;
+    ctx->checkpoints[checkpoint].code_offset = ctx->pc - ctx->bss_words;
+  }
+
+  ir_record_t *record = &ctx->records[ctx->record_count++];
+
+  record->opcode = instr.opcode;
+  record->format = instr.format;
+  record->regs = 0;
+  record->unused = 0;
+  record->operand = 0;
+  record->lineno = ctx->lineno;
+
+  switch(instr.format) {
+    case 2:
+      record->operand = internId(instr.u.format2.addr);
+      break;
+    case 3:
+      record->regs = instr.u.format3.reg & 0xF;
+      break;
+    case 4:
+      record->regs = instr.u.format4.reg & 0xF;
+      record->operand = instr.u.format4.constant;
+      break;
+    case 5:
+      record->regs = instr.u.format5.reg & 0xF;
+      record->operand = internId(instr.u.format5.addr);
+      break;
+    case 6:
+      record->regs = (instr.u.format6.reg1 & 0xF) | (instr.u.format6.reg2 & 0xF) << 4;
+      break;
+    case 7:
+      record->regs = (instr.u.format7.reg1 & 0xF) | (instr.u.format7.reg2 & 0xF) << 4;
+      record->operand = instr.u.format7.offset;
+      break;
+    case 8:
+      record->regs = (instr.u.format8.reg1 & 0xF) | (instr.u.format8.reg2 & 0xF) << 4;
+      record->operand = internId(instr.u.format8.addr);
+      break;
+    case 9:
+      record->operand = instr.u.format9.constant;
+      break;
+  }
+}
+
+/*
+Params: The context being assembled
+
+Return: The number of checkpoints noted in the records
+*/
+static int checkpoint_count(AsmContext *ctx) {
+
+  return (ctx->record_count + RECORD_CHECKPOINT - 1) / RECORD_CHECKPOINT;
+}
+
+
+/*
+Params: The context being assembled, one encoded word
+
+Append the word to the code of the image. betweenPasses sized the code
+for the program found on the first pass, so it only grows if the second
+pass disagrees.
+*/
+static void emit_word(AsmContext *ctx, uint32_t word) {
+
+  asx20_obj *obj = ctx->obj;
+
+  if(obj->code_count == ctx->code_capacity) {
+
+    // A chunk of a parallel second pass writes into its part of the
+    // image and can't move it
+    if(ctx->code_fixed) {
+      bug(ctx, "second pass encoded more words than the first pass counted");
+    }
+
+    int new_capacity = ctx->code_capacity ? ctx->code_capacity * 2 : 1024;
+
+    uint32_t *new_code = realloc(obj->code, new_capacity * sizeof(uint32_t));
+    if(new_code == NULL) {
+      fatal(ctx, "out of memory growing object image");
+    }
+
+    obj->code = new_code;
+    ctx->code_capacity = new_capacity;
+  }
+
+  obj->code[obj->code_count++] = word;
+}
+
+
+/*
+Params: The context being assembled, the number of words an alloc reserves
+
+Record a zero filled region of the given length at pc2 in the BSS table of
+the image, extending the last region if this one follows it directly.
+*/
+static void emit_bss(AsmContext *ctx, uint32_t length) {
+
+  asx20_obj *obj = ctx->obj;
+
+  if(obj->bss_count > 0) {
+    asx20_bss *last = &obj->bss[obj->bss_count - 1];
+    if(last->address + last->length == (uint32_t) ctx->pc2) {
+      last->length += length;
+      return;
+    }
+  }
+
+  if(obj->bss_count == ctx->bss_capacity) {
+
+    int new_capacity = ctx->bss_capacity ? ctx->bss_capacity * 2 : 16;
+
+    asx20_bss *new_bss = realloc(obj->bss, new_capacity * sizeof(asx20_bss));
+    if(new_bss == NULL) {
+      fatal(ctx, "out of memory growing object image");
+    }
+
+    obj->bss = new_bss;
+    ctx->bss_capacity = new_capacity;
+  }
+
+  obj->bss[obj->bss_count].address = ctx->pc2;
+  obj->bss[obj->bss_count].length = length;
+  obj->bss_count++;
+}
+
+
+/*
+Params: The context whose symbol table is being emptied
+
+Free the symbol_info structs and reference lists stored in the symbol table;
+the table itself only owns its copies of the symbol names
+*/
+static void free_symbols(AsmContext *ctx) {
+
+  void *iterator = symtabCreateIterator(ctx->symtab);
+  if(iterator == NULL) {
+    fatal(ctx, "out of memory freeing symbol table");
+  }
+
+  const char *symbol;
+  void *data;
+
+  while((symbol = symtabNext(iterator, &data)) != NULL) {
+
+    symbol_info_t *symbol_info = data;
+    Node_t *current = symbol_info->reference_address;
+
+    while(current != NULL) {
+      Node_t *next = current->next;
+      free(current);
+      current = next;
+    }
+
+    free(symbol_info);
+  }
+
+  symtabDeleteIterator(iterator);
+}
 
 
 /*
 Params: A pointer to whatever pc counter we are choosing to increment (pc or pc2)
         An INSTR variable containing the current instruction we have received from the parser
 */
-static void update_pc(int *pc_counter, INSTR instr) {
+static void update_pc(AsmContext *ctx, int *pc_counter, INSTR instr) {
 
   // Update our pc counter
   if(instr.format == 9) {
 
     // N words for alloc
-    if(strcmp(instr.opcode, "alloc") == 0) {
+    if(instr.opcode == OPCODE_ALLOC) {
 
       // ERROR CHECK: IF ALLOC CONSTANT IS 0
       if(instr.u.format9.constant <= 0) {
 
-        error(ERROR_CONSTANT_ZERO, instr.u.format9.constant);
-        error_count++;
+        error(ctx, ERROR_CONSTANT_ZERO, instr.u.format9.constant);
+        ctx->error_count++;
 
       } else {
         (*pc_counter) += instr.u.format9.constant; // Else update pc by alloc constant
+
+        // Words reserved as BSS are counted on the first pass so that
+        // betweenPasses sizes the code without them
+        if((ctx->options & ASX20_BSS) && pc_counter == &ctx->pc) {
+          ctx->bss_words += instr.u.format9.constant;
+          ctx->bss_allocs++;
+        }
       }
 
     // 1 word for word
-    } else if(strcmp(instr.opcode, "word") == 0) {
+    } else if(instr.opcode == OPCODE_WORD) {
       (*pc_counter)++;
     }
 
@@ -1188,7 +1595,7 @@ static void update_pc(int *pc_counter, INSTR instr) {
   } else if(instr.format == 2) {
 
     // Dont update pc counter if import or export
-    if(strcmp(instr.opcode, "import") != 0 && strcmp(instr.opcode, "export") != 0) {
+    if(instr.opcode != OPCODE_IMPORT && instr.opcode != OPCODE_EXPORT) {
       (*pc_counter)++;
     }
 
@@ -0,0 +1,417 @@
+//
+// asx20.c - library interface to the asx20 assembler
+//
+//          runs both passes over source held in memory or in a file and
+//          hands back the object image, listing and messages in memory
+//          (see asx20.h)
+//
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/uio.h>
+#include "defs.h"
+
+// forward references
+struct capture;
+static void begin(AsmContext *, struct capture *, asx20_obj *, asx20_diag *);
+static int assembleInput(AsmContext *, asx20_obj *);
+static int finish(AsmContext *, struct capture *, int, asx20_obj *, int,
+  asx20_diag *);
+static char *packTables(const asx20_obj *, size_t *);
+
+// where the listing and messages of the assembly under way are collected
+//   the context only sees the streams writing into it
+struct capture {
+  char *listing;
+  size_t listingLength;
+  char *text;
+  size_t textLength;
+};
+
+//
+//      asx20_create
+//
+asx20 *asx20_create(void)
+{
+  return createAssembler();
+}
+
+//
+//      asx20_destroy
+//
+void asx20_destroy(asx20 *ctx)
+{
+  deleteAssembler(ctx);
+}
+
+//
+//      asx20_set_options
+//
+void asx20_set_options(asx20 *ctx, unsigned int options)
+{
+  ctx->options = options;
+}
+
+//
+//      asx20_set_threads
+//
+void asx20_set_threads(asx20 *ctx, int threads)
+{
+  ctx->threads = threads;
+}
+
+//
+//      asx20_assemble_buffer
+//
+int asx20_assemble_buffer(asx20 *ctx, const char *src, size_t len,
+  asx20_obj *out, asx20_diag *diags)
+{
+  asx20_obj local;
+  asx20_obj *obj = out ? out : &local;
+  struct capture cap;
+
+  begin(ctx, &cap, obj, diags);
+  if (scanOpenBuffer(ctx, src, len))
+  {
+    fprintf(ctx->errfp, "source of %zu bytes is too large\n", len);
+    return finish(ctx, &cap, 1, obj, out != NULL, diags);
+  }
+  return finish(ctx, &cap, assembleInput(ctx, obj), obj, out != NULL, diags);
+}
+
+//
+//      asx20_assemble_file
+//
+int asx20_assemble_file(asx20 *ctx, const char *name, int useStdio,
+  asx20_obj *out, asx20_diag *diags)
+{
+  asx20_obj local;
+  asx20_obj *obj = out ? out : &local;
+  struct capture cap;
+
+  begin(ctx, &cap, obj, diags);
+  if (scanOpen(ctx, name, useStdio))
+  {
+    fprintf(ctx->errfp, "can't open %s\n", name);
+    return finish(ctx, &cap, 1, obj, out != NULL, diags);
+  }
+  return finish(ctx, &cap, assembleInput(ctx, obj), obj, out != NULL, diags);
+}
+
+//
+//      asx20_assemble_fd
+//
+int asx20_assemble_fd(asx20 *ctx, int fd, asx20_obj *out, asx20_diag *diags)
+{
+  asx20_obj local;
+  asx20_obj *obj = out ? out : &local;
+  struct capture cap;
+
+  begin(ctx, &cap, obj, diags);
+  scanOpenFd(ctx, fd);
+  return finish(ctx, &cap, assembleInput(ctx, obj), obj, out != NULL, diags);
+}
+
+//
+//      asx20_assemble
+//
+int asx20_assemble(const char *src, size_t len, asx20_obj *out,
+  asx20_diag *diags)
+{
+  asx20 *ctx = asx20_create();
+  int errorCount;
+
+  errorCount = asx20_assemble_buffer(ctx, src, len, out, diags);
+  asx20_destroy(ctx);
+  return errorCount;
+}
+
+//
+//      asx20_obj_write
+//
+//      the object file is three header words (insymbol words, outsymbol
+//      words, program words), then 5 words per export and per import
+//      reference (a 16 byte name and an address), then the code
+//
+//      an image assembled with ASX20_BSS has five header words instead:
+//      ASX20_BSS_MAGIC, insymbol words, outsymbol words, program words
+//      (all the memory the program occupies) and BSS words. 2 words per
+//      BSS entry (an address and a length) follow the import references,
+//      and the code then holds only the words outside the BSS regions,
+//      in address order. a loader can map the BSS regions without
+//      reading anything for them.
+//
+int asx20_obj_write(const asx20_obj *obj, FILE *fp)
+{
+  char *tables;
+  size_t length;
+
+  tables = packTables(obj, &length);
+  fwrite(tables, 1, length, fp);
+  fwrite(obj->code, sizeof(uint32_t), obj->code_count, fp);
+  free(tables);
+
+  return ferror(fp) ? -1 : 0;
+}
+
+//
+//      asx20_obj_write_fd
+//
+//      the whole file goes out in one writev: the header and symbol
+//      tables from one buffer, and the code straight from the image
+//
+int asx20_obj_write_fd(const asx20_obj *obj, int fd)
+{
+  struct iovec iov[2];
+  struct iovec *next = iov;
+  int count = 2;
+  char *tables;
+  size_t length;
+  ssize_t n;
+
+  tables = packTables(obj, &length);
+  iov[0].iov_base = tables;
+  iov[0].iov_len = length;
+  iov[1].iov_base = obj->code;
+  iov[1].iov_len = obj->code_count * sizeof(uint32_t);
+
+  // a pipe or a signal can cut a write short; carry on from there
+  while (count > 0)
+  {
+    n = writev(fd, next, count);
+    if (n < 0 && errno == EINTR)
+    {
+      continue;
+    }
+    if (n < 0)
+    {
+      free(tables);
+      return -1;
+    }
+    while (count > 0 && (size_t) n >= next->iov_len)
+    {
+      n -= next->iov_len;
+      next++;
+      count--;
+    }
+    if (count > 0)
+    {
+      next->iov_base = (char *) next->iov_base + n;
+      next->iov_len -= n;
+    }
+  }
+
+  free(tables);
+  return 0;
+}
+
+//
+//      asx20_obj_free
+//
+void asx20_obj_free(asx20_obj *obj)
+{
+  free(obj->exports);
+  free(obj->imports);
+  free(obj->code);
+  free(obj->bss);
+  free(obj->listing);
+  memset(obj, 0, sizeof(*obj));
+}
+
+//
+//      asx20_diag_free
+//
+void asx20_diag_free(asx20_diag *diags)
+{
+  free(diags->text);
+  memset(diags, 0, sizeof(*diags));
+}
+
+//
+//      packTables
+//
+//      lay out the header and the export, import and BSS tables of an
+//      object file in one buffer, sized from the counts the first pass
+//      left
+//
+//      returns the buffer, which the caller frees
+//
+static
+char *packTables(const asx20_obj *obj, size_t *length)
+{
+  int header[5];
+  int headerWords;
+  char *tables;
+  char *p;
+  int i;
+
+  if (obj->bss)
+  {
+    header[0] = ASX20_BSS_MAGIC;
+    header[1] = obj->insymbolWords;
+    header[2] = obj->outsymbolWords;
+    header[3] = obj->program_words;
+    header[4] = obj->bss_count * 2;
+    headerWords = 5;
+  }
+  else
+  {
+    header[0] = obj->insymbolWords;
+    header[1] = obj->outsymbolWords;
+    header[2] = obj->code_count;
+    headerWords = 3;
+  }
+
+  *length = headerWords * sizeof(int) + (size_t) (obj->export_count +
+    obj->import_count) * (16 + sizeof(uint32_t)) +
+    (size_t) obj->bss_count * sizeof(asx20_bss);
+  tables = malloc(*length);
+  if (tables == NULL)
+  {
+    fatal(NULL, "out of memory writing object file");
+  }
+
+  memcpy(tables, header, headerWords * sizeof(int));
+  p = tables + headerWords * sizeof(int);
+
+  for (i = 0; i < obj->export_count; i++)
+  {
+    memcpy(p, obj->exports[i].name, 16);
+    memcpy(p + 16, &obj->exports[i].address, sizeof(uint32_t));
+    p += 16 + sizeof(uint32_t);
+  }
+  for (i = 0; i < obj->import_count; i++)
+  {
+    memcpy(p, obj->imports[i].name, 16);
+    memcpy(p + 16, &obj->imports[i].address, sizeof(uint32_t));
+    p += 16 + sizeof(uint32_t);
+  }
+  for (i = 0; i < obj->bss_count; i++)
+  {
+    memcpy(p, &obj->bss[i].address, sizeof(uint32_t));
+    memcpy(p + sizeof(uint32_t), &obj->bss[i].length, sizeof(uint32_t));
+    p += 2 * sizeof(uint32_t);
+  }
+  return tables;
+}
+
+//
+//      begin
+//
+//      make the context ready for an assembly whose listing and messages
+//      are collected in memory
+//
+static
+void begin(AsmContext *ctx, struct capture *cap, asx20_obj *obj,
+  asx20_diag *diags)
+{
+  memset(obj, 0, sizeof(*obj));
+  if (diags)
+  {
+    memset(diags, 0, sizeof(*diags));
+  }
+
+  resetAssembler(ctx);
+
+  memset(cap, 0, sizeof(*cap));
+  ctx->listfp = open_memstream(&cap->listing, &cap->listingLength);
+  ctx->errfp = open_memstream(&cap->text, &cap->textLength);
+  if (ctx->listfp == NULL || ctx->errfp == NULL)
+  {
+    fatal(NULL, "can't create stream for assembler output");
+  }
+}
+
+//
+//      assembleInput
+//
+//      run both passes over the input the context's scanner was opened on
+//
+//      returns the number of errors found
+//
+static
+int assembleInput(AsmContext *ctx, asx20_obj *obj)
+{
+  // invoke parser to drive the first pass
+  //   this is the only time the input is read; the assembler keeps
+  //   what it needs for the second pass
+  //   the hand-written front end needs all of the input in memory, so
+  //   input read with stdio or from a descriptor always goes to bison
+  if ((ctx->options & ASX20_FASTSCAN) && ctx->scanText != NULL)
+  {
+    fastParse(ctx);
+  }
+  else
+  {
+    parseInput(ctx);
+  }
+
+  // close input
+  scanClose(ctx);
+
+  // let the assembler know that the first pass is done
+  //   it will tell us how many errors were detected and therefore
+  //   whether to continue with the second pass
+  int errorCount = betweenPasses(ctx, obj) +
+    ctx->scanErrorCount + ctx->parseErrorCount;
+  if (errorCount)
+  {
+    error(ctx, "assembler terminating after first pass with %d error(s)",
+      errorCount);
+    return errorCount;
+  }
+
+  // drive the second pass from the lines recorded during the first
+  secondPass(ctx);
+
+  return 0;
+}
+
+//
+//      finish
+//
+//      hand the listing and messages to the caller, along with the image
+//      if there were no errors, and set the context's streams back to
+//      their defaults
+//
+//      the listing is kept even with errors: the first pass lists the
+//      symbols when only the scanner or parser found errors
+//
+//      returns the number of errors
+//
+static
+int finish(AsmContext *ctx, struct capture *cap, int errorCount,
+  asx20_obj *obj, int keep, asx20_diag *diags)
+{
+  fclose(ctx->listfp);
+  fclose(ctx->errfp);
+  ctx->listfp = stdout;
+  ctx->errfp = stderr;
+  ctx->obj = NULL;
+
+  if (errorCount)
+  {
+    asx20_obj_free(obj);
+  }
+  obj->listing = cap->listing;
+  obj->listing_length = cap->listingLength;
+  if (!keep)
+  {
+    asx20_obj_free(obj);
+  }
+
+  if (diags)
+  {
+    diags->error_count = errorCount;
+    diags->text = cap->text;
+    diags->length = cap->textLength;
+  }
+  else
+  {
+    free(cap->text);
+  }
+  return errorCount;
+}
@@ -0,0 +1,143 @@
+//
+// asx20.h - library interface to the asx20 assembler
+//
+// The assembler can be linked into another program (libasx20.a or
+// libasx20.so) and run on source held in memory. The object image,
+// symbol listing and messages are returned in memory too; nothing is
+// read from or written to disk unless asked for.
+//
+// An asx20 handle holds everything one assembly needs and may be reused
+// for any number of assemblies. Different handles may be used at the
+// same time from different threads.
+//
+
+#ifndef ASX20_H
+#define ASX20_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// version of the assembler
+//   change it whenever the object, listing or messages produced for a
+//   source change; it keys the object cache of the asx20 driver
+#define ASX20_VERSION "1.1"
+
+#if defined(__GNUC__)
+#define ASX20_API __attribute__((visibility("default")))
+#else
+#define ASX20_API
+#endif
+
+// one entry of the export (insymbol) or import (outsymbol) table
+//   name is the symbol truncated to 16 characters, and NUL terminated
+typedef struct asx20_symbol {
+  char name[17];
+  uint32_t address;
+} asx20_symbol;
+
+// a zero filled region reserved by alloc, in words
+typedef struct asx20_bss {
+  uint32_t address;
+  uint32_t length;
+} asx20_bss;
+
+// an assembled object image
+//   the three header words of the object file are insymbolWords,
+//   outsymbolWords and code_count
+//
+//   when assembled with ASX20_BSS, the regions reserved by alloc are
+//   not in code but listed in bss, so code_count is program_words less
+//   the bss lengths, and the object file has the BSS layout (see
+//   asx20_obj_write)
+typedef struct asx20_obj {
+  int insymbolWords;             // 5 words for each export
+  int outsymbolWords;            // 5 words for each import reference
+  asx20_symbol *exports;
+  int export_count;
+  asx20_symbol *imports;
+  int import_count;
+  uint32_t *code;                // the program, one word per entry
+  int code_count;
+  int program_words;             // words of memory the program occupies
+  asx20_bss *bss;                // NULL unless assembled with ASX20_BSS
+  int bss_count;
+  char *listing;                 // symbol listing, NUL terminated
+  size_t listing_length;
+} asx20_obj;
+
+// messages from an assembly
+typedef struct asx20_diag {
+  int error_count;
+  char *text;                    // one message per line, NUL terminated
+  size_t length;
+} asx20_diag;
+
+typedef struct asm_context asx20;
+
+// options for asx20_set_options
+#define ASX20_BSS      0x1       // record alloc regions as BSS entries
+#define ASX20_FASTSCAN 0x2       // parse input that is all in memory with
+                                 //   the hand-written front end, not
+                                 //   flex and bison
+
+// first word of an object file with BSS entries; it can't begin a
+// vmx20 object file, whose insymbol word count is a multiple of 5
+#define ASX20_BSS_MAGIC  0x53534278
+
+// create a handle for running assemblies
+//   returns NULL if memory can't be allocated
+extern ASX20_API asx20 *asx20_create(void);
+
+// release a handle
+extern ASX20_API void asx20_destroy(asx20 *);
+
+// set the options (ASX20_ flags, or'ed) for the handle's assemblies
+//   a new handle has none
+extern ASX20_API void asx20_set_options(asx20 *, unsigned int options);
+
+// set the number of threads that encode the second pass of a large
+// program, and that parse a large input with ASX20_FASTSCAN; 0, the
+// default, uses one per online CPU when the program is big enough to
+// gain from it, and 1 keeps everything on the calling thread (as when
+// many handles are already running at once)
+extern ASX20_API void asx20_set_threads(asx20 *, int threads);
+
+// assemble len bytes of source
+//   the object image is stored in *out and the messages in *diags;
+//   either may be NULL if it isn't wanted. out holds an image only when
+//   there are no errors.
+//   returns the number of errors (0 on success)
+extern ASX20_API int asx20_assemble_buffer(asx20 *, const char *src,
+  size_t len, asx20_obj *out, asx20_diag *diags);
+
+// as asx20_assemble_buffer, but read the source from the named file
+//   the file is memory mapped when possible; if useStdio is non-zero it
+//   is always read with stdio
+extern ASX20_API int asx20_assemble_file(asx20 *, const char *name,
+  int useStdio, asx20_obj *out, asx20_diag *diags);
+
+// as asx20_assemble_buffer, but read the source from the open descriptor
+//   fd, such as a pipe, until end of file. the first pass runs on the
+//   input as it arrives and only what the second pass needs is kept.
+//   fd is not closed.
+extern ASX20_API int asx20_assemble_fd(asx20 *, int fd, asx20_obj *out,
+  asx20_diag *diags);
+
+// assemble len bytes of source with a handle private to the call
+extern ASX20_API int asx20_assemble(const char *src, size_t len,
+  asx20_obj *out, asx20_diag *diags);
+
+// write an object image in the vmx20 object file format
+//   returns 0 on success, -1 on a write error
+extern ASX20_API int asx20_obj_write(const asx20_obj *, FILE *);
+
+// as asx20_obj_write, but write the whole file to a descriptor with a
+// single writev, which is how the asx20 driver writes its objects
+extern ASX20_API int asx20_obj_write_fd(const asx20_obj *, int fd);
+
+// release what an assembly stored in an asx20_obj or asx20_diag
+extern ASX20_API void asx20_obj_free(asx20_obj *);
+extern ASX20_API void asx20_diag_free(asx20_diag *);
+
+#endif
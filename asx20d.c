@@ -0,0 +1,759 @@
+//
+//
+// asx20d.c - assembler daemon for asx20
+//
+//          Usage: asx20d [-j N] socket
+//
+//                 -j N  assemble with N worker threads (default 4)
+//
+//          listens on the Unix socket named and assembles the sources
+//          sent to it (see asx20d.h), so a client pays for a round trip
+//          rather than starting a process and an assembler per file
+//
+//          each worker owns an assembler handle for as long as the
+//          daemon runs. The main thread polls the open connections and
+//          hands a worker one request at a time, so a client that keeps
+//          its connection open between requests holds no worker while
+//          it is idle
+//
+//          the socket is made accessible to its owner only, since a
+//          path request reads any file the daemon's user can read
+//
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include "asx20.h"
+#include "asx20d.h"
+
+// a connection with a request waiting, or one a worker has finished
+// with
+struct conn {
+  int fd;
+  struct conn *next;
+};
+
+// connections with a request waiting for a worker
+static struct conn *pendingHead;
+static struct conn *pendingTail;
+static pthread_mutex_t pendingLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t pendingReady = PTHREAD_COND_INITIALIZER;
+
+// connections a worker has answered, to be polled again; a byte in the
+// wake pipe tells the main thread to collect them (under pendingLock)
+static struct conn *returned;
+static int wakeFds[2];
+
+// connections polled by the main thread for their next request, each
+// at polls[IDLE_FIRST + i]
+#define IDLE_FIRST 2
+static int *idle;
+static int idleCount;
+static int idleSize;
+static struct pollfd *polls;
+
+// seconds a worker waits for the whole of a request once it has
+// started, and for each write of a reply the client is slow to take;
+// after that it gives up on the connection
+#define REQUEST_TIMEOUT 5
+
+// milliseconds new connections are left waiting when the daemon runs
+// out of descriptors or memory for them, so those it has are still
+// served rather than it failing on every poll
+#define ACCEPT_PAUSE 100
+
+// forward references
+static void usage(void);
+static void addIdle(int);
+static void queueConnection(int);
+static void *worker(void *);
+static int serveNext(asx20 *, int);
+static int serveRequest(asx20 *, int, struct asx20d_request *, char *);
+static int sendReply(int, struct asx20d_reply *, int, struct iovec *);
+static int sendRefusal(int, char *);
+static long long msNow(void);
+static int readFull(int, void *, size_t, long long);
+static int writeFull(int, struct iovec *, int);
+
+//
+//      main
+//
+//
+int main(int argc, char *argv[])
+{
+  struct sockaddr_un addr;
+  struct timeval timeout = { REQUEST_TIMEOUT, 0 };
+  long long resumeAccept = 0;
+  int waitMs;
+  struct conn *c;
+  struct conn *next;
+  pthread_t thread;
+  char drain[64];
+  int workers = 4;
+  int listenFd;
+  int fd;
+  int opt;
+  int i;
+
+  while ((opt = getopt(argc, argv, "j:")) != -1)
+  {
+    if (opt == 'j')
+    {
+      workers = atoi(optarg);
+      if (workers < 1)
+      {
+        usage();
+      }
+    }
+    else
+    {
+      usage();
+    }
+  }
+  if (argc - optind != 1)
+  {
+    usage();
+  }
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  if (strlen(argv[optind]) >= sizeof(addr.sun_path))
+  {
+    fprintf(stderr, "socket name %s is too long\n", argv[optind]);
+    exit(1);
+  }
+  strcpy(addr.sun_path, argv[optind]);
+
+  // a client that goes away mid-reply must not take the daemon with it
+  signal(SIGPIPE, SIG_IGN);
+
+  listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (listenFd < 0)
+  {
+    fprintf(stderr, "can't create socket: %s\n", strerror(errno));
+    exit(1);
+  }
+  unlink(addr.sun_path);
+  if (bind(listenFd, (struct sockaddr *) &addr, sizeof(addr)))
+  {
+    fprintf(stderr, "can't bind %s: %s\n", addr.sun_path, strerror(errno));
+    exit(1);
+  }
+  // nobody can connect before the listen, so other users never get
+  // in while the socket still has the umask's permissions
+  if (chmod(addr.sun_path, 0600))
+  {
+    fprintf(stderr, "can't protect %s: %s\n", addr.sun_path,
+      strerror(errno));
+    exit(1);
+  }
+  if (listen(listenFd, 64))
+  {
+    fprintf(stderr, "can't listen on %s: %s\n", addr.sun_path,
+      strerror(errno));
+    exit(1);
+  }
+
+  // a full wake pipe already has the main thread coming
+  if (pipe2(wakeFds, O_CLOEXEC | O_NONBLOCK))
+  {
+    fprintf(stderr, "can't create wake pipe: %s\n", strerror(errno));
+    exit(1);
+  }
+
+  // the workers and their handles are set up once, before the first
+  // connection is taken
+  for (i = 0; i < workers; i++)
+  {
+    if (pthread_create(&thread, NULL, worker, NULL))
+    {
+      fprintf(stderr, "can't create worker thread\n");
+      exit(1);
+    }
+    pthread_detach(thread);
+  }
+
+  idleSize = 64;
+  idle = malloc(idleSize * sizeof(int));
+  polls = malloc((IDLE_FIRST + idleSize) * sizeof(struct pollfd));
+  if (idle == NULL || polls == NULL)
+  {
+    fprintf(stderr, "malloc failed for connections\n");
+    exit(1);
+  }
+
+  for (;;)
+  {
+    polls[0].fd = wakeFds[0];
+    polls[0].events = POLLIN;
+    // poll ignores a negative descriptor
+    waitMs = -1;
+    polls[1].fd = listenFd;
+    if (resumeAccept)
+    {
+      waitMs = resumeAccept - msNow();
+      if (waitMs > 0)
+      {
+        polls[1].fd = -1;
+      }
+      else
+      {
+        waitMs = -1;
+        resumeAccept = 0;
+      }
+    }
+    polls[1].events = POLLIN;
+    for (i = 0; i < idleCount; i++)
+    {
+      polls[IDLE_FIRST + i].fd = idle[i];
+      polls[IDLE_FIRST + i].events = POLLIN;
+    }
+    if (poll(polls, IDLE_FIRST + idleCount, waitMs) < 0)
+    {
+      if (errno == EINTR)
+      {
+        continue;
+      }
+      fprintf(stderr, "poll failed: %s\n", strerror(errno));
+      exit(1);
+    }
+
+    // a request or a hang-up goes to a worker, which answers the one
+    // or closes the connection; going backwards, the last connection
+    // moved into a hole has been looked at already
+    for (i = idleCount - 1; i >= 0; i--)
+    {
+      if (polls[IDLE_FIRST + i].revents)
+      {
+        queueConnection(idle[i]);
+        idle[i] = idle[--idleCount];
+      }
+    }
+
+    if (polls[1].revents & POLLIN)
+    {
+      fd = accept4(listenFd, NULL, NULL, SOCK_CLOEXEC);
+      if (fd >= 0)
+      {
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+        addIdle(fd);
+      }
+      else if (errno == EMFILE || errno == ENFILE || errno == ENOBUFS ||
+        errno == ENOMEM)
+      {
+        resumeAccept = msNow() + ACCEPT_PAUSE;
+      }
+      else if (errno != EINTR && errno != ECONNABORTED &&
+        errno != EAGAIN)
+      {
+        fprintf(stderr, "accept failed: %s\n", strerror(errno));
+        exit(1);
+      }
+    }
+
+    if (polls[0].revents & POLLIN)
+    {
+      while (read(wakeFds[0], drain, sizeof(drain)) > 0)
+      {
+        ;
+      }
+      pthread_mutex_lock(&pendingLock);
+      c = returned;
+      returned = NULL;
+      pthread_mutex_unlock(&pendingLock);
+      while (c)
+      {
+        next = c->next;
+        addIdle(c->fd);
+        free(c);
+        c = next;
+      }
+    }
+  }
+}
+
+//
+//      usage
+//
+static
+void usage(void)
+{
+  fprintf(stderr,"usage: asx20d [-j N] socket\n");
+  exit(1);
+}
+
+//
+//      addIdle
+//
+//      add a connection to those polled for a request, growing the
+//      poll set as needed
+//
+static
+void addIdle(int fd)
+{
+  if (idleCount == idleSize)
+  {
+    idleSize *= 2;
+    idle = realloc(idle, idleSize * sizeof(int));
+    polls = realloc(polls, (IDLE_FIRST + idleSize) * sizeof(struct pollfd));
+    if (idle == NULL || polls == NULL)
+    {
+      fprintf(stderr, "malloc failed for connections\n");
+      exit(1);
+    }
+  }
+  idle[idleCount++] = fd;
+}
+
+//
+//      queueConnection
+//
+//      pass a connection with a request waiting to the workers
+//
+static
+void queueConnection(int fd)
+{
+  struct conn *c = malloc(sizeof(struct conn));
+
+  if (c == NULL)
+  {
+    fprintf(stderr, "malloc failed for connection\n");
+    exit(1);
+  }
+  c->fd = fd;
+  c->next = NULL;
+
+  pthread_mutex_lock(&pendingLock);
+  if (pendingTail)
+  {
+    pendingTail->next = c;
+  }
+  else
+  {
+    pendingHead = c;
+  }
+  pendingTail = c;
+  pthread_cond_signal(&pendingReady);
+  pthread_mutex_unlock(&pendingLock);
+}
+
+//
+//      worker
+//
+//      thread body: answer one request from each connection taken,
+//      then hand the connection back to be polled for the next, with a
+//      handle kept for the life of the daemon
+//
+static
+void *worker(void *arg)
+{
+  asx20 *as = asx20_create();
+  struct conn *c;
+
+  if (as == NULL)
+  {
+    fprintf(stderr, "can't create assembler for worker\n");
+    exit(1);
+  }
+
+  for (;;)
+  {
+    pthread_mutex_lock(&pendingLock);
+    while (pendingHead == NULL)
+    {
+      pthread_cond_wait(&pendingReady, &pendingLock);
+    }
+    c = pendingHead;
+    pendingHead = c->next;
+    if (pendingHead == NULL)
+    {
+      pendingTail = NULL;
+    }
+    pthread_mutex_unlock(&pendingLock);
+
+    if (serveNext(as, c->fd))
+    {
+      close(c->fd);
+      free(c);
+      continue;
+    }
+
+    pthread_mutex_lock(&pendingLock);
+    c->next = returned;
+    returned = c;
+    pthread_mutex_unlock(&pendingLock);
+    while (write(wakeFds[1], "", 1) < 0 && errno == EINTR)
+    {
+      ;
+    }
+  }
+  return NULL;
+}
+
+//
+//      serveNext
+//
+//      answer the next request on a connection
+//
+//      returns 0 if the connection can take another request, -1 if
+//      the client closed it or something went wrong with it
+//
+static
+int serveNext(asx20 *as, int fd)
+{
+  struct asx20d_request req;
+  long long deadline = msNow() + REQUEST_TIMEOUT * 1000;
+  char *payload;
+  int status;
+
+  if (readFull(fd, &req, sizeof(req), deadline))
+  {
+    return -1;
+  }
+
+  // a request that can't be read can't be skipped either, so the
+  // connection ends with the refusal
+  if (req.kind != ASX20D_SOURCE && req.kind != ASX20D_PATH)
+  {
+    sendRefusal(fd, "unknown request\n");
+    return -1;
+  }
+  if (req.length > ASX20D_PAYLOAD_MAX)
+  {
+    sendRefusal(fd, "request is too large\n");
+    return -1;
+  }
+
+  // one more byte for the NUL ending a file name
+  payload = malloc(req.length + 1);
+  if (payload == NULL)
+  {
+    sendRefusal(fd, "out of memory for request\n");
+    return -1;
+  }
+  if (readFull(fd, payload, req.length, deadline))
+  {
+    free(payload);
+    return -1;
+  }
+  payload[req.length] = '\0';
+
+  status = serveRequest(as, fd, &req, payload);
+  free(payload);
+  return status;
+}
+
+//
+//      serveRequest
+//
+//      assemble the source of one request and send back the reply
+//
+//      the object is written straight into a memfd, which becomes the
+//      reply's memfd when the reply is large and is sent from otherwise
+//
+//      returns 0 on success, -1 if the reply could not be sent
+//
+static
+int serveRequest(asx20 *as, int fd, struct asx20d_request *req,
+  char *payload)
+{
+  struct asx20d_reply reply;
+  struct iovec sections[2];
+  asx20_obj obj;
+  asx20_diag diags;
+  off_t objectLength = 0;
+  int objectFd = -1;
+  int status;
+
+  if (req->kind == ASX20D_SOURCE)
+  {
+    reply.error_count = asx20_assemble_buffer(as, payload, req->length,
+      &obj, &diags);
+  }
+  else
+  {
+    reply.error_count = asx20_assemble_file(as, payload, 0, &obj, &diags);
+  }
+
+  if (reply.error_count == 0)
+  {
+    objectFd = memfd_create("asx20d-reply", MFD_CLOEXEC);
+    if (objectFd < 0 || asx20_obj_write_fd(&obj, objectFd) ||
+        (objectLength = lseek(objectFd, 0, SEEK_CUR)) < 0)
+    {
+      fprintf(stderr, "can't write object for reply: %s\n",
+        strerror(errno));
+      if (objectFd >= 0)
+      {
+        close(objectFd);
+      }
+      asx20_obj_free(&obj);
+      asx20_diag_free(&diags);
+      return -1;
+    }
+  }
+
+  reply.flags = 0;
+  reply.object_length = objectLength;
+  reply.listing_length = obj.listing_length;
+  reply.diag_length = diags.length;
+  sections[0].iov_base = obj.listing;
+  sections[0].iov_len = obj.listing_length;
+  sections[1].iov_base = diags.text;
+  sections[1].iov_len = diags.length;
+
+  status = sendReply(fd, &reply, objectFd, sections);
+
+  if (objectFd >= 0)
+  {
+    close(objectFd);
+  }
+  asx20_obj_free(&obj);
+  asx20_diag_free(&diags);
+  return status;
+}
+
+//
+//      sendReply
+//
+//      send a reply header and its sections, in the stream when they
+//      are small and in a memfd passed along with the header when they
+//      are not
+//
+//      the object section is the object_length bytes at the start of
+//      objectFd, a memfd positioned at their end, or there is none and
+//      objectFd is -1; the listing and messages are in sections
+//
+//      returns 0 on success, -1 on failure
+//
+static
+int sendReply(int fd, struct asx20d_reply *reply, int objectFd,
+  struct iovec *sections)
+{
+  union {
+    struct cmsghdr align;
+    char buf[CMSG_SPACE(sizeof(int))];
+  } control;
+  struct iovec iov[1];
+  struct msghdr msg;
+  struct cmsghdr *cmsg;
+  size_t total;
+  off_t offset;
+  ssize_t n;
+  int memfd;
+  int status;
+
+  total = reply->object_length + sections[0].iov_len + sections[1].iov_len;
+  if (total <= ASX20D_INLINE_MAX)
+  {
+    iov[0].iov_base = reply;
+    iov[0].iov_len = sizeof(*reply);
+    if (writeFull(fd, iov, 1))
+    {
+      return -1;
+    }
+    // the object goes from the memfd to the socket without a copy
+    // passing through the daemon
+    offset = 0;
+    while (offset < (off_t) reply->object_length)
+    {
+      n = sendfile(fd, objectFd, &offset, reply->object_length - offset);
+      if (n < 0 && errno == EINTR)
+      {
+        continue;
+      }
+      if (n <= 0)
+      {
+        return -1;
+      }
+    }
+    return writeFull(fd, sections, 2);
+  }
+
+  // the listing and messages follow the object in its memfd
+  memfd = objectFd;
+  if (memfd < 0)
+  {
+    memfd = memfd_create("asx20d-reply", MFD_CLOEXEC);
+  }
+  if (memfd < 0 || writeFull(memfd, sections, 2))
+  {
+    fprintf(stderr, "can't fill memfd for reply: %s\n", strerror(errno));
+    if (memfd >= 0 && memfd != objectFd)
+    {
+      close(memfd);
+    }
+    return -1;
+  }
+
+  reply->flags |= ASX20D_MEMFD;
+  iov[0].iov_base = reply;
+  iov[0].iov_len = sizeof(*reply);
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control.buf;
+  msg.msg_controllen = sizeof(control.buf);
+  cmsg = CMSG_FIRSTHDR(&msg);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+  memcpy(CMSG_DATA(cmsg), &memfd, sizeof(int));
+
+  // the header is small enough to go in one piece with its descriptor
+  while ((status = sendmsg(fd, &msg, MSG_NOSIGNAL)) < 0 && errno == EINTR)
+  {
+    ;
+  }
+  if (memfd != objectFd)
+  {
+    close(memfd);
+  }
+  return status == sizeof(*reply) ? 0 : -1;
+}
+
+//
+//      sendRefusal
+//
+//      answer a request that won't be assembled with a single message
+//
+static
+int sendRefusal(int fd, char *text)
+{
+  struct asx20d_reply reply;
+  struct iovec sections[2];
+
+  memset(&reply, 0, sizeof(reply));
+  memset(sections, 0, sizeof(sections));
+  reply.error_count = 1;
+  reply.diag_length = strlen(text);
+  sections[1].iov_base = text;
+  sections[1].iov_len = reply.diag_length;
+  return sendReply(fd, &reply, -1, sections);
+}
+
+//
+//      msNow
+//
+//      milliseconds on the monotonic clock, for timing out connections
+//
+static
+long long msNow(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000LL + ts.tv_nsec / 1000000;
+}
+
+//
+//      readFull
+//
+//      read exactly len bytes, by deadline (an msNow time)
+//
+//      returns 0 on success, -1 at end of file, on an error or when the
+//      deadline passes
+//
+static
+int readFull(int fd, void *buf, size_t len, long long deadline)
+{
+  struct pollfd pfd;
+  char *p = buf;
+  long long left;
+  ssize_t n;
+
+  pfd.fd = fd;
+  pfd.events = POLLIN;
+  while (len > 0)
+  {
+    // a client sending a byte now and then can't keep the worker
+    left = deadline - msNow();
+    if (left <= 0)
+    {
+      return -1;
+    }
+    n = poll(&pfd, 1, (int) left);
+    if (n < 0 && errno == EINTR)
+    {
+      continue;
+    }
+    if (n <= 0)
+    {
+      return -1;
+    }
+
+    n = read(fd, p, len);
+    if (n < 0 && errno == EINTR)
+    {
+      continue;
+    }
+    if (n <= 0)
+    {
+      return -1;
+    }
+    p += n;
+    len -= n;
+  }
+  return 0;
+}
+
+//
+//      writeFull
+//
+//      write all of the count buffers described by iov, which is
+//      used up in the process
+//
+//      returns 0 on success, -1 on an error
+//
+static
+int writeFull(int fd, struct iovec *iov, int count)
+{
+  ssize_t n;
+
+  while (count > 0)
+  {
+    if (iov->iov_len == 0)
+    {
+      iov++;
+      count--;
+      continue;
+    }
+    n = writev(fd, iov, count);
+    if (n < 0 && errno == EINTR)
+    {
+      continue;
+    }
+    if (n < 0)
+    {
+      return -1;
+    }
+    while (count > 0 && (size_t) n >= iov->iov_len)
+    {
+      n -= iov->iov_len;
+      iov++;
+      count--;
+    }
+    if (count > 0)
+    {
+      iov->iov_base = (char *) iov->iov_base + n;
+      iov->iov_len -= n;
+    }
+  }
+  return 0;
+}
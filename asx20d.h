@@ -0,0 +1,54 @@
+//
+// asx20d.h - protocol spoken over the socket of the asx20d daemon
+//
+// A client connects to the daemon's Unix stream socket and sends any
+// number of requests, each answered by one reply before the next is
+// read. A request is an asx20d_request followed by "length" bytes of
+// payload: the source itself, or the name of a source file to be read
+// by the daemon (relative names are taken from the daemon's directory).
+// A path request opens the file with the daemon's privileges, so the
+// daemon's socket is made accessible only to the user running it; a
+// daemon run by one user must not be shared with others.
+//
+// A reply is an asx20d_reply followed by its sections: the object file,
+// the listing and the messages, in that order. Small replies carry the
+// sections in the stream after the header. Larger ones put them in a
+// memfd that is passed with the header (SCM_RIGHTS), so the client can
+// map them rather than read a copy.
+//
+// Numbers are in the byte order of the host; client and daemon are on
+// the same machine.
+//
+
+#ifndef ASX20D_H
+#define ASX20D_H
+
+#include <stdint.h>
+
+// request kinds
+#define ASX20D_SOURCE   1        // payload is source text
+#define ASX20D_PATH     2        // payload is a file name (no NUL)
+
+// reply flags
+#define ASX20D_MEMFD    1        // sections are in the passed memfd
+
+// replies with more section bytes than this use a memfd
+#define ASX20D_INLINE_MAX   (64 * 1024)
+
+// largest payload the daemon accepts
+#define ASX20D_PAYLOAD_MAX  (1u << 30)
+
+struct asx20d_request {
+  uint32_t kind;
+  uint32_t length;               // bytes of payload that follow
+};
+
+struct asx20d_reply {
+  int32_t error_count;           // 0 when the object is present
+  uint32_t flags;
+  uint32_t object_length;        // bytes of the vmx20 object file
+  uint32_t listing_length;       // bytes of symbol listing
+  uint32_t diag_length;          // bytes of messages
+};
+
+#endif
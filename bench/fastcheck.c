@@ -0,0 +1,348 @@
+//
+// fastcheck.c - check the hand-written front end against flex/bison
+//
+//   usage: bench/fastcheck [-n inputs] [-s seed] [file.asm ...]
+//
+//   assembles "inputs" generated sources (default 600) with the flex/
+//   bison front end and with ASX20_FASTSCAN, the latter on 1 to
+//   MOST_THREADS threads, so that the input is split into chunks in
+//   places no real program would have them. half the sources are mostly
+//   well formed lines and half mostly loose tokens, so that errors, and
+//   bison's recovery from them, fall across the starts of chunks. the
+//   error count, messages, listing and object file must be the same from
+//   both.
+//
+//   each file named is assembled with and without ASX20_FASTSCAN and
+//   ASX20_BSS on 1 thread and on 2 to 12, and must come out the same
+//   however many threads it is given.
+//
+//   prints the first few differences, and exits with 1 if there are any
+//
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "../asx20.h"
+
+// most threads a generated source is parsed on
+#define MOST_THREADS 9
+
+// differences shown in full
+#define MOST_REPORTS 3
+
+// room for the largest source generate makes
+#define SOURCE_MAX 8192
+
+// what one assembly produced
+struct result {
+  int errorCount;
+  asx20_obj obj;
+  asx20_diag diags;
+  char *object;                  // the object file, NULL with errors
+  size_t objectLength;
+};
+
+static int differences;
+
+static size_t generate(char *, unsigned int *, int);
+static void checkFile(char *);
+static void assemble(asx20 *, const char *, size_t, struct result *);
+static int sameResult(struct result *, struct result *);
+static void report(char *, const char *, size_t, struct result *,
+  struct result *);
+static void freeResult(struct result *);
+static char *readFile(char *, size_t *);
+static void die(char *);
+
+int main(int argc, char *argv[])
+{
+  struct result expected;
+  struct result fast;
+  char src[SOURCE_MAX];
+  char what[64];
+  asx20 *bison;
+  asx20 *chunked;
+  unsigned int seed = 1;
+  unsigned int options;
+  int inputs = 600;
+  size_t length;
+  int opt;
+  int i;
+
+  while ((opt = getopt(argc, argv, "n:s:")) != -1)
+  {
+    if (opt == 'n')
+    {
+      inputs = atoi(optarg);
+    }
+    else if (opt == 's')
+    {
+      seed = strtoul(optarg, NULL, 0);
+    }
+    else
+    {
+      fprintf(stderr, "usage: fastcheck [-n inputs] [-s seed] "
+        "[file.asm ...]\n");
+      exit(1);
+    }
+  }
+
+  bison = asx20_create();
+  chunked = asx20_create();
+  if (bison == NULL || chunked == NULL)
+  {
+    die("asx20_create");
+  }
+  asx20_set_threads(bison, 1);
+
+  for (i = 0; i < inputs; i++)
+  {
+    length = generate(src, &seed, i % 2);
+    options = i % 4 >= 2 ? ASX20_BSS : 0;
+    asx20_set_options(bison, options);
+    asx20_set_options(chunked, options | ASX20_FASTSCAN);
+    asx20_set_threads(chunked, 1 + i % MOST_THREADS);
+
+    assemble(bison, src, length, &expected);
+    assemble(chunked, src, length, &fast);
+    if (!sameResult(&expected, &fast))
+    {
+      snprintf(what, sizeof(what), "input %d on %d threads", i,
+        1 + i % MOST_THREADS);
+      report(what, src, length, &expected, &fast);
+    }
+    freeResult(&expected);
+    freeResult(&fast);
+  }
+  asx20_destroy(bison);
+  asx20_destroy(chunked);
+
+  for (i = optind; i < argc; i++)
+  {
+    checkFile(argv[i]);
+  }
+
+  printf("%d generated inputs, %d files: %d differences\n", inputs,
+    argc - optind, differences);
+  return differences != 0;
+}
+
+//
+//      generate
+//
+//      make a source of up to 40 lines in src, from well formed lines
+//      for the most part if wellFormed is set, and otherwise from loose
+//      tokens: mnemonics, names, registers, numbers good and bad,
+//      punctuation, stray characters and NULs
+//
+//      returns the length of the source
+//
+static size_t generate(char *src, unsigned int *seed, int wellFormed)
+{
+  static char *lines[] = {
+    "L1: halt\n", "  load r1, L2\n", "L2: word 5\n", "  ldind r1, -4(r2)\n",
+    "  blt r1, r2, L1\n", "  export L1\n", "  import foo\n", "  jmp foo\n",
+    "  alloc 3\n", "  addi r1, r2\n", "  push r3\n", "L3:\n", "\n",
+    "# a comment\n", "  ldimm r1, 0x10\n", "halt: ret\n",
+  };
+  static char *tokens[] = {
+    "halt", "load", "store", "ldimm", "ldaddr", "ldind", "stind", "addf",
+    "call", "ret", "blt", "jmp", "cmpxchg", "getpid", "push", "pop",
+    "word", "alloc", "import", "export", "HALT",
+    "foo", "L1", "L2", "x", "a1b2",
+    "r0", "r1", "r15", "r16", "r01", "r1a", "sp", "fp", "pc", "spx",
+    "0", "5", "-3", "12", "007", "0x1F", "0x-5", "0x", "0xg", "0x-",
+    "99999999999", "4294967296", "2147483648", "-2147483648", "-", "--1",
+    ":", ",", "(", ")", "+", "@", ".", " ", "  ", "\t", "#c", " # comment",
+    "\n", "\n", "\n", "\n", "\r", "\x01", "\xff", "",
+  };
+  int lineCount = 1 + rand_r(seed) % 40;
+  size_t length = 0;
+  size_t n;
+  char *s;
+  int count;
+  int i;
+  int j;
+
+  for (i = 0; i < lineCount; i++)
+  {
+    if (wellFormed && rand_r(seed) % 3)
+    {
+      s = lines[rand_r(seed) % (sizeof(lines) / sizeof(lines[0]))];
+      n = strlen(s);
+      memcpy(src + length, s, n);
+      length += n;
+      continue;
+    }
+
+    count = rand_r(seed) % 7;
+    for (j = 0; j < count; j++)
+    {
+      s = tokens[rand_r(seed) % (sizeof(tokens) / sizeof(tokens[0]))];
+      // the empty token stands for a NUL in the source
+      n = *s ? strlen(s) : 1;
+      memcpy(src + length, s, n);
+      length += n;
+      if (rand_r(seed) % 2)
+      {
+        src[length++] = ' ';
+      }
+    }
+    // and now and then the last line has no newline
+    if (rand_r(seed) % 10)
+    {
+      src[length++] = '\n';
+    }
+  }
+  return length;
+}
+
+//
+//      checkFile
+//
+//      assemble the named file every way on 1 thread and on more, and
+//      compare what comes out
+//
+static void checkFile(char *name)
+{
+  static int threads[] = { 2, 3, 4, 8, 12 };
+  struct result single;
+  struct result multi;
+  char what[4200];
+  unsigned int options;
+  size_t length;
+  char *src;
+  asx20 *as;
+  int i;
+
+  src = readFile(name, &length);
+  for (options = 0; options < 4; options++)
+  {
+    as = asx20_create();
+    if (as == NULL)
+    {
+      die("asx20_create");
+    }
+    asx20_set_options(as, (options & 1 ? ASX20_FASTSCAN : 0) |
+      (options & 2 ? ASX20_BSS : 0));
+    asx20_set_threads(as, 1);
+    assemble(as, src, length, &single);
+    for (i = 0; i < sizeof(threads) / sizeof(threads[0]); i++)
+    {
+      asx20_set_threads(as, threads[i]);
+      assemble(as, src, length, &multi);
+      if (!sameResult(&single, &multi))
+      {
+        snprintf(what, sizeof(what), "%s%s%s on %d threads", name,
+          options & 1 ? " -f" : "", options & 2 ? " -b" : "", threads[i]);
+        report(what, NULL, 0, &single, &multi);
+      }
+      freeResult(&multi);
+    }
+    freeResult(&single);
+    asx20_destroy(as);
+  }
+  free(src);
+}
+
+//
+//      assemble
+//
+//      assemble a source, keeping everything that came out of it
+//
+static void assemble(asx20 *as, const char *src, size_t length,
+  struct result *r)
+{
+  FILE *fp;
+
+  r->errorCount = asx20_assemble_buffer(as, src, length, &r->obj,
+    &r->diags);
+  r->object = NULL;
+  r->objectLength = 0;
+  if (r->errorCount == 0)
+  {
+    fp = open_memstream(&r->object, &r->objectLength);
+    if (fp == NULL || asx20_obj_write(&r->obj, fp) | fclose(fp))
+    {
+      die("asx20_obj_write");
+    }
+  }
+}
+
+// the same errors, messages, listing and object file
+static int sameResult(struct result *a, struct result *b)
+{
+  return a->errorCount == b->errorCount &&
+    a->diags.length == b->diags.length &&
+    memcmp(a->diags.text, b->diags.text, a->diags.length) == 0 &&
+    a->obj.listing_length == b->obj.listing_length &&
+    memcmp(a->obj.listing, b->obj.listing, a->obj.listing_length) == 0 &&
+    a->objectLength == b->objectLength &&
+    memcmp(a->object, b->object, a->objectLength) == 0;
+}
+
+//
+//      report
+//
+//      count a difference, and show the first few: the source if there
+//      is one to show, and the messages from each side
+//
+static void report(char *what, const char *src, size_t length,
+  struct result *expected, struct result *got)
+{
+  if (differences++ >= MOST_REPORTS)
+  {
+    return;
+  }
+  printf("difference in %s\n", what);
+  if (src)
+  {
+    printf("--- source\n");
+    fwrite(src, 1, length, stdout);
+    printf("\n");
+  }
+  printf("--- expected %d errors, object of %zu bytes\n",
+    expected->errorCount, expected->objectLength);
+  fwrite(expected->diags.text, 1, expected->diags.length, stdout);
+  printf("--- got %d errors, object of %zu bytes\n", got->errorCount,
+    got->objectLength);
+  fwrite(got->diags.text, 1, got->diags.length, stdout);
+}
+
+static void freeResult(struct result *r)
+{
+  asx20_obj_free(&r->obj);
+  asx20_diag_free(&r->diags);
+  free(r->object);
+}
+
+static char *readFile(char *name, size_t *length)
+{
+  FILE *fp;
+  char *data;
+  long size;
+
+  if ((fp = fopen(name, "rb")) == NULL || fseek(fp, 0, SEEK_END) ||
+      (size = ftell(fp)) < 0 || fseek(fp, 0, SEEK_SET))
+  {
+    die(name);
+  }
+  if ((data = malloc(size + 1)) == NULL)
+  {
+    die("malloc");
+  }
+  if (fread(data, 1, size, fp) != (size_t) size)
+  {
+    die(name);
+  }
+  fclose(fp);
+  *length = size;
+  return data;
+}
+
+static void die(char *what)
+{
+  perror(what);
+  exit(1);
+}
@@ -0,0 +1,255 @@
+//
+// frontend.c - compare the flex/bison front end with the hand-written one
+//
+//   usage: bench/frontend [file.asm] [runs]
+//
+//   runs each front end over the file (by default a generated program
+//   of a million lines, with labels, comments and every operand format)
+//   "runs" times (default 5) and prints the best time of each in lines
+//   per second. only the front ends are timed: the program is linked
+//   with --wrap=assemble, so the lines they produce come here rather
+//   than to the assembler, and are checked to be the same from both.
+//
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include "../defs.h"
+
+#define LINES 1000000
+
+// what the lines handed to assemble add up to
+static uint64_t digest;
+static long lineCount;
+
+static double now(void);
+static char *makeSource(char *);
+static double run(char *, int);
+static uint64_t hashString(uint64_t, const char *);
+static void die(char *);
+
+int main(int argc, char *argv[])
+{
+  static char *names[] = { "flex/bison", "fastscan" };
+  uint64_t digests[2];
+  long counts[2];
+  char path[4096];
+  char *name;
+  double best[2];
+  int runs;
+  int i;
+  int r;
+
+  if (argc > 3)
+  {
+    fprintf(stderr, "usage: frontend [file.asm] [runs]\n");
+    exit(1);
+  }
+  runs = argc == 3 ? atoi(argv[2]) : 5;
+  name = argc >= 2 ? argv[1] : makeSource(path);
+
+  for (i = 0; i < 2; i++)
+  {
+    best[i] = 1e9;
+    for (r = 0; r < runs; r++)
+    {
+      double t = run(name, i);
+      if (t < best[i])
+      {
+        best[i] = t;
+      }
+    }
+    digests[i] = digest;
+    counts[i] = lineCount;
+  }
+
+  for (i = 0; i < 2; i++)
+  {
+    printf("%-12s %8.1f ms  %6.2f M lines/s\n", names[i], best[i] * 1e3,
+      counts[i] / best[i] / 1e6);
+  }
+  printf("speedup      %8.2fx\n", best[0] / best[1]);
+  if (counts[0] != counts[1] || digests[0] != digests[1])
+  {
+    printf("the front ends handed assemble different lines\n");
+    return 1;
+  }
+  printf("%ld lines, the same from both\n", counts[0]);
+
+  if (argc < 2)
+  {
+    unlink(path);
+  }
+  return 0;
+}
+
+//
+//      run
+//
+//      time one front end over the named file
+//
+static double run(char *name, int fast)
+{
+  AsmContext *ctx;
+  double t;
+
+  ctx = createAssembler();
+  ctx->options = fast ? ASX20_FASTSCAN : 0;
+  ctx->errfp = stdout;
+  if (scanOpen(ctx, name, 0))
+  {
+    die(name);
+  }
+  if (fast && ctx->scanText == NULL)
+  {
+    fprintf(stderr, "%s can't be mapped for fastscan\n", name);
+    exit(1);
+  }
+
+  digest = 0;
+  lineCount = 0;
+  t = now();
+  if (fast)
+  {
+    fastParse(ctx);
+  }
+  else
+  {
+    parseInput(ctx);
+  }
+  t = now() - t;
+
+  deleteAssembler(ctx);
+  return t;
+}
+
+//
+//      __wrap_assemble
+//
+//      takes the place of assemble, and folds each line into the digest
+//
+void __wrap_assemble(AsmContext *ctx, char *label, INSTR instr)
+{
+  uint64_t h = digest;
+
+  h = hashString(h, label);
+  h = (h ^ (uint32_t) ctx->lineno) * 0x100000001b3ULL;
+  h = (h ^ instr.format) * 0x100000001b3ULL;
+  h = (h ^ (uint32_t) instr.opcode) * 0x100000001b3ULL;
+  h = hashString(h, instr.mnemonic);
+  switch (instr.format)
+  {
+    case 2:
+      h = hashString(h, instr.u.format2.addr);
+      break;
+    case 3:
+      h = (h ^ instr.u.format3.reg) * 0x100000001b3ULL;
+      break;
+    case 4:
+      h = (h ^ instr.u.format4.reg) * 0x100000001b3ULL;
+      h = (h ^ (uint32_t) instr.u.format4.constant) * 0x100000001b3ULL;
+      break;
+    case 5:
+      h = (h ^ instr.u.format5.reg) * 0x100000001b3ULL;
+      h = hashString(h, instr.u.format5.addr);
+      break;
+    case 6:
+      h = (h ^ instr.u.format6.reg1) * 0x100000001b3ULL;
+      h = (h ^ instr.u.format6.reg2) * 0x100000001b3ULL;
+      break;
+    case 7:
+      h = (h ^ instr.u.format7.reg1) * 0x100000001b3ULL;
+      h = (h ^ instr.u.format7.reg2) * 0x100000001b3ULL;
+      h = (h ^ (uint32_t) instr.u.format7.offset) * 0x100000001b3ULL;
+      break;
+    case 8:
+      h = (h ^ instr.u.format8.reg1) * 0x100000001b3ULL;
+      h = (h ^ instr.u.format8.reg2) * 0x100000001b3ULL;
+      h = hashString(h, instr.u.format8.addr);
+      break;
+    case 9:
+      h = (h ^ (uint32_t) instr.u.format9.constant) * 0x100000001b3ULL;
+      break;
+  }
+  digest = h;
+  lineCount++;
+}
+
+// FNV-1a over a string, or a marker for NULL
+static uint64_t hashString(uint64_t h, const char *s)
+{
+  if (s == NULL)
+  {
+    return (h ^ 0xff) * 0x100000001b3ULL;
+  }
+  for (; *s; s++)
+  {
+    h = (h ^ (unsigned char) *s) * 0x100000001b3ULL;
+  }
+  return (h ^ 0) * 0x100000001b3ULL;
+}
+
+//
+//      makeSource
+//
+//      write the default program to a temporary file, whose name is left
+//      in path
+//
+static char *makeSource(char *path)
+{
+  static char *ops[] = {
+    "  addi r1, r2",
+    "  ldimm r3, %d",
+    "  load r4, L%d",
+    "  ldind r5, -%d(fp)",
+    "  blt r1, r2, L%d",
+    "  push r%d",
+    "  word 0x%x",
+    "  jmp L%d",
+  };
+  FILE *fp;
+  char *dir;
+  int fd;
+  int i;
+
+  dir = getenv("TMPDIR") ? getenv("TMPDIR") : "/tmp";
+  snprintf(path, 4096, "%s/frontendXXXXXX", dir);
+  if ((fd = mkstemp(path)) < 0 || (fp = fdopen(fd, "w")) == NULL)
+  {
+    die(path);
+  }
+
+  fprintf(fp, "  export L0\n  import ext\n");
+  for (i = 0; i < LINES; i++)
+  {
+    if (i % 100 == 0)
+    {
+      fprintf(fp, "L%d:\n", i / 100);
+    }
+    fprintf(fp, ops[i % 8], i % 8 == 5 ? i % 13 : (i / 100) % 1000);
+    fprintf(fp, i % 5 == 0 ? "        # step %d\n" : "\n", i);
+  }
+  fprintf(fp, "  halt\n");
+  if (fclose(fp))
+  {
+    die(path);
+  }
+  return path;
+}
+
+static double now(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void die(char *what)
+{
+  perror(what);
+  exit(1);
+}
@@ -0,0 +1,61 @@
+#!/bin/sh
+#
+# input.sh - compare the mmap and stdio input paths of asx20
+#
+#   usage: bench/input.sh [megabytes] [runs]
+#
+#   generates a source file of about the given size (default 100 MB),
+#   assembles it with the default mapped input and with -s (stdio),
+#   and prints the best wall time of each over the given number of
+#   runs (default 3)
+#
+
+ASX20=${ASX20:-./asx20}
+MB=${1:-100}
+RUNS=${2:-3}
+DIR=$(mktemp -d)
+trap 'rm -rf "$DIR"' EXIT
+
+# about 100 bytes per line, one word per line, so keep the line count
+# under the 2^20 word limit by padding with comments as the size grows
+LINES=$((MB * 10000))
+PAD=$(( (MB * 1048576 / LINES) - 30 ))
+if [ $LINES -gt 1000000 ]; then
+  LINES=1000000
+  PAD=$(( (MB * 1048576 / LINES) - 30 ))
+fi
+
+awk -v lines=$LINES -v pad=$PAD 'BEGIN {
+  c = ""
+  for (i = 0; i < pad; i++) c = c "x"
+  print "export L0"
+  for (i = 0; i < lines; i++) {
+    if (i % 100 == 0) printf "L%d:\n", i / 100
+    if (i % 3 == 0)      printf "  addi r1, r2        # %s\n", c
+    else if (i % 3 == 1) printf "  ldimm r3, %d      # %s\n", i % 1000, c
+    else                 printf "  load r4, L%d      # %s\n", i / 100, c
+  }
+  print "  halt"
+}' > "$DIR/big.asm"
+
+echo "input: $(wc -c < "$DIR/big.asm") bytes, $(wc -l < "$DIR/big.asm") lines"
+
+best() {
+  b=""
+  r=0
+  while [ $r -lt $RUNS ]; do
+    s=$(date +%s.%N)
+    "$ASX20" "$@" "$DIR/big.asm" > /dev/null || exit 1
+    e=$(date +%s.%N)
+    b=$(awk -v s=$s -v e=$e -v b="$b" 'BEGIN {
+      t = e - s
+      if (b == "" || t < b) b = t
+      printf "%.3f", b
+    }')
+    r=$((r + 1))
+  done
+  echo "$b"
+}
+
+echo "stdio: $(best -s) s"
+echo "mmap:  $(best) s"
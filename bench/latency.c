@@ -0,0 +1,261 @@
+//
+// latency.c - compare asx20d round trips with running asx20 per file
+//
+//   usage: bench/latency socket asx20 file.asm [runs]
+//
+//   assembles file.asm "runs" times (default 1000) by sending it to the
+//   asx20d listening on socket, over one connection, and "runs" times by
+//   fork and exec of asx20, and prints the p50 and p99 latency of each
+//   in microseconds. the object from the daemon is checked against the
+//   one asx20 writes.
+//
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include "../asx20d.h"
+
+static double now(void);
+static int compareTimes(const void *, const void *);
+static void report(char *, double *, int);
+static char *readFile(char *, size_t *);
+static int request(int, char *, size_t, char **, size_t *);
+static void readFull(int, void *, size_t);
+static void die(char *);
+
+int main(int argc, char *argv[])
+{
+  struct sockaddr_un addr;
+  char *src, *obj, *objName, *expected;
+  size_t srcLength, objLength, expectedLength;
+  double *times;
+  double t;
+  int runs, fd, status, i;
+  pid_t pid;
+
+  if (argc < 4 || argc > 5)
+  {
+    fprintf(stderr, "usage: latency socket asx20 file.asm [runs]\n");
+    exit(1);
+  }
+  runs = argc == 5 ? atoi(argv[4]) : 1000;
+  if (runs < 1)
+  {
+    die("runs must be positive");
+  }
+  times = malloc(runs * sizeof(double));
+  src = readFile(argv[3], &srcLength);
+
+  // daemon, one connection for all the requests
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strncpy(addr.sun_path, argv[1], sizeof(addr.sun_path) - 1);
+  fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0 || connect(fd, (struct sockaddr *) &addr, sizeof(addr)))
+  {
+    die("can't connect to daemon");
+  }
+  obj = NULL;
+  objLength = 0;
+  for (i = 0; i < runs; i++)
+  {
+    free(obj);
+    t = now();
+    if (request(fd, src, srcLength, &obj, &objLength))
+    {
+      die("daemon reported errors");
+    }
+    times[i] = now() - t;
+  }
+  close(fd);
+  report("asx20d", times, runs);
+
+  // a process per file
+  for (i = 0; i < runs; i++)
+  {
+    t = now();
+    pid = fork();
+    if (pid == 0)
+    {
+      int null = open("/dev/null", O_WRONLY);
+      dup2(null, 1);
+      dup2(null, 2);
+      execl(argv[2], argv[2], argv[3], (char *) NULL);
+      _exit(127);
+    }
+    if (pid < 0 || waitpid(pid, &status, 0) != pid ||
+        !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+    {
+      die("asx20 failed");
+    }
+    times[i] = now() - t;
+  }
+  report("fork+exec", times, runs);
+
+  // the daemon's object must be the one asx20 wrote
+  objName = malloc(strlen(argv[3]) + 5);
+  strcpy(objName, argv[3]);
+  if (strlen(objName) > 4 && !strcmp(objName + strlen(objName) - 4, ".asm"))
+  {
+    objName[strlen(objName) - 4] = '\0';
+  }
+  strcat(objName, ".obj");
+  expected = readFile(objName, &expectedLength);
+  if (expectedLength != objLength || memcmp(expected, obj, objLength))
+  {
+    die("daemon object differs from asx20 object");
+  }
+
+  free(expected);
+  free(objName);
+  free(obj);
+  free(src);
+  free(times);
+  return 0;
+}
+
+// send one source and take its object from the reply
+//   returns the number of errors reported
+static int request(int fd, char *src, size_t srcLength, char **obj,
+  size_t *objLength)
+{
+  union {
+    struct cmsghdr align;
+    char buf[CMSG_SPACE(sizeof(int))];
+  } control;
+  struct asx20d_request req;
+  struct asx20d_reply reply;
+  struct msghdr msg;
+  struct cmsghdr *cmsg;
+  struct iovec iov;
+  size_t rest;
+  char *sections;
+  char *skip;
+  int memfd;
+
+  req.kind = ASX20D_SOURCE;
+  req.length = srcLength;
+  if (write(fd, &req, sizeof(req)) != sizeof(req) ||
+      write(fd, src, srcLength) != (ssize_t) srcLength)
+  {
+    die("can't send request");
+  }
+
+  iov.iov_base = &reply;
+  iov.iov_len = sizeof(reply);
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control.buf;
+  msg.msg_controllen = sizeof(control.buf);
+  if (recvmsg(fd, &msg, MSG_WAITALL) != sizeof(reply))
+  {
+    die("can't read reply");
+  }
+
+  *objLength = reply.object_length;
+  *obj = malloc(reply.object_length + 1);
+  rest = (size_t) reply.listing_length + reply.diag_length;
+
+  if (reply.flags & ASX20D_MEMFD)
+  {
+    cmsg = CMSG_FIRSTHDR(&msg);
+    if (cmsg == NULL || cmsg->cmsg_type != SCM_RIGHTS)
+    {
+      die("reply has no memfd");
+    }
+    memcpy(&memfd, CMSG_DATA(cmsg), sizeof(int));
+    sections = mmap(NULL, reply.object_length + rest, PROT_READ,
+      MAP_PRIVATE, memfd, 0);
+    if (sections == MAP_FAILED)
+    {
+      die("can't map reply");
+    }
+    memcpy(*obj, sections, reply.object_length);
+    munmap(sections, reply.object_length + rest);
+    close(memfd);
+  }
+  else
+  {
+    readFull(fd, *obj, reply.object_length);
+    skip = malloc(rest + 1);
+    readFull(fd, skip, rest);
+    free(skip);
+  }
+  return reply.error_count;
+}
+
+static void readFull(int fd, void *buf, size_t len)
+{
+  ssize_t n;
+
+  while (len > 0)
+  {
+    n = read(fd, buf, len);
+    if (n <= 0)
+    {
+      die("short reply");
+    }
+    buf = (char *) buf + n;
+    len -= n;
+  }
+}
+
+static char *readFile(char *name, size_t *length)
+{
+  struct stat st;
+  char *buf;
+  int fd;
+
+  fd = open(name, O_RDONLY);
+  if (fd < 0 || fstat(fd, &st))
+  {
+    die(name);
+  }
+  buf = malloc(st.st_size + 1);
+  readFull(fd, buf, st.st_size);
+  close(fd);
+  *length = st.st_size;
+  return buf;
+}
+
+static double now(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static int compareTimes(const void *a, const void *b)
+{
+  double x = *(const double *) a;
+  double y = *(const double *) b;
+
+  return x < y ? -1 : x > y;
+}
+
+static void report(char *what, double *times, int runs)
+{
+  qsort(times, runs, sizeof(double), compareTimes);
+  printf("%-10s p50 %9.1f us   p99 %9.1f us   (%d runs)\n", what,
+    times[runs / 2], times[(int) (runs * 0.99)], runs);
+}
+
+static void die(char *why)
+{
+  fprintf(stderr, "latency: %s%s%s\n", why, errno ? ": " : "",
+    errno ? strerror(errno) : "");
+  exit(1);
+}
@@ -0,0 +1,39 @@
+#!/bin/sh
+#
+# latency.sh - compare asx20d round trips with running asx20 per file
+#
+#   usage: bench/latency.sh [lines] [runs]
+#
+#   generates a small source file (default 50 lines), starts asx20d on
+#   a private socket, and runs bench/latency on it for the given number
+#   of runs (default 1000), which prints the p50 and p99 latency of the
+#   daemon and of fork+exec of asx20
+#
+
+ASX20=${ASX20:-./asx20}
+ASX20D=${ASX20D:-./asx20d}
+LATENCY=${LATENCY:-bench/latency}
+LINES=${1:-50}
+RUNS=${2:-1000}
+DIR=$(mktemp -d)
+trap 'kill $PID 2>/dev/null; rm -rf "$DIR"' EXIT
+
+awk -v lines=$LINES 'BEGIN {
+  print "export L0"
+  for (i = 0; i < lines; i++) {
+    if (i % 10 == 0) printf "L%d:\n", i / 10
+    if (i % 3 == 0)      printf "  addi r1, r2\n"
+    else if (i % 3 == 1) printf "  ldimm r3, %d\n", i % 1000
+    else                 printf "  load r4, L%d\n", i / 10
+  }
+  print "  halt"
+}' > "$DIR/small.asm"
+
+"$ASX20D" -j 2 "$DIR/sock" &
+PID=$!
+while [ ! -S "$DIR/sock" ]; do
+  sleep 0.01
+done
+
+echo "input: $(wc -c < "$DIR/small.asm") bytes, $(wc -l < "$DIR/small.asm") lines"
+"$LATENCY" "$DIR/sock" "$ASX20" "$DIR/small.asm" $RUNS
@@ -0,0 +1,227 @@
+//
+// output.c - compare ways of writing the object file
+//
+//   usage: bench/output dir [runs]
+//
+//   assembles a program of 2^20 words, with a thousand exports and a
+//   thousand import references, then writes its object file into dir
+//   "runs" times (default 10) with each writer and prints the best time
+//   of each:
+//
+//     per-word   the writer asx20 used to have: an fwrite per header
+//                word, two per symbol and one per code word
+//     stdio      asx20_obj_write
+//     writev     asx20_obj_write_fd, one writev of the whole file
+//
+//   the files written are checked to be the same
+//
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include "../asx20.h"
+
+#define WORDS   (1 << 20)
+#define LABELS  1000
+
+static double now(void);
+static char *makeSource(size_t *);
+static int writePerWord(const asx20_obj *, FILE *);
+static double best(const asx20_obj *, char *, int, int);
+static char *readFile(char *, size_t *);
+static void die(char *);
+
+int main(int argc, char *argv[])
+{
+  static char *names[] = { "per-word", "stdio", "writev" };
+  char path[3][4096];
+  char *contents[3];
+  size_t lengths[3];
+  asx20_obj obj;
+  asx20_diag diags;
+  size_t srcLength;
+  char *src;
+  double t;
+  int runs;
+  int i;
+
+  if (argc < 2 || argc > 3)
+  {
+    fprintf(stderr, "usage: output dir [runs]\n");
+    exit(1);
+  }
+  runs = argc == 3 ? atoi(argv[2]) : 10;
+
+  src = makeSource(&srcLength);
+  t = now();
+  if (asx20_assemble(src, srcLength, &obj, &diags))
+  {
+    fwrite(diags.text, 1, diags.length, stderr);
+    die("assembly failed");
+  }
+  printf("assembled %d words in %.0f ms\n", obj.code_count,
+    (now() - t) / 1e3);
+
+  for (i = 0; i < 3; i++)
+  {
+    snprintf(path[i], sizeof(path[i]), "%s/%s.obj", argv[1], names[i]);
+    t = best(&obj, path[i], i, runs);
+    contents[i] = readFile(path[i], &lengths[i]);
+    printf("%-9s %8.2f ms  (%zu bytes, best of %d)\n", names[i], t / 1e3,
+      lengths[i], runs);
+  }
+  for (i = 1; i < 3; i++)
+  {
+    if (lengths[i] != lengths[0] ||
+        memcmp(contents[i], contents[0], lengths[0]))
+    {
+      die("object files differ");
+    }
+  }
+
+  for (i = 0; i < 3; i++)
+  {
+    unlink(path[i]);
+    free(contents[i]);
+  }
+  asx20_obj_free(&obj);
+  asx20_diag_free(&diags);
+  free(src);
+  return 0;
+}
+
+// the best time in microseconds of creating, writing and closing the
+// object file with one of the writers
+static double best(const asx20_obj *obj, char *path, int writer, int runs)
+{
+  double b = 0;
+  double t;
+  FILE *fp;
+  int fd;
+  int r;
+
+  for (r = 0; r < runs; r++)
+  {
+    unlink(path);
+    t = now();
+    if (writer == 2)
+    {
+      fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+      if (fd < 0 || asx20_obj_write_fd(obj, fd) || close(fd))
+      {
+        die(path);
+      }
+    }
+    else
+    {
+      fp = fopen(path, "w");
+      if (fp == NULL ||
+          (writer == 0 ? writePerWord(obj, fp) : asx20_obj_write(obj, fp)) ||
+          fclose(fp))
+      {
+        die(path);
+      }
+    }
+    t = now() - t;
+    if (r == 0 || t < b)
+    {
+      b = t;
+    }
+  }
+  return b;
+}
+
+static int writePerWord(const asx20_obj *obj, FILE *fp)
+{
+  int i;
+
+  fwrite(&obj->insymbolWords, sizeof(int), 1, fp);
+  fwrite(&obj->outsymbolWords, sizeof(int), 1, fp);
+  fwrite(&obj->code_count, sizeof(int), 1, fp);
+  for (i = 0; i < obj->export_count; i++)
+  {
+    fwrite(obj->exports[i].name, sizeof(char), 16, fp);
+    fwrite(&obj->exports[i].address, sizeof(int), 1, fp);
+  }
+  for (i = 0; i < obj->import_count; i++)
+  {
+    fwrite(obj->imports[i].name, sizeof(char), 16, fp);
+    fwrite(&obj->imports[i].address, sizeof(int), 1, fp);
+  }
+  for (i = 0; i < obj->code_count; i++)
+  {
+    fwrite(&obj->code[i], sizeof(int), 1, fp);
+  }
+  return ferror(fp) ? -1 : 0;
+}
+
+// a program of exactly WORDS one-word instructions
+static char *makeSource(size_t *length)
+{
+  size_t size = (size_t) WORDS * 24 + LABELS * 48;
+  char *src = malloc(size);
+  size_t n = 0;
+  int i;
+
+  if (src == NULL)
+  {
+    die("out of memory");
+  }
+  n += sprintf(src + n, "  import ext\n");
+  for (i = 0; i < LABELS; i++)
+  {
+    n += sprintf(src + n, "  export L%d\n", i);
+  }
+  for (i = 0; i < WORDS; i++)
+  {
+    if (i % (WORDS / LABELS) == 0 && i / (WORDS / LABELS) < LABELS)
+    {
+      n += sprintf(src + n, "L%d:\n", i / (WORDS / LABELS));
+      n += sprintf(src + n, "  load r4, ext\n");
+    }
+    else
+    {
+      n += sprintf(src + n, "  addi r1, r2\n");
+    }
+  }
+  *length = n;
+  return src;
+}
+
+static char *readFile(char *name, size_t *length)
+{
+  FILE *fp = fopen(name, "r");
+  char *buf;
+  long size;
+
+  if (fp == NULL || fseek(fp, 0, SEEK_END) || (size = ftell(fp)) < 0)
+  {
+    die(name);
+  }
+  rewind(fp);
+  buf = malloc(size + 1);
+  if (buf == NULL || fread(buf, 1, size, fp) != (size_t) size)
+  {
+    die(name);
+  }
+  fclose(fp);
+  *length = size;
+  return buf;
+}
+
+static double now(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static void die(char *why)
+{
+  fprintf(stderr, "output: %s\n", why);
+  exit(1);
+}
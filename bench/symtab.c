@@ -0,0 +1,1023 @@
+//
+// symtab.c - time the symbol table at sizes from a thousand symbols up
+//
+//   usage: bench/symtab [-j] [symbols]
+//
+//   installs labels named as a program's would be (L0, L1, ...) in a
+//   table created with the hint assemble gives it, then looks each of
+//   them up in a random order, and looks up as many that aren't there.
+//   the table is built at each size from 1000 up to "symbols" (default
+//   a million), ten times larger each time, and the time per operation
+//   is printed for each. a table whose lookups take a fixed number of
+//   probes takes about as long per lookup at every size.
+//
+//   then the symbol table work of a line that defines a label and refers
+//   to another ("L5: jmp L9") is timed both ways assemble has done it:
+//   with symtabLookup, symtabInstall and symtabLookup again, and with
+//   symtabLookupOrInsert given the hashes the scanner worked out when it
+//   interned the names.
+//
+//   last, tables made by symtabCreate and by symtabCreateArena are
+//   compared at each size: the time to install the labels, to build,
+//   walk and delete a BST of them, to do the same with the sorted view
+//   assemble lists them from, and to delete the table.
+//
+//   and the index of a table is timed: building it, looking each label
+//   up in it, and listing the labels under prefixes a digit or two
+//   shorter than the labels (L12345 is under L123), per label listed.
+//
+//   finally a concurrent table is given a mixed load by 1 to 16 threads
+//   at once: each looks up labels the others install, one install for
+//   every nine lookups, and the operations per second of them all
+//   together are printed.
+//
+//   with -j it runs the suite that symbol table changes are measured
+//   with instead, and writes the results as JSON to compare between
+//   revisions. four sets of keys are installed, looked up (all of them,
+//   in a random order, and as many that aren't there), iterated over,
+//   put in a BST and walked, put in a sorted view and walked, and the
+//   table deleted, at each size from 1000 keys up to "symbols" (default
+//   a million; 10000000 for the full suite):
+//
+//     sequential  names a generator makes, L00000000, L00000001, ...
+//     random      random labels of 3 to 10 characters
+//     exported16  random names of 16 characters, the longest an
+//                 object file's symbol table keeps
+//     collide     names in groups of 16 with the same hash, built by
+//                 chaining blocks that collide under FNV-1a
+//
+//   each key set at each size is run in a process of its own, whose
+//   peak RSS is reported with the time per operation, and the number of
+//   allocations and bytes the symbol table asked for. the allocations
+//   are counted by wrapping malloc and friends, which the makefile's
+//   -Wl,--wrap flags do.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include "../symtab.h"
+
+// the hint assemble creates its table with
+#define SIZE_HINT 100
+
+static void timeModes(int);
+static void timeIndex(int);
+static void timeConcurrent(int);
+static void *mixedLoad(void *);
+static void runSuite(int);
+static void runKeys(int, int);
+static char **makeKeys(int, int);
+static void findCollisions(void);
+static unsigned int fnvFrom(unsigned int, const char *);
+static uint64_t nextRandom(void);
+static double now(void);
+static char **makeNames(int, const char *);
+static void shuffle(char **, int);
+static void die(char *);
+
+int main(int argc, char *argv[])
+{
+  char **names;
+  char **missing;
+  void *table;
+  double install;
+  double hit;
+  double miss;
+  double line;
+  double upsert;
+  unsigned int *hashes;
+  long found;
+  int most;
+  int n;
+  int i;
+
+  if (argc > 1 && strcmp(argv[1], "-j") == 0)
+  {
+    runSuite(argc > 2 ? atoi(argv[2]) : 1000000);
+    return 0;
+  }
+  if (argc > 2)
+  {
+    fprintf(stderr, "usage: symtab [-j] [symbols]\n");
+    exit(1);
+  }
+  most = argc == 2 ? atoi(argv[1]) : 1000000;
+
+  printf("%10s %12s %12s %12s %12s %12s\n", "symbols", "install ns",
+    "hit ns", "miss ns", "line ns", "upsert ns");
+  for (n = 1000; n <= most; n *= 10)
+  {
+    names = makeNames(n, "L");
+    missing = makeNames(n, "M");
+    found = 0;
+
+    table = symtabCreate(SIZE_HINT);
+    if (table == NULL)
+    {
+      die("symtabCreate");
+    }
+
+    install = now();
+    for (i = 0; i < n; i++)
+    {
+      if (!symtabInstall(table, names[i], names[i]))
+      {
+        die("symtabInstall");
+      }
+    }
+    install = now() - install;
+
+    shuffle(names, n);
+    hit = now();
+    for (i = 0; i < n; i++)
+    {
+      found += symtabLookup(table, names[i]) == names[i];
+    }
+    hit = now() - hit;
+
+    miss = now();
+    for (i = 0; i < n; i++)
+    {
+      found += symtabLookup(table, missing[i]) != NULL;
+    }
+    miss = now() - miss;
+
+    if (found != n)
+    {
+      fprintf(stderr, "found %ld symbols of %d\n", found, n);
+      exit(1);
+    }
+    symtabDelete(table);
+
+    // each line defines names[i] and refers to names[i + 1]
+    line = now();
+    table = symtabCreate(SIZE_HINT);
+    for (i = 0; i < n - 1; i++)
+    {
+      if (symtabLookup(table, names[i]) == NULL &&
+          !symtabInstall(table, names[i], names[i]))
+      {
+        die("symtabInstall");
+      }
+      if (symtabLookup(table, names[i + 1]) == NULL &&
+          !symtabInstall(table, names[i + 1], names[i + 1]))
+      {
+        die("symtabInstall");
+      }
+      found += symtabLookup(table, names[i + 1]) == names[i + 1];
+    }
+    line = now() - line;
+    symtabDelete(table);
+
+    if ((hashes = malloc(n * sizeof(*hashes))) == NULL)
+    {
+      die("malloc");
+    }
+    for (i = 0; i < n; i++)
+    {
+      hashes[i] = symtabHash(names[i]);
+    }
+
+    upsert = now();
+    table = symtabCreate(SIZE_HINT);
+    for (i = 0; i < n - 1; i++)
+    {
+      void **slot;
+
+      if ((slot = symtabLookupOrInsert(table, names[i], hashes[i])) == NULL)
+      {
+        die("symtabLookupOrInsert");
+      }
+      *slot = names[i];
+      if ((slot = symtabLookupOrInsert(table, names[i + 1], hashes[i + 1])) == NULL)
+      {
+        die("symtabLookupOrInsert");
+      }
+      if (*slot == NULL)
+      {
+        *slot = names[i + 1];
+      }
+      found += *slot == names[i + 1];
+    }
+    upsert = now() - upsert;
+    symtabDelete(table);
+    free(hashes);
+
+    if (found != n + 2 * (n - 1))
+    {
+      fprintf(stderr, "lines found %ld symbols\n", found);
+      exit(1);
+    }
+
+    printf("%10d %12.1f %12.1f %12.1f %12.1f %12.1f\n", n, install * 1e9 / n,
+      hit * 1e9 / n, miss * 1e9 / n, line * 1e9 / (n - 1),
+      upsert * 1e9 / (n - 1));
+
+    for (i = 0; i < n; i++)
+    {
+      free(names[i]);
+      free(missing[i]);
+    }
+    free(names);
+    free(missing);
+  }
+
+  timeModes(most);
+  timeIndex(most);
+  timeConcurrent(most);
+  return 0;
+}
+
+//
+//      timeModes
+//
+//      time each way of allocating a table's memory, for each size up
+//      to most
+//
+static void timeModes(int most)
+{
+  static void *(*create[])(int) = { symtabCreate, symtabCreateArena };
+  static const char *mode[] = { "malloc", "arena" };
+  char **names;
+  void *table;
+  void *iterator;
+  void *tree;
+  void *walk;
+  void *data;
+  const char *symbol;
+  const char *last;
+  double install;
+  double sort;
+  double view;
+  double teardown;
+  long found;
+  int n;
+  int m;
+  int i;
+
+  printf("\n%10s %8s %12s %12s %12s %12s\n", "symbols", "mode",
+    "install ns", "bst ns", "sorted ns", "delete ns");
+  for (n = 1000; n <= most; n *= 10)
+  {
+    names = makeNames(n, "L");
+    for (m = 0; m < 2; m++)
+    {
+      install = now();
+      if ((table = create[m](SIZE_HINT)) == NULL)
+      {
+        die("symtabCreate");
+      }
+      for (i = 0; i < n; i++)
+      {
+        if (!symtabInstall(table, names[i], names[i]))
+        {
+          die("symtabInstall");
+        }
+      }
+      install = now() - install;
+
+      sort = now();
+      if ((iterator = symtabCreateIterator(table)) == NULL ||
+          (tree = symtabCreateBST(iterator)) == NULL)
+      {
+        die("symtabCreateBST");
+      }
+      walk = symtabCreateBSTIterator(tree);
+      found = 0;
+      while (symtabBSTNext(walk, &data) != NULL)
+      {
+        found++;
+      }
+      symtabDeleteBSTIterator(walk);
+      symtabBSTDelete(tree);
+      symtabDeleteIterator(iterator);
+      sort = now() - sort;
+
+      if (found != n)
+      {
+        fprintf(stderr, "walked %ld symbols of %d\n", found, n);
+        exit(1);
+      }
+
+      view = now();
+      if ((walk = symtabSortedView(table)) == NULL)
+      {
+        die("symtabSortedView");
+      }
+      last = NULL;
+      for (i = 0; i < symtabSortedCount(walk); i++)
+      {
+        symbol = symtabSortedEntry(walk, i, &data);
+        if (strcmp(symbol, data) != 0 ||
+            (last != NULL && strcmp(last, symbol) >= 0))
+        {
+          fprintf(stderr, "sorted view out of order at %d\n", i);
+          exit(1);
+        }
+        last = symbol;
+      }
+      symtabDeleteSortedView(walk);
+      view = now() - view;
+
+      teardown = now();
+      symtabDelete(table);
+      teardown = now() - teardown;
+
+      printf("%10d %8s %12.1f %12.1f %12.1f %12.1f\n", n, mode[m],
+        install * 1e9 / n, sort * 1e9 / n, view * 1e9 / n,
+        teardown * 1e9 / n);
+    }
+    for (i = 0; i < n; i++)
+    {
+      free(names[i]);
+    }
+    free(names);
+  }
+}
+
+//
+//      timeIndex
+//
+//      time an index of the table for each size up to most
+//
+static void timeIndex(int most)
+{
+  char **names;
+  char prefix[32];
+  void *table;
+  void *index;
+  void *range;
+  void *data;
+  double build;
+  double lookup;
+  double list;
+  long found;
+  long listed;
+  int n;
+  int i;
+
+  printf("\n%10s %12s %12s %12s\n", "symbols", "build ns", "lookup ns",
+    "prefix ns");
+  for (n = 1000; n <= most; n *= 10)
+  {
+    names = makeNames(n, "L");
+    if ((table = symtabCreateArena(SIZE_HINT)) == NULL)
+    {
+      die("symtabCreateArena");
+    }
+    for (i = 0; i < n; i++)
+    {
+      if (!symtabInstall(table, names[i], names[i]))
+      {
+        die("symtabInstall");
+      }
+    }
+
+    build = now();
+    if ((index = symtabCreateIndex(table)) == NULL)
+    {
+      die("symtabCreateIndex");
+    }
+    build = now() - build;
+
+    shuffle(names, n);
+    found = 0;
+    lookup = now();
+    for (i = 0; i < n; i++)
+    {
+      found += symtabIndexLookup(index, names[i]) == names[i];
+    }
+    lookup = now() - lookup;
+    if (found != n)
+    {
+      fprintf(stderr, "index found %ld symbols of %d\n", found, n);
+      exit(1);
+    }
+
+    // one query for each thousandth of the labels
+    listed = 0;
+    list = now();
+    for (i = 0; i < n; i += 1000)
+    {
+      snprintf(prefix, sizeof(prefix), "%s", names[i]);
+      prefix[strlen(prefix) > 3 ? strlen(prefix) - 2 : 2] = '\0';
+      if ((range = symtabIndexPrefix(index, prefix)) == NULL)
+      {
+        die("symtabIndexPrefix");
+      }
+      while (symtabIndexNext(range, &data) != NULL)
+      {
+        listed++;
+      }
+      symtabDeleteRange(range);
+    }
+    list = now() - list;
+
+    printf("%10d %12.1f %12.1f %12.1f\n", n, build * 1e9 / n,
+      lookup * 1e9 / n, list * 1e9 / (listed ? listed : 1));
+
+    symtabDeleteIndex(index);
+    symtabDelete(table);
+    for (i = 0; i < n; i++)
+    {
+      free(names[i]);
+    }
+    free(names);
+  }
+}
+
+// what each thread of timeConcurrent is given to do
+struct load
+{
+  void *table;
+  char **names;
+  int first;
+  int count;
+  long found;
+};
+
+//
+//      timeConcurrent
+//
+//      time a concurrent table under a mixed load from more and more
+//      threads, with most operations in all
+//
+static void timeConcurrent(int most)
+{
+  struct load loads[16];
+  pthread_t threads[16];
+  char **names;
+  void *table;
+  double took;
+  int ops;
+  int n;
+  int t;
+  int i;
+
+  ops = most < 160 ? 160 : most;
+  names = makeNames(ops, "L");
+
+  printf("\n%10s %12s\n", "threads", "Mops/s");
+  for (n = 1; n <= 16; n *= 2)
+  {
+    if ((table = symtabCreateConcurrent(SIZE_HINT, 0)) == NULL)
+    {
+      die("symtabCreateConcurrent");
+    }
+
+    took = now();
+    for (t = 0; t < n; t++)
+    {
+      loads[t].table = table;
+      loads[t].names = names;
+      loads[t].first = t * (ops / n);
+      loads[t].count = ops / n;
+      loads[t].found = 0;
+      if (pthread_create(&threads[t], NULL, mixedLoad, &loads[t]))
+      {
+        die("pthread_create");
+      }
+    }
+    for (t = 0; t < n; t++)
+    {
+      pthread_join(threads[t], NULL);
+    }
+    took = now() - took;
+
+    printf("%10d %12.2f\n", n, (double)(ops / n) * n / took / 1e6);
+    symtabDeleteConcurrent(table);
+  }
+
+  for (i = 0; i < ops; i++)
+  {
+    free(names[i]);
+  }
+  free(names);
+}
+
+//
+//      mixedLoad
+//
+//      one thread of timeConcurrent: of every ten operations, install
+//      one of its own labels and look up nine spread over all of them
+//
+static void *mixedLoad(void *arg)
+{
+  struct load *load = arg;
+  unsigned int r = load->first + 1;
+  char *name;
+  int i;
+
+  for (i = 0; i < load->count; i++)
+  {
+    if (i % 10 == 0)
+    {
+      name = load->names[load->first + i];
+      if (symtabConcurrentLookupOrInsert(load->table, name,
+            symtabHash(name), name) == NULL)
+      {
+        die("symtabConcurrentLookupOrInsert");
+      }
+    }
+    else
+    {
+      r = r * 1103515245 + 12345;
+      load->found += symtabConcurrentLookup(load->table,
+        load->names[(r >> 8) % (load->first + load->count)]) != NULL;
+    }
+  }
+  return NULL;
+}
+
+// the key sets of the suite
+#define SEQUENTIAL 0
+#define RANDOM 1
+#define EXPORTED16 2
+#define COLLIDE 3
+#define KEY_SETS 4
+
+static const char *keySetName[KEY_SETS] =
+  { "sequential", "random", "exported16", "collide" };
+
+// room for each key of a set, with its null
+static const int keyStride[KEY_SETS] = { 10, 11, 17, 44 };
+
+// the collide set: a name is one of each pair of 8 character blocks,
+// then its group's number. the two blocks of a pair bring FNV-1a to
+// the same state from the one the pairs before leave it in, so the 16
+// names of a group all have the same hash
+#define COLLIDE_BLOCKS 4
+static char collideBlocks[COLLIDE_BLOCKS][2][9];
+
+// what the symbol table allocates, counted by the wrappers below
+static long allocCount;
+static long allocBytes;
+
+void *__real_malloc(size_t);
+void *__real_calloc(size_t, size_t);
+void *__real_realloc(void *, size_t);
+int __real_posix_memalign(void **, size_t, size_t);
+
+void *__wrap_malloc(size_t size)
+{
+  __atomic_fetch_add(&allocCount, 1, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&allocBytes, (long) size, __ATOMIC_RELAXED);
+  return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t n, size_t size)
+{
+  __atomic_fetch_add(&allocCount, 1, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&allocBytes, (long) (n * size), __ATOMIC_RELAXED);
+  return __real_calloc(n, size);
+}
+
+void *__wrap_realloc(void *p, size_t size)
+{
+  __atomic_fetch_add(&allocCount, 1, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&allocBytes, (long) size, __ATOMIC_RELAXED);
+  return __real_realloc(p, size);
+}
+
+int __wrap_posix_memalign(void **p, size_t align, size_t size)
+{
+  __atomic_fetch_add(&allocCount, 1, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&allocBytes, (long) size, __ATOMIC_RELAXED);
+  return __real_posix_memalign(p, align, size);
+}
+
+//
+//      runSuite
+//
+//      run every key set at every size up to most, each in a child
+//      process, and print the results as one JSON document
+//
+static void runSuite(int most)
+{
+  int runs;
+  int set;
+  int n;
+  int status;
+  pid_t pid;
+
+  findCollisions();
+
+  printf("{\n  \"benchmark\": \"symtab\",\n  \"runs\": [\n");
+  runs = 0;
+  for (set = 0; set < KEY_SETS; set++)
+  {
+    for (n = 1000; n <= most; n *= 10)
+    {
+      if (runs++ > 0)
+      {
+        printf(",\n");
+      }
+      fflush(stdout);
+
+      if ((pid = fork()) < 0)
+      {
+        die("fork");
+      }
+      if (pid == 0)
+      {
+        runKeys(set, n);
+        fflush(stdout);
+        _exit(0);
+      }
+      if (waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) ||
+          WEXITSTATUS(status) != 0)
+      {
+        fprintf(stderr, "%s at %d keys failed\n", keySetName[set], n);
+        exit(1);
+      }
+    }
+  }
+  printf("\n  ]\n}\n");
+}
+
+//
+//      runKeys
+//
+//      time one key set at one size, printing a JSON object
+//
+static void runKeys(int set, int n)
+{
+  char **keys;
+  char **order;
+  void *table;
+  void *iterator;
+  void *tree;
+  void *walk;
+  void *view;
+  void *data;
+  double install;
+  double hit;
+  double miss;
+  double iterate;
+  double sort;
+  double sorted;
+  double teardown;
+  long installCount;
+  long installBytes;
+  long count;
+  long bytes;
+  long found;
+  struct rusage usage;
+  int i;
+
+  // the first n keys are installed, and the next n looked up as misses
+  keys = makeKeys(set, 2 * n);
+  if ((order = malloc(n * sizeof(*order))) == NULL)
+  {
+    die("malloc");
+  }
+  memcpy(order, keys, n * sizeof(*order));
+  shuffle(order, n);
+
+  count = allocCount;
+  bytes = allocBytes;
+  found = 0;
+
+  install = now();
+  if ((table = symtabCreate(SIZE_HINT)) == NULL)
+  {
+    die("symtabCreate");
+  }
+  for (i = 0; i < n; i++)
+  {
+    if (!symtabInstall(table, keys[i], keys[i]))
+    {
+      die("symtabInstall");
+    }
+  }
+  install = now() - install;
+  installCount = allocCount - count;
+  installBytes = allocBytes - bytes;
+
+  hit = now();
+  for (i = 0; i < n; i++)
+  {
+    found += symtabLookup(table, order[i]) == order[i];
+  }
+  hit = now() - hit;
+
+  miss = now();
+  for (i = n; i < 2 * n; i++)
+  {
+    found += symtabLookup(table, keys[i]) != NULL;
+  }
+  miss = now() - miss;
+
+  iterate = now();
+  if ((iterator = symtabCreateIterator(table)) == NULL)
+  {
+    die("symtabCreateIterator");
+  }
+  while (symtabNext(iterator, &data) != NULL)
+  {
+    found++;
+  }
+  symtabDeleteIterator(iterator);
+  iterate = now() - iterate;
+
+  sort = now();
+  if ((iterator = symtabCreateIterator(table)) == NULL ||
+      (tree = symtabCreateBST(iterator)) == NULL)
+  {
+    die("symtabCreateBST");
+  }
+  walk = symtabCreateBSTIterator(tree);
+  while (symtabBSTNext(walk, &data) != NULL)
+  {
+    found++;
+  }
+  symtabDeleteBSTIterator(walk);
+  symtabBSTDelete(tree);
+  symtabDeleteIterator(iterator);
+  sort = now() - sort;
+
+  sorted = now();
+  if ((view = symtabSortedView(table)) == NULL)
+  {
+    die("symtabSortedView");
+  }
+  for (i = 0; i < symtabSortedCount(view); i++)
+  {
+    found += symtabSortedEntry(view, i, &data) != NULL;
+  }
+  symtabDeleteSortedView(view);
+  sorted = now() - sorted;
+
+  teardown = now();
+  symtabDelete(table);
+  teardown = now() - teardown;
+
+  if (found != 4L * n)
+  {
+    fprintf(stderr, "%s: found %ld keys of %ld\n", keySetName[set], found,
+      4L * n);
+    exit(1);
+  }
+
+  getrusage(RUSAGE_SELF, &usage);
+  printf("    {\"keys\": \"%s\", \"n\": %d, "
+    "\"install_ns\": %.1f, \"hit_ns\": %.1f, \"miss_ns\": %.1f, "
+    "\"iterate_ns\": %.1f, \"bst_ns\": %.1f, \"sorted_ns\": %.1f, "
+    "\"delete_ns\": %.1f, \"install_allocs\": %ld, "
+    "\"install_alloc_bytes\": %ld, \"allocs\": %ld, "
+    "\"alloc_bytes\": %ld, \"peak_rss_kb\": %ld}",
+    keySetName[set], n, install * 1e9 / n, hit * 1e9 / n, miss * 1e9 / n,
+    iterate * 1e9 / n, sort * 1e9 / n, sorted * 1e9 / n,
+    teardown * 1e9 / n, installCount, installBytes, allocCount - count,
+    allocBytes - bytes, usage.ru_maxrss);
+}
+
+//
+//      makeKeys
+//
+//      n different keys of a set, all in one block
+//
+static char **makeKeys(int set, int n)
+{
+  char **keys;
+  char *block;
+  void *seen;
+  int stride;
+  int length;
+  int i;
+  int j;
+
+  stride = keyStride[set];
+  if ((keys = malloc(n * sizeof(*keys))) == NULL ||
+      (block = malloc((size_t) n * stride)) == NULL)
+  {
+    die("makeKeys");
+  }
+
+  // random keys are drawn until they are all different
+  seen = NULL;
+  if (set == RANDOM || set == EXPORTED16)
+  {
+    if ((seen = symtabCreate(n)) == NULL)
+    {
+      die("symtabCreate");
+    }
+  }
+
+  for (i = 0; i < n; i++)
+  {
+    char *key = keys[i] = block + (size_t) i * stride;
+
+    switch (set)
+    {
+    case SEQUENTIAL:
+      snprintf(key, stride, "L%08d", i);
+      break;
+
+    case RANDOM:
+    case EXPORTED16:
+      do
+      {
+        static const char rest[] = "abcdefghijklmnopqrstuvwxyz0123456789_";
+
+        length = set == RANDOM ? 3 + (int) (nextRandom() % 8) : 16;
+        key[0] = 'a' + nextRandom() % 26;
+        for (j = 1; j < length; j++)
+        {
+          key[j] = rest[nextRandom() % (sizeof(rest) - 1)];
+        }
+        key[length] = '\0';
+      } while (symtabLookup(seen, key) != NULL);
+      if (!symtabInstall(seen, key, key))
+      {
+        die("symtabInstall");
+      }
+      break;
+
+    case COLLIDE:
+      key[0] = '\0';
+      for (j = 0; j < COLLIDE_BLOCKS; j++)
+      {
+        strcat(key, collideBlocks[j][(i >> j) & 1]);
+      }
+      snprintf(key + COLLIDE_BLOCKS * 8, stride - COLLIDE_BLOCKS * 8, "_%d",
+        i >> COLLIDE_BLOCKS);
+      if (i % 16 != 0 && symtabHash(key) != symtabHash(keys[i - i % 16]))
+      {
+        fprintf(stderr, "collide: %s does not collide\n", key);
+        exit(1);
+      }
+      break;
+    }
+  }
+
+  if (seen != NULL)
+  {
+    symtabDelete(seen);
+  }
+  return keys;
+}
+
+//
+//      findCollisions
+//
+//      find the pairs of blocks of the collide set, each by drawing
+//      random blocks until two bring FNV-1a to the same state from where
+//      the pairs before leave it
+//
+static void findCollisions(void)
+{
+  enum { SLOTS = 1 << 20 };
+  unsigned int *hashes;
+  char (*blocks)[9];
+  unsigned int state;
+  unsigned int h;
+  unsigned int k;
+  int pair;
+  int j;
+
+  if ((hashes = malloc(SLOTS * sizeof(*hashes))) == NULL ||
+      (blocks = malloc(SLOTS * sizeof(*blocks))) == NULL)
+  {
+    die("findCollisions");
+  }
+
+  state = 2166136261u;
+  for (pair = 0; pair < COLLIDE_BLOCKS; pair++)
+  {
+    memset(blocks, 0, SLOTS * sizeof(*blocks));
+    for (;;)
+    {
+      char block[9];
+
+      for (j = 0; j < 8; j++)
+      {
+        block[j] = 'a' + nextRandom() % 26;
+      }
+      block[8] = '\0';
+      h = fnvFrom(state, block);
+
+      for (k = h & (SLOTS - 1); blocks[k][0] != '\0'; k = (k + 1) & (SLOTS - 1))
+      {
+        if (hashes[k] == h && strcmp(blocks[k], block) != 0)
+        {
+          break;
+        }
+      }
+      if (blocks[k][0] != '\0')
+      {
+        strcpy(collideBlocks[pair][0], blocks[k]);
+        strcpy(collideBlocks[pair][1], block);
+        break;
+      }
+      hashes[k] = h;
+      strcpy(blocks[k], block);
+    }
+    state = h;
+  }
+
+  free(hashes);
+  free(blocks);
+}
+
+//
+//      fnvFrom
+//
+//      FNV-1a, as symtabHash works it out, carried on from a state
+//
+static unsigned int fnvFrom(unsigned int state, const char *s)
+{
+  while (*s)
+  {
+    state = (state ^ (unsigned char) *s++) * 16777619u;
+  }
+  return state;
+}
+
+//
+//      nextRandom
+//
+//      the next of a series of random numbers, the same every run
+//
+static uint64_t nextRandom(void)
+{
+  static uint64_t x = 2463534242ULL;
+
+  x ^= x << 13;
+  x ^= x >> 7;
+  x ^= x << 17;
+  return x;
+}
+
+//
+//      makeNames
+//
+//      the names prefix0 to prefix(n - 1)
+//
+static char **makeNames(int n, const char *prefix)
+{
+  char **names;
+  char buf[32];
+  int i;
+
+  if ((names = malloc(n * sizeof(*names))) == NULL)
+  {
+    die("makeNames");
+  }
+  for (i = 0; i < n; i++)
+  {
+    snprintf(buf, sizeof(buf), "%s%d", prefix, i);
+    if ((names[i] = malloc(strlen(buf) + 1)) == NULL)
+    {
+      die("makeNames");
+    }
+    strcpy(names[i], buf);
+  }
+  return names;
+}
+
+//
+//      shuffle
+//
+//      put the names in a random order, the same every run
+//
+static void shuffle(char **names, int n)
+{
+  uint64_t x = 88172645463325252ULL;
+  int i;
+
+  for (i = n - 1; i > 0; i--)
+  {
+    int j;
+    char *t;
+
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    j = (int) (x % (uint64_t) (i + 1));
+    t = names[i];
+    names[i] = names[j];
+    names[j] = t;
+  }
+}
+
+static double now(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void die(char *what)
+{
+  perror(what);
+  exit(1);
+}
@@ -0,0 +1,315 @@
+//
+// cache.c - object cache for the asx20 driver
+//
+//           an entry is a small header followed by the object file, the
+//           listing and the messages, one after the other. entries are
+//           written to a temporary file and renamed into place, so
+//           assemblers sharing a cache never see part of one.
+//
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "cache.h"
+
+// first bytes of every entry; change it if the layout changes
+#define CACHE_MAGIC "asx20c1"
+
+struct entryHeader {
+  char magic[8];
+  int32_t errorCount;
+  uint32_t objectLength;
+  uint32_t listingLength;
+  uint32_t textLength;
+};
+
+// forward references
+static void hash128(const unsigned char *, size_t, uint64_t, uint64_t *);
+static char *entryName(const char *, const char *, const char *);
+
+//
+//      cacheKey
+//
+//      the key is a 128-bit MurmurHash3 of the source, seeded with a hash
+//      of ASX20_VERSION and the options, so that a new assembler doesn't
+//      replay what an old one produced, nor one option what another did
+//
+//      the mapping hashed is handed back rather than unmapped, so a miss
+//      assembles the same bytes and a file changed in between can't be
+//      stored under the key of what it was before
+//
+int cacheKey(const char *name, unsigned int options,
+  char key[CACHE_KEY_LENGTH + 1], char **src, size_t *length)
+{
+  char version[sizeof(ASX20_VERSION) + 16];
+  uint64_t seed[2];
+  uint64_t h[2];
+  struct stat st;
+  void *map;
+  int fd;
+
+  fd = open(name, O_RDONLY);
+  if (fd < 0)
+  {
+    return -1;
+  }
+  if (fstat(fd, &st) || !S_ISREG(st.st_mode))
+  {
+    close(fd);
+    return -1;
+  }
+
+  snprintf(version, sizeof(version), "%s/%x", ASX20_VERSION, options);
+  hash128((const unsigned char *) version, strlen(version), 0, seed);
+  if (st.st_size == 0)
+  {
+    // nothing to map; an empty source is still a source
+    *src = "";
+    *length = 0;
+    hash128(NULL, 0, seed[0], h);
+  }
+  else
+  {
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED)
+    {
+      close(fd);
+      return -1;
+    }
+    *src = map;
+    *length = st.st_size;
+    hash128(map, st.st_size, seed[0], h);
+  }
+  close(fd);
+
+  snprintf(key, CACHE_KEY_LENGTH + 1, "%016llx%016llx",
+    (unsigned long long) h[0], (unsigned long long) h[1]);
+  return 0;
+}
+
+//
+//      cacheLookup
+//
+int cacheLookup(const char *dir, const char *key, struct cacheEntry *entry)
+{
+  struct entryHeader *header;
+  struct stat st;
+  char *name;
+  char *map;
+  int fd;
+
+  name = entryName(dir, key, "");
+  fd = open(name, O_RDONLY);
+  free(name);
+  if (fd < 0)
+  {
+    return -1;
+  }
+  if (fstat(fd, &st) || st.st_size < (off_t) sizeof(struct entryHeader))
+  {
+    close(fd);
+    return -1;
+  }
+  map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED)
+  {
+    return -1;
+  }
+
+  // an entry that doesn't add up is ignored, and replaced by the store
+  // that follows the miss
+  header = (struct entryHeader *) map;
+  if (memcmp(header->magic, CACHE_MAGIC, sizeof(header->magic)) ||
+      sizeof(struct entryHeader) + (off_t) header->objectLength +
+      header->listingLength + header->textLength != st.st_size)
+  {
+    munmap(map, st.st_size);
+    return -1;
+  }
+
+  entry->map = map;
+  entry->mapLength = st.st_size;
+  entry->errorCount = header->errorCount;
+  entry->object = map + sizeof(struct entryHeader);
+  entry->objectLength = header->objectLength;
+  entry->listing = entry->object + entry->objectLength;
+  entry->listingLength = header->listingLength;
+  entry->text = entry->listing + entry->listingLength;
+  entry->textLength = header->textLength;
+  return 0;
+}
+
+//
+//      cacheRelease
+//
+void cacheRelease(struct cacheEntry *entry)
+{
+  munmap(entry->map, entry->mapLength);
+  memset(entry, 0, sizeof(*entry));
+}
+
+//
+//      cacheStore
+//
+void cacheStore(const char *dir, const char *key, const asx20_obj *obj,
+  const asx20_diag *diags, int errorCount)
+{
+  struct entryHeader header;
+  char *tmpName;
+  char *name;
+  FILE *fp;
+  long end;
+  int fd;
+
+  tmpName = entryName(dir, key, ".XXXXXX");
+  fd = mkstemp(tmpName);
+  if (fd < 0)
+  {
+    free(tmpName);
+    return;
+  }
+  fp = fdopen(fd, "w");
+  if (fp == NULL)
+  {
+    close(fd);
+    unlink(tmpName);
+    free(tmpName);
+    return;
+  }
+
+  // the header goes in last, once the object's length is known
+  memset(&header, 0, sizeof(header));
+  fwrite(&header, sizeof(header), 1, fp);
+  if (errorCount == 0)
+  {
+    asx20_obj_write(obj, fp);
+  }
+  end = ftell(fp);
+  fwrite(obj->listing, 1, obj->listing_length, fp);
+  fwrite(diags->text, 1, diags->length, fp);
+
+  memcpy(header.magic, CACHE_MAGIC, sizeof(header.magic));
+  header.errorCount = errorCount;
+  header.objectLength = end - sizeof(header);
+  header.listingLength = obj->listing_length;
+  header.textLength = diags->length;
+  fseek(fp, 0, SEEK_SET);
+  fwrite(&header, sizeof(header), 1, fp);
+
+  name = entryName(dir, key, "");
+  if (ferror(fp) | fclose(fp) || rename(tmpName, name))
+  {
+    unlink(tmpName);
+  }
+  free(name);
+  free(tmpName);
+}
+
+//
+//      entryName
+//
+//      the file name of an entry, with a suffix
+//
+static
+char *entryName(const char *dir, const char *key, const char *suffix)
+{
+  char *name;
+
+  name = malloc(strlen(dir) + 2 + CACHE_KEY_LENGTH + strlen(suffix) + 1);
+  if (name == NULL)
+  {
+    fprintf(stderr, "malloc failed for cache entry name\n");
+    exit(1);
+  }
+  sprintf(name, "%s/%s%s", dir, key, suffix);
+  return name;
+}
+
+//
+//      hash128
+//
+//      MurmurHash3 x64_128 of len bytes, giving two 64-bit halves
+//
+
+static inline uint64_t rotl64(uint64_t x, int r)
+{
+  return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t fmix64(uint64_t k)
+{
+  k ^= k >> 33;
+  k *= 0xff51afd7ed558ccdULL;
+  k ^= k >> 33;
+  k *= 0xc4ceb9fe1a85ec53ULL;
+  k ^= k >> 33;
+  return k;
+}
+
+static
+void hash128(const unsigned char *data, size_t len, uint64_t seed,
+  uint64_t *out)
+{
+  const uint64_t c1 = 0x87c37b91114253d5ULL;
+  const uint64_t c2 = 0x4cf5ad432745937fULL;
+  size_t nblocks = len / 16;
+  const unsigned char *tail = data + nblocks * 16;
+  uint64_t h1 = seed;
+  uint64_t h2 = seed;
+  uint64_t k1, k2;
+  size_t i;
+
+  for (i = 0; i < nblocks; i++)
+  {
+    memcpy(&k1, data + i * 16, 8);
+    memcpy(&k2, data + i * 16 + 8, 8);
+
+    k1 *= c1; k1 = rotl64(k1, 31); k1 *= c2; h1 ^= k1;
+    h1 = rotl64(h1, 27); h1 += h2; h1 = h1 * 5 + 0x52dce729;
+
+    k2 *= c2; k2 = rotl64(k2, 33); k2 *= c1; h2 ^= k2;
+    h2 = rotl64(h2, 31); h2 += h1; h2 = h2 * 5 + 0x38495ab5;
+  }
+
+  k1 = 0;
+  k2 = 0;
+  switch (len & 15)
+  {
+    case 15: k2 ^= (uint64_t) tail[14] << 48;  // fall through
+    case 14: k2 ^= (uint64_t) tail[13] << 40;  // fall through
+    case 13: k2 ^= (uint64_t) tail[12] << 32;  // fall through
+    case 12: k2 ^= (uint64_t) tail[11] << 24;  // fall through
+    case 11: k2 ^= (uint64_t) tail[10] << 16;  // fall through
+    case 10: k2 ^= (uint64_t) tail[9] << 8;    // fall through
+    case 9:  k2 ^= (uint64_t) tail[8];
+             k2 *= c2; k2 = rotl64(k2, 33); k2 *= c1; h2 ^= k2;
+             // fall through
+    case 8:  k1 ^= (uint64_t) tail[7] << 56;   // fall through
+    case 7:  k1 ^= (uint64_t) tail[6] << 48;   // fall through
+    case 6:  k1 ^= (uint64_t) tail[5] << 40;   // fall through
+    case 5:  k1 ^= (uint64_t) tail[4] << 32;   // fall through
+    case 4:  k1 ^= (uint64_t) tail[3] << 24;   // fall through
+    case 3:  k1 ^= (uint64_t) tail[2] << 16;   // fall through
+    case 2:  k1 ^= (uint64_t) tail[1] << 8;    // fall through
+    case 1:  k1 ^= (uint64_t) tail[0];
+             k1 *= c1; k1 = rotl64(k1, 31); k1 *= c2; h1 ^= k1;
+  }
+
+  h1 ^= len;
+  h2 ^= len;
+  h1 += h2;
+  h2 += h1;
+  h1 = fmix64(h1);
+  h2 = fmix64(h2);
+  h1 += h2;
+  h2 += h1;
+
+  out[0] = h1;
+  out[1] = h2;
+}
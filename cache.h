@@ -0,0 +1,54 @@
+//
+// cache.h - interface to the object cache of the asx20 driver
+//
+// The cache is a directory of entries named by a 128-bit hash of the
+// source and the assembler version. An entry holds what assembling that
+// source produced: the object file, the symbol listing and the
+// messages, with the error count. A hit is replayed from a mapping of
+// the entry without running the assembler.
+//
+
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stddef.h>
+#include "asx20.h"
+
+// length of a key in hex digits
+#define CACHE_KEY_LENGTH 32
+
+// a cache entry found by cacheLookup
+struct cacheEntry {
+  void *map;                     // the mapped entry
+  size_t mapLength;
+  int errorCount;
+  char *object;                  // vmx20 object file; empty with errors
+  size_t objectLength;
+  char *listing;
+  size_t listingLength;
+  char *text;                    // messages
+  size_t textLength;
+};
+
+// compute the key of the named source file, assembled with the given
+// ASX20_ options
+//   the source that was hashed is left mapped at *src, *length bytes,
+//   so that a miss can assemble the very bytes it was keyed on; the
+//   caller unmaps it with munmap when *length isn't 0
+//   returns 0 on success, -1 if the file can't be read
+int cacheKey(const char *name, unsigned int options,
+  char key[CACHE_KEY_LENGTH + 1], char **src, size_t *length);
+
+// find the entry for a key in the cache directory
+//   returns 0 on a hit, -1 on a miss
+int cacheLookup(const char *dir, const char *key, struct cacheEntry *);
+
+// release an entry found by cacheLookup
+void cacheRelease(struct cacheEntry *);
+
+// add what an assembly produced to the cache directory
+//   failing to store an entry is not an error; the next run just misses
+void cacheStore(const char *dir, const char *key, const asx20_obj *,
+  const asx20_diag *, int errorCount);
+
+#endif
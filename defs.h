@@ -3,7 +3,12 @@
 //
 //
 
+#ifndef DEFS_H
+#define DEFS_H
+
 #include <stdio.h>
+#include "asx20.h"
+#include "opcodes.h"
 
 ////////////////////////////////////////////////////////////////////////////
 // struct for communication between parser and assembler guts
@@ -11,13 +16,16 @@
 // the parser will pass this struct to the assemble function for
 // each line of input that contains a label, instruction, or directive
 //
-// the struct contains three members:
+// the struct contains four members:
 //   1. format number
 //        0 indicates there is no instruction, only a label on the line
 //        1-8 indicate the eight instruction formats for vm520
 //        9 indicates that it is the "word" or "alloc" directive
-//   2. opcode
-//   3. union
+//   2. opcode, an OPCODE_ value from opcodes.h
+//        OPCODE_NONE if there is no instruction
+//        OPCODE_UNKNOWN if the mnemonic is not in the opcode table
+//   3. mnemonic, the name as written when the opcode is OPCODE_UNKNOWN
+//   4. union
 //        the union has a member for formats 2-9, which contain the
 //          particular components required for each format
 //
@@ -32,7 +40,8 @@
 //
 typedef struct instruction {
     unsigned int format;
-    char * opcode;
+    int opcode;
+    char * mnemonic;
     union {
       struct format2 {
         char * addr;
@@ -68,32 +77,153 @@ typedef struct instruction {
     } u;
 } INSTR;
 
+////////////////////////////////////////////////////////////////////////////
+// state of one assembly
+//
+// everything an assembly needs is kept in an AsmContext rather than in
+// globals, so several assemblies can run at the same time in different
+// threads, and a context can be reset and reused for another input.
+//
+// the scanner, the parser, the message routines and the assembler guts
+// all take the context as their first argument.
+//
+typedef struct asm_context {
+
+  // scanner state (scan.l)
+  void *scanner;                 // reentrant flex scanner (a yyscan_t)
+  int lineno;                    // line being scanned, or replayed
+  unsigned int scanErrorCount;   // errors detected by the scanner
+  void *intern;                  // identifiers, interned (intern.h)
+  FILE *scanFile;                // input when read with stdio
+  int scanFd;                    // input when streamed from a descriptor
+  char *mappedBuf;               // input when memory mapped
+  size_t mappedLen;
+  const char *scanText;          // input when it is all in memory
+  size_t scanLength;
+
+  // parser state (parse.y)
+  unsigned int parseErrorCount;  // errors detected by the parser
+
+  // where messages (message.c) and the symbol listing are written
+  FILE *errfp;
+  FILE *listfp;
+
+  // assembler state (assemble.c)
+  int pc;                        // pc counter for the first pass
+  int pc2;                       // pc counter for the second pass
+  void *symtab;                  // symbol table
+  int error_count;               // errors detected by the assembler
+  int bad_operand;               // # of ERROR_OPERAND_FORMAT
+  int constant_unfit;            // # of ERROR_CONSTANT_INVALID
+  int unknown_opcode;            // # of ERROR_OPCODE_UNKOWN
+  int pass_counter;              // 1 on the first pass, 2 on the second
+  asx20_obj *obj;                // image being built
+  int code_capacity;             // words allocated for obj->code
+  unsigned int options;          // ASX20_ flags, kept across resets
+  int threads;                   // for the front end and second pass of a
+                                 //   large input, 0 for auto; kept too
+  int bss_words;                 // words reserved by alloc with ASX20_BSS
+  int bss_allocs;                // and the number of allocs reserving them
+  int bss_capacity;              // entries allocated for obj->bss
+  int code_fixed;                // obj->code is part of another image
+  struct ir_record *records;     // lines packed by the first pass
+  int record_count;
+  int record_capacity;
+  struct ir_checkpoint *checkpoints; // pc every few thousand records
+  int checkpoint_capacity;
+  struct symbol_ref *symbols_by_id; // symbols by intern ID of their name
+  int symbol_id_count;
+
+} AsmContext;
+
 ////////////////////////////////////////////////////////////////////////////
 // guts of the assembler (assemble.c)
 
-// called once at startup to initialize the assembler
-extern void initAssemble(void);
+// called to create a context for an assembly
+//   messages go to stderr and the symbol listing to stdout until the
+//   caller changes errfp and listfp
+extern AsmContext *createAssembler(void);
+
+// called to make a context ready for another input
+//   errfp and listfp are kept
+extern void resetAssembler(AsmContext *);
+
+// called to release a context and everything it owns
+extern void deleteAssembler(AsmContext *);
 
 // called to process one line of input
-//   called on each pass
-extern void assemble(char *, INSTR);
+//   called on the first pass
+extern void assemble(AsmContext *, char *, INSTR);
 
 // called between passes
+//   fills in the header, export and import tables of the image, and
+//   makes room for its code
 //   returns number of errors detected during the first pass
-extern int betweenPasses(FILE *);
+extern int betweenPasses(AsmContext *, asx20_obj *);
+
+// called to run the second pass
+//   encodes the records packed during the first pass, so the input
+//   is only read and parsed once
+extern void secondPass(AsmContext *);
 
 ////////////////////////////////////////////////////////////////////////////
-// error message routines (error.c)
+// scanner (scan.l)
+
+// called to make a copy of a buffer the input for the context's scanner
+//   returns 0 on success
+extern int scanOpenBuffer(AsmContext *, const char *, size_t);
+
+// called to open the input file for the context's scanner
+//   the file is memory mapped when possible; if the third argument is
+//   non-zero it is always read with stdio
+//   returns 0 on success, -1 if the file can't be opened
+extern int scanOpen(AsmContext *, const char *, int);
+
+// called to make an open descriptor the input for the context's scanner
+//   it is read as data arrives, and is left open by scanClose
+extern void scanOpenFd(AsmContext *, int);
+
+// called after the first pass to release the scanner and its input
+extern void scanClose(AsmContext *);
+
+// called to convert an integer constant as the scanner does
+//   reports constants that don't fit in an int, and returns 1 for them
+extern int scanConstant(AsmContext *, char *);
+
+////////////////////////////////////////////////////////////////////////////
+// parser (parse.y)
+
+// called to drive the first pass over the input opened by scanOpen
+//   returns 0 if the whole input was parsed
+extern int parseInput(AsmContext *);
+
+////////////////////////////////////////////////////////////////////////////
+// hand-written front end (fastscan.c)
+
+// called instead of parseInput, with ASX20_FASTSCAN, when the whole
+// input is in memory (scanText)
+//   hands assemble the same lines, and reports the same errors at the
+//   same lines, as the flex scanner and bison parser
+//   a large input is split into chunks that are parsed on several threads
+//   returns 0 if the whole input was parsed
+extern int fastParse(AsmContext *);
+
+////////////////////////////////////////////////////////////////////////////
+// error message routines (message.c)
+//
+// each prints to the context's errfp with its current line number; the
+// context may be NULL, in which case stderr is used with no line number
 
 // called when some resource is fully depleted
-extern void fatal(char *fmt, ...);
+extern void fatal(AsmContext *, char *fmt, ...);
 
 // called when there is an internal, unexpected problem
-extern void bug(char *fmt, ...);
+extern void bug(AsmContext *, char *fmt, ...);
 
 // called for user semantic error
-extern void error(char *fmt, ...);
+extern void error(AsmContext *, char *fmt, ...);
 
 // called for user syntax error
-extern void parseError(char *fmt, ...);
+extern void parseError(AsmContext *, char *fmt, ...);
 
+#endif
@@ -0,0 +1,1128 @@
+//
+// fastscan.c - hand-written front end for asx20 assembler
+//
+//              a line of assembler is an optional label, an opcode and at
+//              most three operands, which this scans and parses in one go
+//              straight out of the input buffer, rather than through the
+//              flex DFA and the bison stack. runs of letters and digits,
+//              and of blanks, are measured 16 bytes at a time with SSE2,
+//              and comments are skipped with memchr.
+//
+//              it is a drop-in for scan.l and parse.y: assemble is handed
+//              the same lines, and the same errors are reported at the
+//              same line numbers, including the errors bison keeps quiet
+//              while it is recovering from the last one.
+//
+//              a large input is split at newlines into chunks, and all but
+//              the first are parsed on threads of their own into lists of
+//              lines, while the first is parsed into assemble. the lists
+//              are then handed to assemble in order, with their messages,
+//              so the first pass sees just what it would from one thread.
+//
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include "defs.h"
+#include "intern.h"
+
+enum tokenKind
+{
+  T_EOF,                         // end of input, or a byte flex ends it at
+  T_EOL,                         // newline, or comment and newline
+  T_ID,
+  T_OPCODE,
+  T_REG,
+  T_INT,
+  T_COLON,
+  T_COMMA,
+  T_LPAREN,
+  T_RPAREN,
+  T_OTHER                        // any other character
+};
+
+struct token
+{
+  enum tokenKind kind;
+  char *str;                     // interned name of a T_ID
+  int value;                     // opcode, register or constant
+};
+
+struct fastScanner
+{
+  AsmContext *ctx;
+  const char *next;              // next character to scan
+  const char *end;
+  int stopped;                   // at a byte that ends the input
+};
+
+// a large input is only split when each thread would have this much
+// of it, and never between more than PARSE_MAX_THREADS
+#define PARSE_MIN_BYTES (1 << 20)
+#define PARSE_MAX_THREADS 16
+
+// a line parsed on a thread of its own, to be handed to assemble later
+struct parsedLine
+{
+  char *label;
+  INSTR instr;
+  int lineno;                    // context line number for assemble
+  int messages;                  // messages of the chunk before it
+};
+
+// one parse of the input from start to end
+struct parseRun
+{
+  const char *start;
+  const char *end;
+  int statements;                // statements before start
+  int errStatus;                 // tokens bison shifts before reporting
+                                 //   another error, at start and at end
+  int shifted;                   // tokens shifted
+  int firstError;                // tokens shifted before the first
+                                 //   syntax error, -1 if there is none
+  int stopped;                   // ended at a byte that ends the input
+  struct parseChunk *chunk;      // where lines go, NULL for assemble
+};
+
+// a chunk of the input parsed on its own thread, with a copy of the
+// context that has its own intern table and collects its messages
+struct parseChunk
+{
+  AsmContext ctx;
+  struct parseRun run;
+  int result;                    // what parseRun returned
+  int newlines;                  // newlines in the chunk
+  int lineno;                    // context line number at its start
+  struct parsedLine *lines;
+  int count;
+  int capacity;
+  char *text;                    // messages
+  size_t textLength;
+  pthread_t thread;
+};
+
+// where the parser is in a line; each state is named for what it has
+// seen since the label, if any
+enum parseState
+{
+  P_START,                       // nothing yet
+  P_NAME,                        // a name, which is a label or an opcode
+  P_LABEL,                       // a label
+  P_OPCODE,                      // an opcode
+  P_END,                         // a complete instruction that can't grow
+  P_REG,                         // opcode REG
+  P_REG_COMMA,                   // opcode REG ,
+  P_REG_INT,                     // opcode REG , INT
+  P_LPAREN,                      // opcode REG , INT (
+  P_LPAREN_REG,                  // opcode REG , INT ( REG
+  P_REG_REG,                     // opcode REG , REG
+  P_REG_REG_COMMA,               // opcode REG , REG ,
+  P_ERROR
+};
+
+// forward references
+static int parseRun(AsmContext *, struct parseRun *);
+static void emitLine(AsmContext *, struct parseRun *, char *, INSTR);
+static int parseChunks(AsmContext *, int);
+static void *countChunk(void *);
+static void *parseChunk(void *);
+static void replayChunk(AsmContext *, struct parseChunk *);
+static char *globalName(AsmContext *, const char **, char *);
+static int parseThreadCount(AsmContext *);
+static void nextToken(struct fastScanner *, struct token *);
+static enum parseState shift(AsmContext *, enum parseState, struct token *,
+  INSTR *, char **);
+static char *nameOf(AsmContext *, struct token *);
+static char *opcodeName(AsmContext *, int);
+static void clearInstr(INSTR *);
+static void setOpcode(INSTR *, struct token *);
+static int scanNumber(struct fastScanner *, const char *, const char *);
+static int isHexDigit(int);
+static size_t spanWord(const char *, const char *);
+static size_t spanBlanks(const char *, const char *);
+
+// fastParse
+//
+// parse the whole of the context's scanText, calling assemble for each
+// line with a label or an instruction
+//
+// returns 0 if the whole input was parsed
+//
+int fastParse(AsmContext *ctx)
+{
+  struct parseRun run;
+  int threads;
+
+  threads = parseThreadCount(ctx);
+  if (threads > 1)
+  {
+    return parseChunks(ctx, threads);
+  }
+
+  memset(&run, 0, sizeof(run));
+  run.start = ctx->scanText;
+  run.end = ctx->scanText + ctx->scanLength;
+  return parseRun(ctx, &run);
+}
+
+// parseRun
+//
+// parse the input from run->start to run->end, handing each line with a
+// label or an instruction to emitLine
+//
+// after a syntax error the rest of the line is skipped, as the "error
+// EOL" rule of parse.y does. bison says nothing of another error until
+// it has shifted three tokens since the last; errStatus counts them the
+// same way, so that the same errors are reported.
+//
+// returns 0 if the input was parsed to run->end
+//
+static
+int parseRun(AsmContext *ctx, struct parseRun *run)
+{
+  struct fastScanner scanner;
+  struct token token;
+  enum parseState state;
+  INSTR instr;
+  char *label;
+
+  scanner.ctx = ctx;
+  scanner.next = run->start;
+  scanner.end = run->end;
+  scanner.stopped = 0;
+
+  run->shifted = 0;
+  run->firstError = -1;
+  state = P_START;
+  label = NULL;
+  clearInstr(&instr);
+
+  for (;;)
+  {
+    nextToken(&scanner, &token);
+    run->stopped = scanner.stopped;
+
+    // the grammar wants at least one statement
+    if (token.kind == T_EOF && state == P_START && run->statements > 0)
+    {
+      return 0;
+    }
+
+    state = shift(ctx, state, &token, &instr, &label);
+
+    if (state == P_ERROR)
+    {
+      if (run->firstError < 0)
+      {
+        run->firstError = run->shifted;
+      }
+      if (run->errStatus == 0)
+      {
+        ctx->parseErrorCount += 1;
+        parseError(ctx, "syntax error");
+      }
+      while (token.kind != T_EOL)
+      {
+        if (token.kind == T_EOF)
+        {
+          run->stopped = scanner.stopped;
+          return 1;
+        }
+        nextToken(&scanner, &token);
+      }
+
+      // bison shifts the error token, which starts the count at three,
+      // then the newline
+      run->errStatus = 2;
+    }
+    else
+    {
+      run->shifted++;
+      if (run->errStatus > 0)
+      {
+        run->errStatus--;
+      }
+    }
+
+    if (token.kind == T_EOL)
+    {
+      if (state != P_ERROR && (label != NULL || instr.format != 0))
+      {
+        emitLine(ctx, run, label, instr);
+      }
+      run->statements++;
+      state = P_START;
+      label = NULL;
+      clearInstr(&instr);
+    }
+  }
+}
+
+// emitLine
+//
+// hand a line to assemble, or keep it for later if the run is a chunk
+// on a thread of its own
+//
+static
+void emitLine(AsmContext *ctx, struct parseRun *run, char *label, INSTR instr)
+{
+  struct parseChunk *chunk = run->chunk;
+  struct parsedLine *line;
+
+  if (chunk == NULL)
+  {
+    assemble(ctx, label, instr);
+    return;
+  }
+
+  if (chunk->count == chunk->capacity)
+  {
+    int capacity = chunk->capacity ? chunk->capacity * 2 : 4096;
+    line = realloc(chunk->lines, capacity * sizeof(*line));
+    if (line == NULL)
+    {
+      fatal(ctx, "out of memory in emitLine");
+    }
+    chunk->lines = line;
+    chunk->capacity = capacity;
+  }
+
+  line = &chunk->lines[chunk->count++];
+  line->label = label;
+  line->instr = instr;
+  line->lineno = ctx->lineno;
+  line->messages = ctx->scanErrorCount + ctx->parseErrorCount;
+}
+
+// parseChunks
+//
+// parse the context's scanText in up to the given number of chunks,
+// split after a newline, so the chunks are whole lines and each starts
+// where a statement can
+//
+// the newlines in each chunk are counted first, on their threads, so
+// that each chunk's context knows the number of its first line. the
+// first chunk is then parsed into assemble on this thread while the
+// others are parsed on theirs, and each is handed to assemble as soon
+// as it and those before it are done.
+//
+// a chunk is parsed as if no error came just before it. when one did,
+// and bison would still have been recovering from it at the chunk's
+// first error, the chunk is parsed again here with the right count.
+// a chunk that ends the input early ends the parse, and those after it
+// are thrown away.
+//
+// returns 0 if the whole input was parsed
+//
+static
+int parseChunks(AsmContext *ctx, int threads)
+{
+  struct parseChunk *chunks;
+  const char *text = ctx->scanText;
+  const char *end = ctx->scanText + ctx->scanLength;
+  const char *start;
+  int lineno;
+  int result;
+  int count;
+  int i;
+
+  chunks = calloc(threads, sizeof(*chunks));
+  if (chunks == NULL)
+  {
+    fatal(ctx, "out of memory in parseChunks");
+  }
+
+  count = 0;
+  start = text;
+  for (i = 1; i <= threads && start < end; i++)
+  {
+    const char *split = end;
+
+    if (i < threads)
+    {
+      split = text + (size_t) ((double) ctx->scanLength * i / threads);
+      if (split < start)
+      {
+        split = start;
+      }
+      split = memchr(split, '\n', end - split);
+      split = split != NULL ? split + 1 : end;
+    }
+    if (split > start)
+    {
+      chunks[count].run.start = start;
+      chunks[count].run.end = split;
+      count++;
+      start = split;
+    }
+  }
+
+  if (count == 1)
+  {
+    result = parseRun(ctx, &chunks[0].run);
+    free(chunks);
+    return result;
+  }
+
+  // count the newlines to number the lines of each chunk
+  for (i = 1; i < count; i++)
+  {
+    if (pthread_create(&chunks[i].thread, NULL, countChunk, &chunks[i]))
+    {
+      fatal(ctx, "can't create thread in parseChunks");
+    }
+  }
+  countChunk(&chunks[0]);
+
+  lineno = ctx->lineno + chunks[0].newlines;
+  for (i = 1; i < count; i++)
+  {
+    struct parseChunk *chunk = &chunks[i];
+
+    pthread_join(chunk->thread, NULL);
+
+    chunk->lineno = lineno;
+    chunk->ctx = *ctx;
+    chunk->ctx.lineno = lineno;
+    chunk->ctx.scanErrorCount = 0;
+    chunk->ctx.parseErrorCount = 0;
+    chunk->ctx.intern = internCreate();
+    chunk->ctx.errfp = open_memstream(&chunk->text, &chunk->textLength);
+    if (chunk->ctx.intern == NULL || chunk->ctx.errfp == NULL)
+    {
+      fatal(ctx, "can't set up chunk in parseChunks");
+    }
+    chunk->run.statements = 1;
+    chunk->run.chunk = chunk;
+
+    // at most one line per newline, and one after the last
+    chunk->capacity = chunk->newlines + 1;
+    chunk->lines = malloc(chunk->capacity * sizeof(*chunk->lines));
+    if (chunk->lines == NULL)
+    {
+      fatal(ctx, "out of memory in parseChunks");
+    }
+    lineno += chunk->newlines;
+
+    if (pthread_create(&chunk->thread, NULL, parseChunk, chunk))
+    {
+      fatal(ctx, "can't create thread in parseChunks");
+    }
+  }
+
+  result = parseRun(ctx, &chunks[0].run);
+
+  for (i = 1; i < count; i++)
+  {
+    struct parseChunk *chunk = &chunks[i];
+    struct parseRun *last = &chunks[i - 1].run;
+    int errStatus = last->errStatus;
+
+    pthread_join(chunk->thread, NULL);
+
+    if (!last->stopped)
+    {
+      if (chunk->run.firstError >= 0 && chunk->run.firstError < errStatus)
+      {
+        // the chunk's first error is one bison keeps quiet
+        ctx->lineno = chunk->lineno;
+        chunk->run.errStatus = errStatus;
+        chunk->run.chunk = NULL;
+        result = parseRun(ctx, &chunk->run);
+      }
+      else
+      {
+        replayChunk(ctx, chunk);
+        result = chunk->result;
+        if (chunk->run.firstError < 0)
+        {
+          chunk->run.errStatus = errStatus > chunk->run.shifted ?
+            errStatus - chunk->run.shifted : 0;
+        }
+      }
+    }
+    else
+    {
+      chunk->run.stopped = 1;
+    }
+
+    free(chunk->lines);
+    free(chunk->text);
+    internDelete(chunk->ctx.intern);
+  }
+
+  free(chunks);
+  return result;
+}
+
+// countChunk
+//
+// thread body that counts the newlines of a chunk
+//
+static
+void *countChunk(void *arg)
+{
+  struct parseChunk *chunk = arg;
+  const char *p = chunk->run.start;
+  const char *end = chunk->run.end;
+  int newlines = 0;
+
+#ifdef __SSE2__
+  while (end - p >= 16)
+  {
+    __m128i c = _mm_loadu_si128((const __m128i *) p);
+    __m128i eol = _mm_cmpeq_epi8(c, _mm_set1_epi8('\n'));
+
+    newlines += __builtin_popcount(_mm_movemask_epi8(eol));
+    p += 16;
+  }
+#endif
+  for (; p < end; p++)
+  {
+    newlines += *p == '\n';
+  }
+  chunk->newlines = newlines;
+  return NULL;
+}
+
+// parseChunk
+//
+// thread body that parses a chunk into its list of lines
+//
+static
+void *parseChunk(void *arg)
+{
+  struct parseChunk *chunk = arg;
+
+  chunk->result = parseRun(&chunk->ctx, &chunk->run);
+  fclose(chunk->ctx.errfp);
+  return NULL;
+}
+
+// replayChunk
+//
+// hand the lines of a parsed chunk to assemble, with its messages in
+// between them where they came, and its names made those of the
+// context's intern table
+//
+static
+void replayChunk(AsmContext *ctx, struct parseChunk *chunk)
+{
+  const char **names;
+  const char *text = chunk->text;
+  int messages = 0;
+  int i;
+
+  names = calloc(internCount(chunk->ctx.intern) + 1, sizeof(*names));
+  if (names == NULL)
+  {
+    fatal(ctx, "out of memory in replayChunk");
+  }
+
+  for (i = 0; i <= chunk->count; i++)
+  {
+    int before = chunk->ctx.scanErrorCount + chunk->ctx.parseErrorCount;
+
+    // the messages before this line, or at the end those after the last
+    if (i < chunk->count)
+    {
+      before = chunk->lines[i].messages;
+    }
+    for (; messages < before; messages++)
+    {
+      const char *eol = strchr(text, '\n');
+      fwrite(text, 1, eol + 1 - text, ctx->errfp);
+      text = eol + 1;
+    }
+
+    if (i < chunk->count)
+    {
+      struct parsedLine *line = &chunk->lines[i];
+      INSTR instr = line->instr;
+
+      instr.mnemonic = globalName(ctx, names, instr.mnemonic);
+      switch (instr.format)
+      {
+        case 2:
+          instr.u.format2.addr = globalName(ctx, names, instr.u.format2.addr);
+          break;
+        case 5:
+          instr.u.format5.addr = globalName(ctx, names, instr.u.format5.addr);
+          break;
+        case 8:
+          instr.u.format8.addr = globalName(ctx, names, instr.u.format8.addr);
+          break;
+      }
+      ctx->lineno = line->lineno;
+      assemble(ctx, globalName(ctx, names, line->label), instr);
+    }
+  }
+
+  free(names);
+  ctx->lineno = chunk->ctx.lineno;
+  ctx->scanErrorCount += chunk->ctx.scanErrorCount;
+  ctx->parseErrorCount += chunk->ctx.parseErrorCount;
+}
+
+// globalName
+//
+// the context's interned string for a name interned in a chunk's table,
+// or NULL for NULL; names holds those found so far, by the chunk's ID
+//
+static
+char *globalName(AsmContext *ctx, const char **names, char *name)
+{
+  int id;
+
+  if (name == NULL)
+  {
+    return NULL;
+  }
+
+  id = internId(name);
+  if (names[id] == NULL)
+  {
+    names[id] = internString(ctx->intern, name, internLength(name));
+    if (names[id] == NULL)
+    {
+      fatal(ctx, "out of memory in globalName");
+    }
+  }
+  return (char *) names[id];
+}
+
+// parseThreadCount
+//
+// the number of threads to parse the context's input on: the context's
+// threads if it is set, otherwise one per online CPU, but never so many
+// that a thread gets less than PARSE_MIN_BYTES
+//
+static
+int parseThreadCount(AsmContext *ctx)
+{
+  int threads = ctx->threads;
+
+  if (threads <= 0)
+  {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    threads = cpus > 0 ? (int) cpus : 1;
+    if ((size_t) threads > ctx->scanLength / PARSE_MIN_BYTES)
+    {
+      threads = (int) (ctx->scanLength / PARSE_MIN_BYTES);
+    }
+  }
+  if (threads > PARSE_MAX_THREADS)
+  {
+    threads = PARSE_MAX_THREADS;
+  }
+  return threads;
+}
+
+// shift
+//
+// take one more token of the line in the given state, filling in the
+// instruction and the label as they become known
+//
+// returns the new state, P_ERROR if the token can't come next
+//
+static
+enum parseState shift(AsmContext *ctx, enum parseState state,
+  struct token *token, INSTR *instr, char **label)
+{
+  enum tokenKind kind = token->kind;
+  int name = kind == T_ID || kind == T_OPCODE;
+
+  switch (state)
+  {
+    case P_START:
+      if (kind == T_EOL)
+      {
+        return P_START;
+      }
+      if (name)
+      {
+        setOpcode(instr, token);
+        return P_NAME;
+      }
+      return P_ERROR;
+
+    case P_NAME:
+      if (kind == T_COLON)
+      {
+        // it was a label after all
+        *label = instr->opcode == OPCODE_UNKNOWN ? instr->mnemonic :
+          opcodeName(ctx, instr->opcode);
+        clearInstr(instr);
+        return P_LABEL;
+      }
+      return shift(ctx, P_OPCODE, token, instr, label);
+
+    case P_LABEL:
+      if (kind == T_EOL)
+      {
+        return P_START;
+      }
+      if (name)
+      {
+        setOpcode(instr, token);
+        return P_OPCODE;
+      }
+      return P_ERROR;
+
+    case P_OPCODE:
+      if (kind == T_EOL)
+      {
+        instr->format = 1;
+        return P_START;
+      }
+      if (name)
+      {
+        instr->format = 2;
+        instr->u.format2.addr = nameOf(ctx, token);
+        return P_END;
+      }
+      if (kind == T_REG)
+      {
+        instr->format = 3;
+        instr->u.format3.reg = token->value;
+        return P_REG;
+      }
+      if (kind == T_INT)
+      {
+        instr->format = 9;
+        instr->u.format9.constant = token->value;
+        return P_END;
+      }
+      return P_ERROR;
+
+    case P_END:
+      return kind == T_EOL ? P_START : P_ERROR;
+
+    case P_REG:
+      if (kind == T_EOL)
+      {
+        return P_START;
+      }
+      return kind == T_COMMA ? P_REG_COMMA : P_ERROR;
+
+    case P_REG_COMMA:
+      if (kind == T_INT)
+      {
+        // format 4, unless it turns out to be an offset
+        unsigned int reg = instr->u.format3.reg;
+        instr->format = 4;
+        instr->u.format4.reg = reg;
+        instr->u.format4.constant = token->value;
+        return P_REG_INT;
+      }
+      if (name)
+      {
+        unsigned int reg = instr->u.format3.reg;
+        instr->format = 5;
+        instr->u.format5.reg = reg;
+        instr->u.format5.addr = nameOf(ctx, token);
+        return P_END;
+      }
+      if (kind == T_REG)
+      {
+        unsigned int reg = instr->u.format3.reg;
+        instr->format = 6;
+        instr->u.format6.reg1 = reg;
+        instr->u.format6.reg2 = token->value;
+        return P_REG_REG;
+      }
+      return P_ERROR;
+
+    case P_REG_INT:
+      if (kind == T_EOL)
+      {
+        return P_START;
+      }
+      return kind == T_LPAREN ? P_LPAREN : P_ERROR;
+
+    case P_LPAREN:
+      if (kind == T_REG)
+      {
+        unsigned int reg = instr->u.format4.reg;
+        int offset = instr->u.format4.constant;
+        instr->format = 7;
+        instr->u.format7.reg1 = reg;
+        instr->u.format7.offset = offset;
+        instr->u.format7.reg2 = token->value;
+        return P_LPAREN_REG;
+      }
+      return P_ERROR;
+
+    case P_LPAREN_REG:
+      return kind == T_RPAREN ? P_END : P_ERROR;
+
+    case P_REG_REG:
+      if (kind == T_EOL)
+      {
+        return P_START;
+      }
+      return kind == T_COMMA ? P_REG_REG_COMMA : P_ERROR;
+
+    case P_REG_REG_COMMA:
+      if (name)
+      {
+        unsigned int reg1 = instr->u.format6.reg1;
+        unsigned int reg2 = instr->u.format6.reg2;
+        instr->format = 8;
+        instr->u.format8.reg1 = reg1;
+        instr->u.format8.reg2 = reg2;
+        instr->u.format8.addr = nameOf(ctx, token);
+        return P_END;
+      }
+      return P_ERROR;
+
+    case P_ERROR:
+      break;
+  }
+
+  bug(ctx, "fastParse reaches end of shift");
+  return P_ERROR;
+}
+
+// clearInstr
+//
+// make the instruction that of a line with no instruction, as the parser
+// does for a line with only a label
+//
+static
+void clearInstr(INSTR *instr)
+{
+  memset(instr, 0, sizeof(*instr));
+  instr->opcode = OPCODE_NONE;
+}
+
+// setOpcode
+//
+// make a name the opcode of the instruction; the scanner has already
+// found it in the opcode table if it is there
+//
+static
+void setOpcode(INSTR *instr, struct token *token)
+{
+  if (token->kind == T_OPCODE)
+  {
+    instr->opcode = token->value;
+    instr->mnemonic = NULL;
+  }
+  else
+  {
+    instr->opcode = OPCODE_UNKNOWN;
+    instr->mnemonic = token->str;
+  }
+}
+
+// nameOf
+//
+// the interned string for a name, which is spelled like an opcode when
+// the scanner found it in the opcode table
+//
+static
+char *nameOf(AsmContext *ctx, struct token *token)
+{
+  return token->kind == T_ID ? token->str : opcodeName(ctx, token->value);
+}
+
+// opcodeName
+//
+// the interned name of an opcode used as a label
+//
+static
+char *opcodeName(AsmContext *ctx, int op)
+{
+  const char *mnemonic = opcodeTable[op].mnemonic;
+  const char *p;
+
+  p = internString(ctx->intern, mnemonic, strlen(mnemonic));
+  if (p == NULL)
+  {
+    fatal(ctx, "out of memory in opcodeName");
+  }
+  return (char *) p;
+}
+
+// nextToken
+//
+// scan the next token, matching what the rules of scan.l would
+//
+static
+void nextToken(struct fastScanner *scanner, struct token *token)
+{
+  AsmContext *ctx = scanner->ctx;
+  const char *p = scanner->next;
+  const char *end = scanner->end;
+  unsigned char c;
+  size_t n;
+
+  p += spanBlanks(p, end);
+  if (p == end)
+  {
+    scanner->next = p;
+    token->kind = T_EOF;
+    return;
+  }
+
+  c = *p;
+
+  // identifiers, which may be registers or opcodes
+  if ((unsigned char) ((c | 0x20) - 'a') < 26)
+  {
+    n = spanWord(p, end);
+    scanner->next = p + n;
+
+    if ((n == 2 && ((c == 'r' && p[1] >= '0' && p[1] <= '9') ||
+                    (c == 'f' && p[1] == 'p') ||
+                    (c == 's' && p[1] == 'p') ||
+                    (c == 'p' && p[1] == 'c'))) ||
+        (n == 3 && c == 'r' && p[1] == '1' && p[2] >= '0' && p[2] <= '5'))
+    {
+      token->kind = T_REG;
+      token->value = c == 'f' ? 13 : c == 's' ? 14 : c == 'p' ? 15 :
+                     n == 2 ? p[1] - '0' : p[2] - '0' + 10;
+      return;
+    }
+
+    token->value = opcodeLookup(p, n);
+    if (token->value != OPCODE_UNKNOWN)
+    {
+      token->kind = T_OPCODE;
+      return;
+    }
+
+    token->kind = T_ID;
+    token->str = (char *) internString(ctx->intern, p, n);
+    if (token->str == NULL)
+    {
+      fatal(ctx, "out of memory in nextToken");
+    }
+    return;
+  }
+
+  // integer constants: decimal, negative decimal and hex
+  if ((unsigned char) (c - '0') < 10 ||
+      (c == '-' && end - p > 1 && (unsigned char) (p[1] - '0') < 10))
+  {
+    const char *q = p + (c == '-');
+    const char *h = p + 2;
+
+    // 0x, maybe a minus sign, and at least one hex digit
+    if (c == '0' && end - p > 2 && p[1] == 'x')
+    {
+      if (*h == '-' && end - h > 1)
+      {
+        h++;
+      }
+      if (isHexDigit(*h))
+      {
+        while (h < end && isHexDigit(*h))
+        {
+          h++;
+        }
+        token->kind = T_INT;
+        token->value = scanNumber(scanner, p, h);
+        return;
+      }
+    }
+    while (q < end && (unsigned char) (*q - '0') < 10)
+    {
+      q++;
+    }
+    token->kind = T_INT;
+    token->value = scanNumber(scanner, p, q);
+    return;
+  }
+
+  scanner->next = p + 1;
+  switch (c)
+  {
+    case '\n':
+      ctx->lineno++;
+      token->kind = T_EOL;
+      return;
+
+    case '#':
+      // a comment only ends with a newline; without one the # is just
+      // another character
+      p = memchr(p, '\n', end - p);
+      if (p != NULL)
+      {
+        scanner->next = p + 1;
+        ctx->lineno++;
+        token->kind = T_EOL;
+        return;
+      }
+      token->kind = T_OTHER;
+      return;
+
+    case ',':
+      token->kind = T_COMMA;
+      return;
+
+    case ':':
+      token->kind = T_COLON;
+      return;
+
+    case '(':
+      token->kind = T_LPAREN;
+      return;
+
+    case ')':
+      token->kind = T_RPAREN;
+      return;
+
+    default:
+      // flex hands back any other character as a token of its own, and
+      // bison takes a NUL, or a byte that is negative as a char, to be
+      // the end of the input
+      if (c == '\0' || c >= 0x80)
+      {
+        scanner->next = end;
+        scanner->stopped = 1;
+        token->kind = T_EOF;
+        return;
+      }
+      token->kind = T_OTHER;
+      return;
+  }
+}
+
+// scanNumber
+//
+// convert the constant from p to end, and move the scanner past it
+//
+static
+int scanNumber(struct fastScanner *scanner, const char *p, const char *end)
+{
+  char buf[64];
+  char *text = buf;
+  size_t n = end - p;
+  int value;
+
+  scanner->next = end;
+
+  // nine digits or fewer always fit in an int, so there is nothing for
+  // scanConstant to report
+  if (n <= 10 && !(n > 1 && p[1] == 'x'))
+  {
+    const char *q = p + (*p == '-');
+    if (end - q <= 9)
+    {
+      value = 0;
+      for (; q < end; q++)
+      {
+        value = value * 10 + (*q - '0');
+      }
+      return *p == '-' ? -value : value;
+    }
+  }
+
+  // scanConstant wants a string, as flex gives it
+  if (n >= sizeof(buf) && (text = malloc(n + 1)) == NULL)
+  {
+    fatal(scanner->ctx, "out of memory in scanNumber");
+  }
+  memcpy(text, p, n);
+  text[n] = '\0';
+  value = scanConstant(scanner->ctx, text);
+  if (text != buf)
+  {
+    free(text);
+  }
+  return value;
+}
+
+// isHexDigit
+//
+static
+int isHexDigit(int c)
+{
+  return (unsigned char) (c - '0') < 10 || (unsigned char) ((c | 0x20) - 'a') < 6;
+}
+
+#ifdef __SSE2__
+// the bytes of c that are from lo to hi, as 0xFF, and the rest as 0
+static inline __m128i inRange(__m128i c, char lo, char hi)
+{
+  __m128i d = _mm_sub_epi8(c, _mm_set1_epi8(lo));
+  return _mm_cmpeq_epi8(_mm_min_epu8(d, _mm_set1_epi8(hi - lo)), d);
+}
+#endif
+
+// spanWord
+//
+// the number of letters and digits from p
+//
+static
+size_t spanWord(const char *p, const char *end)
+{
+  const char *q = p;
+
+#ifdef __SSE2__
+  while (end - q >= 16)
+  {
+    __m128i c = _mm_loadu_si128((const __m128i *) q);
+    __m128i lower = _mm_or_si128(c, _mm_set1_epi8(0x20));
+    __m128i word = _mm_or_si128(inRange(lower, 'a', 'z'),
+                                inRange(c, '0', '9'));
+    unsigned int mask = ~_mm_movemask_epi8(word) & 0xFFFF;
+
+    if (mask)
+    {
+      return q - p + __builtin_ctz(mask);
+    }
+    q += 16;
+  }
+#endif
+  while (q < end && ((unsigned char) ((*q | 0x20) - 'a') < 26 ||
+                     (unsigned char) (*q - '0') < 10))
+  {
+    q++;
+  }
+  return q - p;
+}
+
+// spanBlanks
+//
+// the number of spaces and tabs from p
+//
+static
+size_t spanBlanks(const char *p, const char *end)
+{
+  const char *q = p;
+
+  // most tokens are followed by one blank, or none
+  if (q < end && *q != ' ' && *q != '\t')
+  {
+    return 0;
+  }
+
+#ifdef __SSE2__
+  while (end - q >= 16)
+  {
+    __m128i c = _mm_loadu_si128((const __m128i *) q);
+    __m128i blank = _mm_or_si128(_mm_cmpeq_epi8(c, _mm_set1_epi8(' ')),
+                                 _mm_cmpeq_epi8(c, _mm_set1_epi8('\t')));
+    unsigned int mask = ~_mm_movemask_epi8(blank) & 0xFFFF;
+
+    if (mask)
+    {
+      return q - p + __builtin_ctz(mask);
+    }
+    q += 16;
+  }
+#endif
+  while (q < end && (*q == ' ' || *q == '\t'))
+  {
+    q++;
+  }
+  return q - p;
+}
@@ -0,0 +1,240 @@
+#include "intern.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+// Each string is kept in the arena after a small header, and the
+// pointer handed out is to its characters, so the header can be found
+// from the pointer alone
+typedef struct entry {
+  uint32_t id;
+  uint32_t length;
+  uint32_t hash;
+  char str[]; // Null terminated
+} entry_t;
+
+// The arena is a list of blocks that strings are bumped out of
+typedef struct block {
+  struct block *next;
+  size_t size; // Bytes in data
+  char data[];
+} block_t;
+
+// Open addressed hash table of the interned strings
+typedef struct slot {
+  entry_t *entry; // NULL if empty
+  uint32_t hash;
+} slot_t;
+
+typedef struct table {
+  slot_t *slots;
+  uint32_t mask; // Number of slots - 1 (a power of 2)
+  uint32_t count; // Strings interned
+  block_t *blocks; // Newest block first
+  char *next; // Free space in the newest block
+  char *end;
+} table_t;
+
+// Sizes the table starts with
+#define INITIAL_SLOTS 256
+#define INITIAL_BLOCK 16384
+
+// Entries are kept aligned for their header
+#define ENTRY_ALIGN sizeof(uint32_t)
+
+
+//---------------PROTOTYPES---------------
+
+// Hash function
+static uint32_t hash(const char *s, size_t len);
+
+// Make room in the arena for an entry
+static entry_t *arena_alloc(table_t *table, size_t len);
+
+// Double the number of slots
+static int grow_slots(table_t *table);
+
+
+//---------------FUNCTIONS---------------
+
+void *internCreate(void) {
+
+  table_t *table = calloc(1, sizeof(table_t));
+  if(table == NULL) {
+    return NULL;
+  }
+
+  table->slots = calloc(INITIAL_SLOTS, sizeof(slot_t));
+  if(table->slots == NULL) {
+    free(table);
+    return NULL;
+  }
+  table->mask = INITIAL_SLOTS - 1;
+
+  return table;
+}
+
+void internDelete(void *internHandle) {
+
+  table_t *table = internHandle;
+
+  block_t *block = table->blocks;
+  while(block != NULL) {
+    block_t *next = block->next;
+    free(block);
+    block = next;
+  }
+
+  free(table->slots);
+  free(table);
+}
+
+void internClear(void *internHandle) {
+
+  table_t *table = internHandle;
+
+  // Keep the newest block, which is the largest, for the next strings
+  if(table->blocks != NULL) {
+    block_t *block = table->blocks->next;
+    while(block != NULL) {
+      block_t *next = block->next;
+      free(block);
+      block = next;
+    }
+    table->blocks->next = NULL;
+    table->next = table->blocks->data;
+    table->end = table->blocks->data + table->blocks->size;
+  }
+
+  memset(table->slots, 0, (table->mask + 1) * sizeof(slot_t));
+  table->count = 0;
+}
+
+const char *internString(void *internHandle, const char *s, size_t len) {
+
+  table_t *table = internHandle;
+  uint32_t h = hash(s, len);
+
+  // Linear probing from the slot the hash picks
+  uint32_t i = h & table->mask;
+  while(table->slots[i].entry != NULL) {
+    entry_t *entry = table->slots[i].entry;
+    if(table->slots[i].hash == h && entry->length == len &&
+       memcmp(entry->str, s, len) == 0) {
+      return entry->str;
+    }
+    i = (i + 1) & table->mask;
+  }
+
+  entry_t *entry = arena_alloc(table, len);
+  if(entry == NULL) {
+    return NULL;
+  }
+  entry->id = table->count;
+  entry->length = len;
+  entry->hash = h;
+  memcpy(entry->str, s, len);
+  entry->str[len] = '\0';
+
+  table->slots[i].entry = entry;
+  table->slots[i].hash = h;
+  table->count++;
+
+  // Keep the table at most half full so probes stay short
+  if(table->count * 2 > table->mask + 1 && !grow_slots(table)) {
+    return NULL;
+  }
+
+  return entry->str;
+}
+
+int internId(const char *interned) {
+
+  const entry_t *entry = (const entry_t *)(interned - offsetof(entry_t, str));
+  return entry->id;
+}
+
+size_t internLength(const char *interned) {
+
+  const entry_t *entry = (const entry_t *)(interned - offsetof(entry_t, str));
+  return entry->length;
+}
+
+uint32_t internHash(const char *interned) {
+
+  const entry_t *entry = (const entry_t *)(interned - offsetof(entry_t, str));
+  return entry->hash;
+}
+
+int internCount(void *internHandle) {
+
+  table_t *table = internHandle;
+  return table->count;
+}
+
+// FNV-1a
+static uint32_t hash(const char *s, size_t len) {
+
+  uint32_t h = 2166136261u;
+
+  for(size_t i = 0; i < len; i++) {
+    h ^= (unsigned char) s[i];
+    h *= 16777619u;
+  }
+
+  return h;
+}
+
+static entry_t *arena_alloc(table_t *table, size_t len) {
+
+  size_t size = (sizeof(entry_t) + len + 1 + (ENTRY_ALIGN - 1)) &
+    ~(ENTRY_ALIGN - 1);
+
+  if(table->next == NULL || (size_t)(table->end - table->next) < size) {
+
+    // Each new block doubles the last, and is always big enough
+    size_t block_size = table->blocks ? table->blocks->size * 2 : INITIAL_BLOCK;
+    while(block_size < size) {
+      block_size *= 2;
+    }
+
+    block_t *block = malloc(sizeof(block_t) + block_size);
+    if(block == NULL) {
+      return NULL;
+    }
+    block->size = block_size;
+    block->next = table->blocks;
+    table->blocks = block;
+    table->next = block->data;
+    table->end = block->data + block_size;
+  }
+
+  entry_t *entry = (entry_t *) table->next;
+  table->next += size;
+  return entry;
+}
+
+static int grow_slots(table_t *table) {
+
+  uint32_t new_mask = table->mask * 2 + 1;
+
+  slot_t *new_slots = calloc(new_mask + 1, sizeof(slot_t));
+  if(new_slots == NULL) {
+    return 0;
+  }
+
+  for(uint32_t i = 0; i <= table->mask; i++) {
+    if(table->slots[i].entry != NULL) {
+      uint32_t j = table->slots[i].hash & new_mask;
+      while(new_slots[j].entry != NULL) {
+        j = (j + 1) & new_mask;
+      }
+      new_slots[j] = table->slots[i];
+    }
+  }
+
+  free(table->slots);
+  table->slots = new_slots;
+  table->mask = new_mask;
+  return 1;
+}
@@ -0,0 +1,50 @@
+//
+// This is the interface for a string interning table. Each distinct
+// string given to the table is stored once, in an arena owned by the
+// table, and the same stable pointer is handed back every time the
+// string is seen again. Interned strings can therefore be compared with
+// ==, and each also carries a small integer ID: the number of distinct
+// strings interned before it.
+//
+// Strings live until the table is cleared or deleted.
+//
+
+#ifndef INTERN_H
+#define INTERN_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+void *internCreate(void);
+  // Creates an empty table.
+  // If successful, returns a handle for the new table.
+  // If memory cannot be allocated for the table, returns NULL.
+
+void internDelete(void *internHandle);
+  // Deletes a table and every string interned in it.
+
+void internClear(void *internHandle);
+  // Forgets every string interned in the table, keeping memory to
+  //   reuse for the next strings. IDs start again from 0.
+
+const char *internString(void *internHandle, const char *s, size_t len);
+  // Intern the len characters at s (which need not be null terminated).
+  // Returns the table's null terminated copy, the same pointer for
+  //   every call with the same characters.
+  // If memory cannot be allocated for a new string, returns NULL.
+
+int internId(const char *interned);
+  // Returns the ID of a string returned by internString.
+  // The behavior is undefined for any other string.
+
+size_t internLength(const char *interned);
+  // Returns the length of a string returned by internString.
+
+uint32_t internHash(const char *interned);
+  // Returns the FNV-1a hash of a string returned by internString, which
+  //   is the hash symtabLookupOrInsert takes (see symtab.h).
+
+int internCount(void *internHandle);
+  // Returns the number of distinct strings in the table.
+
+#endif
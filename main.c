@@ -2,32 +2,78 @@
 //
 // main.c - main routine for cs520 assembler
 //
-//          Usage: asx20 file.asm
+//          Usage: asx20 [-sbf] [-c dir] [-o out.obj] file.asm
+//                 asx20 [-sbf] [-c dir] -j N file.asm ...
 //
-//          Output: file.obj
+//                 -s    read the input with stdio rather than mapping it
+//                 -b    write alloc regions as BSS entries rather than
+//                       zero words (see asx20_obj_write)
+//                 -f    parse with the hand-written front end rather
+//                       than flex and bison (mapped input only); a
+//                       large file is parsed on several threads
+//                 -c    keep an object cache in the directory named: a
+//                       source assembled before is not assembled again,
+//                       its object, listing and messages are replayed
+//                 -o    name the object file
+//                 -j N  assemble the files N at a time
 //
+//          Output: file.obj for each file.asm
+//
+//          a file named "-" is stdin or stdout: "asx20 - -o -" assembles
+//          its input as it is piped in and writes the object to stdout,
+//          with the listing on stderr. the object goes to stdout by
+//          default when the input is stdin.
+//
+//          the assembling itself is done by libasx20 (see asx20.h); this
+//          reads the named files with it and writes out what it returns
 //
 
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <unistd.h>
-#include "defs.h"
-
-// parser generated by bison
-void yyparse(void);
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "asx20.h"
+#include "cache.h"
 
-// forward reference
-static void nameOutFile(char *, char *);
+// how every file is assembled, from the command line
+struct settings {
+  int useStdio;
+  unsigned int options;          // ASX20_ flags for the handles
+  char *cacheDir;                // object cache, or NULL
+};
 
-// file pointer to be used by message functions 
-FILE *yyerrfp;
+// one input file of a batch (see assembleBatch)
+struct job {
+  char *name;
+  off_t size;
+};
 
-// count of errors detected by the parser
-unsigned int parseErrorCount = 0;
+// the files of a batch, shared by the threads assembling them
+struct batch {
+  struct job *order;             // files, largest first
+  int count;
+  int jobs;                      // files assembled at the same time
+  int next;                      // next file to hand out
+  int failed;                    // number of files that failed
+  struct settings *settings;
+  pthread_mutex_t lock;          // guards next, failed and the output
+};
 
-// count of errors detected by the scanner
-unsigned int scanErrorCount = 0;
+// forward references
+static void usage(void);
+static int assembleFile(asx20 *, char *, char *, struct settings *,
+  struct batch *);
+static int writeObject(asx20_obj *, struct cacheEntry *, int);
+static int assembleBatch(char **, int, int, struct settings *);
+static void *batchWorker(void *);
+static int compareJobSize(const void *, const void *);
+static void printOutput(char *, char *, size_t, FILE *);
+static void nameOutFile(char *, char *);
 
 //
 //      main
@@ -35,98 +81,443 @@ unsigned int scanErrorCount = 0;
 //
 int main(int argc, char *argv[])
 {
+  struct settings settings = { 0, 0, NULL };
+  int jobs = 0;
+  char *outName = NULL;
+  int opt;
+  int i;
+
+  // check for options followed by one or more file arguments
+  while ((opt = getopt(argc, argv, "sbfo:c:j:")) != -1)
+  {
+    if (opt == 's')
+    {
+      settings.useStdio = 1;
+    }
+    else if (opt == 'b')
+    {
+      settings.options |= ASX20_BSS;
+    }
+    else if (opt == 'f')
+    {
+      settings.options |= ASX20_FASTSCAN;
+    }
+    else if (opt == 'o')
+    {
+      outName = optarg;
+    }
+    else if (opt == 'c')
+    {
+      settings.cacheDir = optarg;
+    }
+    else if (opt == 'j')
+    {
+      jobs = atoi(optarg);
+      if (jobs < 1)
+      {
+        usage();
+      }
+    }
+    else
+    {
+      usage();
+    }
+  }
+  if (argc - optind < 1)
+  {
+    usage();
+  }
+
+  // a single file with no -j is assembled right here
+  if (argc - optind == 1 && jobs == 0)
+  {
+    asx20 *as = asx20_create();
+    int status;
+
+    asx20_set_options(as, settings.options);
+    status = assembleFile(as, argv[optind], outName, &settings, NULL);
+    asx20_destroy(as);
+    return status;
+  }
+
+  // a batch names its object files after its inputs, and has only
+  // one stdin
+  if (outName)
+  {
+    usage();
+  }
+  for (i = optind; i < argc; i++)
+  {
+    if (!strcmp(argv[i], "-"))
+    {
+      usage();
+    }
+  }
+
+  return assembleBatch(argv + optind, argc - optind,
+    jobs ? jobs : 1, &settings);
+}
+
+//
+//      usage
+//
+static
+void usage(void)
+{
+  fprintf(stderr,"usage: asx20 [-sbf] [-c dir] [-o out.obj] file.asm\n");
+  fprintf(stderr,"       asx20 [-sbf] [-c dir] -j N file.asm ...\n");
+  exit(1);
+}
+
+//
+//      assembleFile
+//
+//      assemble one input file, writing the object file next to it (or
+//      to outName if it isn't NULL) and the listing and messages to
+//      stdout and stderr
+//
+//      an input named "-" is read from stdin as it arrives. an object
+//      file named "-" is written to stdout, and the listing then goes to
+//      stderr with the messages.
+//
+//      with a cache directory, a file whose entry is found there is not
+//      assembled; what its entry holds is written out instead, and a
+//      file that is assembled gets an entry for next time.
+//
+//      in a batch, the listing and messages are printed in one piece
+//      under a line naming the file, so the output of files running
+//      together does not interleave
+//
+//      returns 0 on success, otherwise the number of errors found (or 1
+//      if a file could not be opened)
+//
+static
+int assembleFile(asx20 *as, char *inName, char *outName,
+  struct settings *settings, struct batch *b)
+{
+  asx20_obj obj;
+  asx20_diag diags;
+  struct cacheEntry entry;
+  struct cacheEntry *hit = NULL;
+  char key[CACHE_KEY_LENGTH + 1];
+  char *src;
+  size_t srcLength;
+  int keyed = 0;
   char *outn;
-  FILE *outf;
-  extern FILE *yyin;
-  extern int yylineno;
- 
-  yyerrfp = stderr;
+  int outFd;
+  FILE *listf = stdout;
+  int errorCount;
 
-  // initialize assembler
-  initAssemble();
+  if (!strcmp(inName, "-"))
+  {
+    errorCount = asx20_assemble_fd(as, STDIN_FILENO, &obj, &diags);
+    if (outName == NULL)
+    {
+      outName = "-";
+    }
+  }
+  else
+  {
+    // with a cache, a source assembled before is replayed from its entry
+    keyed = settings->cacheDir &&
+      cacheKey(inName, settings->options, key, &src, &srcLength) == 0;
+    if (keyed && cacheLookup(settings->cacheDir, key, &entry) == 0)
+    {
+      hit = &entry;
+      errorCount = entry.errorCount;
+    }
+    else if (keyed)
+    {
+      // a miss assembles the source its key was computed from
+      errorCount = asx20_assemble_buffer(as, src, srcLength, &obj, &diags);
+      cacheStore(settings->cacheDir, key, &obj, &diags, errorCount);
+    }
+    else
+    {
+      errorCount = asx20_assemble_file(as, inName, settings->useStdio, &obj,
+        &diags);
+    }
+    if (keyed && srcLength != 0)
+    {
+      munmap(src, srcLength);
+    }
+  }
 
-  // check that single argument is all that is there
-  if ((argc != 2))
+  if (outName && !strcmp(outName, "-"))
   {
-    fprintf(stderr,"usage: asx20 file.asm\n");
-    exit(1);
+    listf = stderr;
+    if (errorCount == 0 && writeObject(&obj, hit, STDOUT_FILENO))
+    {
+      fprintf(stderr, "can't write object to stdout\n");
+      errorCount = 1;
+    }
+  }
+  else
+  {
+    // allocate space for output filename (+1 for null; +4 for ".obj")
+    outn = malloc((outName ? strlen(outName) : strlen(inName) + 4) + 1);
+    if (outn == 0)
+    {
+      fprintf(stderr, "malloc failed for output filename\n");
+      exit(1);
+    }
+
+    // name the output file
+    if (outName)
+    {
+      strcpy(outn, outName);
+    }
+    else
+    {
+      nameOutFile(inName, outn);
+    }
+
+    // a failed assembly leaves no object, not the one from the last
+    // time it succeeded
+    if (errorCount != 0)
+    {
+      if (unlink(outn) && errno != ENOENT)
+      {
+        fprintf(stderr, "can't remove %s\n", outn);
+      }
+    }
+    // write the object file
+    else if ((outFd = open(outn, O_WRONLY | O_CREAT | O_TRUNC, 0666)) < 0)
+    {
+      fprintf(stderr, "can't open %s\n", outn);
+      errorCount = 1;
+    }
+    else
+    {
+      if (writeObject(&obj, hit, outFd) | close(outFd))
+      {
+        fprintf(stderr, "can't write %s\n", outn);
+        errorCount = 1;
+      }
+    }
+    free(outn);
   }
 
-  // tell yacc to start on line 1
-  yylineno = 1;
+  if (b)
+  {
+    pthread_mutex_lock(&b->lock);
+  }
+  if (hit)
+  {
+    printOutput(b ? inName : NULL, hit->listing, hit->listingLength, listf);
+    printOutput(b ? inName : NULL, hit->text, hit->textLength, stderr);
+  }
+  else
+  {
+    printOutput(b ? inName : NULL, obj.listing, obj.listing_length, listf);
+    printOutput(b ? inName : NULL, diags.text, diags.length, stderr);
+  }
+  if (b)
+  {
+    pthread_mutex_unlock(&b->lock);
+  }
 
-  // open the input file
-  if (!(yyin = fopen(argv[1],"r")))
+  if (hit)
   {
-    fprintf(stderr, "can't open %s\n", argv[1]);
-    exit(1);
+    cacheRelease(hit);
+  }
+  else
+  {
+    asx20_obj_free(&obj);
+    asx20_diag_free(&diags);
   }
+  return errorCount;
+}
 
-  // invoke parser to drive the first pass
-  yyparse();
+//
+//      writeObject
+//
+//      write the object file of an assembly, or of a cache entry if one
+//      is given, to a descriptor
+//
+//      returns 0 on success, -1 on a write error
+//
+static
+int writeObject(asx20_obj *obj, struct cacheEntry *hit, int fd)
+{
+  char *p;
+  size_t left;
+  ssize_t n;
 
-  // close input file
-  fclose(yyin);
+  if (hit == NULL)
+  {
+    return asx20_obj_write_fd(obj, fd);
+  }
 
-  // allocate space for output filename (+1 for null; +4 for ".obj")
-  outn = malloc(strlen(argv[1]) + 1 + 4);
-  if (outn == 0)
+  p = hit->object;
+  left = hit->objectLength;
+  while (left > 0)
   {
-    fprintf(stderr, "malloc failed for output filename\n");
-    exit(1);
+    n = write(fd, p, left);
+    if (n < 0 && errno == EINTR)
+    {
+      continue;
+    }
+    if (n < 0)
+    {
+      return -1;
+    }
+    p += n;
+    left -= n;
   }
+  return 0;
+}
 
-  // name the output file
-  nameOutFile(argv[1], outn);
+//
+//      assembleBatch
+//
+//      assemble many files, up to "jobs" of them at the same time
+//
+//      each of "jobs" threads owns an assembler handle, and takes the
+//      next file from the list, largest first, until none are left, so a
+//      big file doesn't start last and run alone.
+//
+//      returns the number of files that failed
+//
+static
+int assembleBatch(char **names, int count, int jobs,
+  struct settings *settings)
+{
+  struct batch b;
+  pthread_t *threads;
+  struct stat st;
+  int i;
 
-  // open the output file
-  if (!(outf = fopen(outn,"w")))
+  if (jobs > count)
   {
-    fprintf(stderr, "can't open %s\n", outn);
+    jobs = count;
+  }
+
+  b.order = malloc(count * sizeof(struct job));
+  threads = malloc(jobs * sizeof(pthread_t));
+  if (b.order == NULL || threads == NULL)
+  {
+    fprintf(stderr, "malloc failed for batch\n");
     exit(1);
   }
 
-  // let the assembler know that the first pass is done
-  //   it will tell us how many errors were detected and therefore
-  //   whether to continue with the second pass
-  int errorCount = betweenPasses(outf);
-  if (errorCount + scanErrorCount + parseErrorCount)
+  for (i = 0; i < count; i++)
   {
-    // close output file that was not used
-    fclose(outf);
+    b.order[i].name = names[i];
+    b.order[i].size = stat(names[i], &st) == 0 ? st.st_size : 0;
+  }
+  qsort(b.order, count, sizeof(struct job), compareJobSize);
+
+  b.count = count;
+  b.jobs = jobs;
+  b.next = 0;
+  b.failed = 0;
+  b.settings = settings;
+  pthread_mutex_init(&b.lock, NULL);
 
-    // remove the output file
-    if (unlink(outn))
+  for (i = 0; i < jobs; i++)
+  {
+    if (pthread_create(&threads[i], NULL, batchWorker, &b))
     {
-      bug("can't remove output file?");
+      fprintf(stderr, "can't create thread for batch\n");
+      exit(1);
     }
-
-    error("assembler terminating after first pass with %d error(s)",
-      errorCount + scanErrorCount + parseErrorCount);
-    return errorCount + scanErrorCount + parseErrorCount;
+  }
+  for (i = 0; i < jobs; i++)
+  {
+    pthread_join(threads[i], NULL);
   }
 
-  // tell yacc again to start on line 1
-  yylineno = 1;
+  pthread_mutex_destroy(&b.lock);
+  free(b.order);
+  free(threads);
+  return b.failed;
+}
 
-  // re-open the file
-  if (!(yyin = fopen(argv[1],"r")))
+//
+//      batchWorker
+//
+//      thread body for assembleBatch: assemble files from the batch with
+//      one handle until there are none left
+//
+static
+void *batchWorker(void *arg)
+{
+  struct batch *b = arg;
+  asx20 *as = asx20_create();
+  struct job *j;
+  int status;
+
+  asx20_set_options(as, b->settings->options);
+
+  // files running side by side already keep the CPUs busy
+  if (b->jobs > 1)
   {
-    fprintf(stderr, "can't open input file for second pass\n");
-    exit(1);
+    asx20_set_threads(as, 1);
   }
 
-  // invoke parser to drive the second pass
-  yyparse();
+  for (;;)
+  {
+    pthread_mutex_lock(&b->lock);
+    j = b->next < b->count ? &b->order[b->next++] : NULL;
+    pthread_mutex_unlock(&b->lock);
+    if (j == NULL)
+    {
+      break;
+    }
+
+    status = assembleFile(as, j->name, NULL, b->settings, b);
+    if (status)
+    {
+      pthread_mutex_lock(&b->lock);
+      b->failed++;
+      pthread_mutex_unlock(&b->lock);
+    }
+  }
 
+  asx20_destroy(as);
+  return NULL;
+}
 
-  // close the files
-  fclose(outf);
-  fclose(yyin);
+//
+//      compareJobSize
+//
+//      qsort comparison putting larger files first
+//
+static
+int compareJobSize(const void *a, const void *b)
+{
+  const struct job *ja = a;
+  const struct job *jb = b;
 
+  if (ja->size != jb->size)
+  {
+    return ja->size < jb->size ? 1 : -1;
+  }
   return 0;
 }
 
+//
+//      printOutput
+//
+//      print the listing or messages of one file, headed by the name of
+//      the file if one is given and there is anything to print
+//
+static
+void printOutput(char *name, char *text, size_t length, FILE *to)
+{
+  if (length == 0)
+  {
+    return;
+  }
+  if (name)
+  {
+    fprintf(to, "%s:\n", name);
+  }
+  fwrite(text, 1, length, to);
+  fflush(to);
+}
+
 //
 //      nameOutFile
 //
@@ -6,37 +6,37 @@
 #include <stdio.h>
 #include <stdarg.h>
 #include <stdlib.h>
+#include "defs.h"
 
-// file pointer to print messages to
-//   set by initMessages, or defaults to stderr
+// messages go to the context's errfp, which createAssembler sets to
+// stderr. fatal and bug end the process, so theirs always go to stderr,
+// where they are seen even when errfp is collecting messages in memory.
+// a NULL context (no assembly under way yet) also means stderr, and the
+// message has no line number.
 //
-static FILE * yyerrfp = 0;
-
-// note: yylineno gets advanced to next line before "assemble" is called.
-//       therefore, we subtract one before printing it in this module
-//       except for in parseError, which is only called by the parser
+// note: the context's lineno gets advanced to next line before
+//       "assemble" is called. therefore, we subtract one before printing
+//       it in this module except for in parseError, which is only called
+//       by the parser
 //
-extern int yylineno;
-
-// for formatting messages
-static char buf[1024];
 
-// yyerrfp defaults to stderr
-static void checkInitialized(void)
+// print one message
+//   the buffer is local so that contexts in different threads don't
+//   share it
+static void message(AsmContext *ctx, FILE *fp, char *kind, int adjust,
+                    char *fmt, va_list ap)
 {
-  if (yyerrfp == 0)
+  char buf[1024];
+
+  vsnprintf(buf, sizeof(buf), fmt, ap);
+  if (ctx == NULL)
   {
-    yyerrfp = stderr;
+    fprintf(stderr,"[%s] %s\n", kind, buf);
+  }
+  else
+  {
+    fprintf(fp,"[%s] line %d:  %s\n", kind, ctx->lineno-adjust, buf);
   }
-}
-
-//  initMessages
-//
-//  initialize the message module
-//
-void InitMessages(FILE *fp)
-{
-  yyerrfp = fp;
 }
 
 //  error
@@ -44,30 +44,26 @@ void InitMessages(FILE *fp)
 //  print error message (ie user made mistake)
 //
 //
-void error(char * fmt, ...)
+void error(AsmContext *ctx, char * fmt, ...)
 {
-  checkInitialized();
   va_list ap;
   va_start(ap, fmt);
-  vsprintf(buf, fmt, ap);
+  message(ctx, ctx ? ctx->errfp : NULL, "error", 1, fmt, ap);
   va_end(ap);
-  fprintf(yyerrfp,"[error] line %d:  %s\n", yylineno-1, buf);
 }
 
 //  parseError
 //
 //  print error message when parse error encountered
-//  (like "error" except don't subtract one from yylineno)
+//  (like "error" except don't subtract one from lineno)
 //
 //
-void parseError(char * fmt, ...)
+void parseError(AsmContext *ctx, char * fmt, ...)
 {
-  checkInitialized();
   va_list ap;
   va_start(ap, fmt);
-  vsprintf(buf, fmt, ap);
+  message(ctx, ctx ? ctx->errfp : NULL, "error", 0, fmt, ap);
   va_end(ap);
-  fprintf(yyerrfp,"[error] line %d:  %s\n", yylineno, buf);
 }
 
 //  fatal
@@ -76,14 +72,12 @@ void parseError(char * fmt, ...)
 //
 //  (usually means some internal data structure overflowed)
 //
-void fatal(char * fmt, ...)
+void fatal(AsmContext *ctx, char * fmt, ...)
 {
-  checkInitialized();
   va_list ap;
   va_start(ap, fmt);
-  vsprintf(buf, fmt, ap);
+  message(ctx, stderr, "fatal error", 1, fmt, ap);
   va_end(ap);
-  fprintf(yyerrfp,"[fatal error] line %d:  %s\n", yylineno-1, buf);
   exit(1);
 }
 
@@ -93,14 +87,11 @@ void fatal(char * fmt, ...)
 //
 //  (shouldn't happen?!)
 //
-void bug(char * fmt, ...)
+void bug(AsmContext *ctx, char * fmt, ...)
 {
-  checkInitialized();
   va_list ap;
   va_start(ap, fmt);
-  vsprintf(buf, fmt, ap);
+  message(ctx, stderr, "compiler bug", 1, fmt, ap);
   va_end(ap);
-  fprintf(yyerrfp,"[compiler bug] line %d:  %s\n", yylineno-1, buf);
   exit(1);
 }
-
@@ -0,0 +1,101 @@
+//
+// mkopcodes.c - generate the perfect hash for the opcode table
+//
+//               run when the assembler is built, it searches for a
+//               multiplier that sends every mnemonic in opcodes.def to a
+//               slot of its own in the smallest table it can, and writes
+//               the multiplier and the slots to standard output for
+//               opcodes.c to include.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "opcodes.h"
+
+static const char *mnemonics[] = {
+#define OPCODE(tag, mnemonic, encoding, format) mnemonic,
+#include "opcodes.def"
+#undef OPCODE
+};
+
+// tries for each table size before going on to a bigger one
+#define TRIES 1000000
+
+int main(void)
+{
+  int slots[256];
+  uint32_t state = 2463534242u;
+  uint32_t multiplier;
+  int minLength = 255;
+  int maxLength = 0;
+  int bits;
+  int i;
+
+  for (i = 0; i < OPCODE_COUNT; i++)
+  {
+    int len = strlen(mnemonics[i]);
+    if (len < minLength) minLength = len;
+    if (len > maxLength) maxLength = len;
+  }
+  if (minLength < 2)
+  {
+    fprintf(stderr, "mkopcodes: mnemonics must be 2 or more characters\n");
+    return 1;
+  }
+
+  // the smallest power of two with room for every mnemonic
+  for (bits = 1; (1 << bits) < OPCODE_COUNT; bits++)
+  {
+    ;
+  }
+
+  for (; bits <= 8; bits++)
+  {
+    for (int try = 0; try < TRIES; try++)
+    {
+      // xorshift, from a fixed seed so the output is the same every build
+      state ^= state << 13;
+      state ^= state >> 17;
+      state ^= state << 5;
+      multiplier = state | 1;
+
+      for (i = 0; i < (1 << bits); i++)
+      {
+        slots[i] = OPCODE_UNKNOWN;
+      }
+      for (i = 0; i < OPCODE_COUNT; i++)
+      {
+        const char *s = mnemonics[i];
+        uint32_t h = OPCODE_HASH(s, (int) strlen(s), multiplier, 32 - bits);
+        if (slots[h] != OPCODE_UNKNOWN)
+        {
+          break;
+        }
+        slots[h] = i;
+      }
+      if (i == OPCODE_COUNT)
+      {
+        goto found;
+      }
+    }
+  }
+  fprintf(stderr, "mkopcodes: no perfect hash found for opcodes.def\n");
+  return 1;
+
+found:
+  printf("// generated by mkopcodes from opcodes.def; do not edit\n\n");
+  printf("#define OPCODE_MULTIPLIER 0x%08xu\n", multiplier);
+  printf("#define OPCODE_SHIFT %d\n", 32 - bits);
+  printf("#define OPCODE_MIN_LENGTH %d\n", minLength);
+  printf("#define OPCODE_MAX_LENGTH %d\n\n", maxLength);
+  printf("static const unsigned char opcodeSlots[%d] = {", 1 << bits);
+  for (i = 0; i < (1 << bits); i++)
+  {
+    printf("%s%2d%s", i % 16 ? " " : "\n  ", slots[i],
+      i + 1 < (1 << bits) ? "," : "\n");
+  }
+  printf("};\n");
+  return 0;
+}
@@ -0,0 +1,37 @@
+//
+// opcodes.c - the opcode table, and finding mnemonics in it
+//
+
+#include <string.h>
+#include "opcodes.h"
+#include "ophash.h"
+
+const opcodeInfo opcodeTable[OPCODE_COUNT] = {
+#define OPCODE(tag, mnemonic, encoding, format) { mnemonic, encoding, format },
+#include "opcodes.def"
+#undef OPCODE
+};
+
+//
+//      opcodeLookup
+//
+//      the hash picks the only entry the name could be, so it takes one
+//      compare to know whether it is
+//
+int opcodeLookup(const char *s, int len)
+{
+  int op;
+
+  if (len < OPCODE_MIN_LENGTH || len > OPCODE_MAX_LENGTH)
+  {
+    return OPCODE_UNKNOWN;
+  }
+
+  op = opcodeSlots[OPCODE_HASH(s, len, OPCODE_MULTIPLIER, OPCODE_SHIFT)];
+  if (op == OPCODE_UNKNOWN || strncmp(opcodeTable[op].mnemonic, s, len) ||
+      opcodeTable[op].mnemonic[len] != '\0')
+  {
+    return OPCODE_UNKNOWN;
+  }
+  return op;
+}
@@ -0,0 +1,46 @@
+//
+// This is the interface for the table of vmx20 instructions and asx20
+// directives, which is generated from opcodes.def.
+//
+// The scanner finds mnemonics in the table with a perfect hash worked out
+// by mkopcodes when the assembler is built, and hands the parser the
+// opcode's enum value rather than its name. Everything the assembler
+// needs to know about an opcode is then one lookup in opcodeTable.
+//
+
+#ifndef OPCODES_H
+#define OPCODES_H
+
+#include <stdint.h>
+
+enum opcode {
+#define OPCODE(tag, mnemonic, encoding, format) OPCODE_##tag,
+#include "opcodes.def"
+#undef OPCODE
+  OPCODE_COUNT,                  // number of entries in opcodeTable
+  OPCODE_UNKNOWN = OPCODE_COUNT, // a mnemonic not in the table
+  OPCODE_NONE                    // no instruction on the line
+};
+
+typedef struct opcodeInfo {
+  const char *mnemonic;
+  unsigned int encoding;         // low 8 bits of the instruction word
+  unsigned int format;           // operand format the instruction takes
+} opcodeInfo;
+
+extern const opcodeInfo opcodeTable[OPCODE_COUNT];
+
+int opcodeLookup(const char *s, int len);
+  // Returns the opcode whose mnemonic is the len characters at s, or
+  //   OPCODE_UNKNOWN if there is none.
+
+// The hash the lookup uses: the first two characters, the last and the
+// length, multiplied by a constant mkopcodes chose so that no two
+// mnemonics land in the same slot. Only used for 2 or more characters.
+#define OPCODE_HASH(s, len, multiplier, shift) \
+  ((uint32_t) (((uint32_t) (unsigned char) (s)[0] | \
+                (uint32_t) (unsigned char) (s)[1] << 8 | \
+                (uint32_t) (unsigned char) (s)[(len) - 1] << 16 | \
+                (uint32_t) (len) << 24) * (multiplier)) >> (shift))
+
+#endif
@@ -55,34 +55,26 @@
 #define YYSKELETON_NAME "yacc.c"
 
 /* Pure parsers.  */
-#define YYPURE 0
+#define YYPURE 2
 
 /* Push parsers.  */
-#define YYPUSH 0
+#define YYPUSH 1
 
 /* Pull parsers.  */
-#define YYPULL 1
+#define YYPULL 0
 
 
 
 
 /* First part of user prologue.  */
-#line 7 "parse.y"
+#line 17 "parse.y"
 
 #include <stddef.h>
 #include <stdio.h>
-#include "defs.h"
-
-extern unsigned int parseErrorCount;
-
-// scanner produced by flex
-int yylex(void);
-
-// forward reference
-void yyerror(char *s);
+#include <string.h>
+#include "intern.h"
 
-
-#line 86 "y.tab.c"
+#line 78 "y.tab.c"
 
 # ifndef YY_CAST
 #  ifdef __cplusplus
@@ -116,6 +108,18 @@ void yyerror(char *s);
 #if YYDEBUG
 extern int yydebug;
 #endif
+/* "%code requires" blocks.  */
+#line 7 "parse.y"
+
+#include "defs.h"
+
+// the reentrant scanner produced by flex
+#ifndef YY_TYPEDEF_YY_SCANNER_T
+#define YY_TYPEDEF_YY_SCANNER_T
+typedef void* yyscan_t;
+#endif
+
+#line 123 "y.tab.c"
 
 /* Token kinds.  */
 #ifndef YYTOKENTYPE
@@ -127,35 +131,23 @@ extern int yydebug;
     YYerror = 256,                 /* error  */
     YYUNDEF = 257,                 /* "invalid token"  */
     ID = 258,                      /* ID  */
-    INT_CONST = 259,               /* INT_CONST  */
-    REG = 260,                     /* REG  */
-    EOL = 261,                     /* EOL  */
-    COLON = 262,                   /* COLON  */
-    COMMA = 263,                   /* COMMA  */
-    LPAREN = 264,                  /* LPAREN  */
-    RPAREN = 265                   /* RPAREN  */
+    OPCODE = 259,                  /* OPCODE  */
+    INT_CONST = 260,               /* INT_CONST  */
+    REG = 261,                     /* REG  */
+    EOL = 262,                     /* EOL  */
+    COLON = 263,                   /* COLON  */
+    COMMA = 264,                   /* COMMA  */
+    LPAREN = 265,                  /* LPAREN  */
+    RPAREN = 266                   /* RPAREN  */
   };
   typedef enum yytokentype yytoken_kind_t;
 #endif
-/* Token kinds.  */
-#define YYEMPTY -2
-#define YYEOF 0
-#define YYerror 256
-#define YYUNDEF 257
-#define ID 258
-#define INT_CONST 259
-#define REG 260
-#define EOL 261
-#define COLON 262
-#define COMMA 263
-#define LPAREN 264
-#define RPAREN 265
 
 /* Value type.  */
 #if ! defined YYSTYPE && ! defined YYSTYPE_IS_DECLARED
 union YYSTYPE
 {
-#line 25 "parse.y"
+#line 46 "parse.y"
 
         char *       y_str;
         unsigned int y_reg;
@@ -163,7 +155,7 @@ union YYSTYPE
         INSTR        y_instr;
         
 
-#line 167 "y.tab.c"
+#line 159 "y.tab.c"
 
 };
 typedef union YYSTYPE YYSTYPE;
@@ -172,10 +164,21 @@ typedef union YYSTYPE YYSTYPE;
 #endif
 
 
-extern YYSTYPE yylval;
 
 
-int yyparse (void);
+#ifndef YYPUSH_MORE_DEFINED
+# define YYPUSH_MORE_DEFINED
+enum { YYPUSH_MORE = 4 };
+#endif
+
+typedef struct yypstate yypstate;
+
+
+int yypush_parse (yypstate *ps,
+                  int pushed_char, YYSTYPE const *pushed_val, AsmContext *ctx);
+
+yypstate *yypstate_new (void);
+void yypstate_delete (yypstate *ps);
 
 
 #endif /* !YY_YY_Y_TAB_H_INCLUDED  */
@@ -187,25 +190,38 @@ enum yysymbol_kind_t
   YYSYMBOL_YYerror = 1,                    /* error  */
   YYSYMBOL_YYUNDEF = 2,                    /* "invalid token"  */
   YYSYMBOL_ID = 3,                         /* ID  */
-  YYSYMBOL_INT_CONST = 4,                  /* INT_CONST  */
-  YYSYMBOL_REG = 5,                        /* REG  */
-  YYSYMBOL_EOL = 6,                        /* EOL  */
-  YYSYMBOL_COLON = 7,                      /* COLON  */
-  YYSYMBOL_COMMA = 8,                      /* COMMA  */
-  YYSYMBOL_LPAREN = 9,                     /* LPAREN  */
-  YYSYMBOL_RPAREN = 10,                    /* RPAREN  */
-  YYSYMBOL_YYACCEPT = 11,                  /* $accept  */
-  YYSYMBOL_program = 12,                   /* program  */
-  YYSYMBOL_stmt_list = 13,                 /* stmt_list  */
-  YYSYMBOL_stmt = 14,                      /* stmt  */
-  YYSYMBOL_label = 15,                     /* label  */
-  YYSYMBOL_instruction = 16,               /* instruction  */
-  YYSYMBOL_opcode = 17                     /* opcode  */
+  YYSYMBOL_OPCODE = 4,                     /* OPCODE  */
+  YYSYMBOL_INT_CONST = 5,                  /* INT_CONST  */
+  YYSYMBOL_REG = 6,                        /* REG  */
+  YYSYMBOL_EOL = 7,                        /* EOL  */
+  YYSYMBOL_COLON = 8,                      /* COLON  */
+  YYSYMBOL_COMMA = 9,                      /* COMMA  */
+  YYSYMBOL_LPAREN = 10,                    /* LPAREN  */
+  YYSYMBOL_RPAREN = 11,                    /* RPAREN  */
+  YYSYMBOL_YYACCEPT = 12,                  /* $accept  */
+  YYSYMBOL_program = 13,                   /* program  */
+  YYSYMBOL_stmt_list = 14,                 /* stmt_list  */
+  YYSYMBOL_stmt = 15,                      /* stmt  */
+  YYSYMBOL_label = 16,                     /* label  */
+  YYSYMBOL_name = 17,                      /* name  */
+  YYSYMBOL_instruction = 18,               /* instruction  */
+  YYSYMBOL_opcode = 19                     /* opcode  */
 };
 typedef enum yysymbol_kind_t yysymbol_kind_t;
 
 
 
+/* Unqualified %code blocks.  */
+#line 34 "parse.y"
+
+// scanner produced by flex
+int yylex(YYSTYPE *, yyscan_t);
+
+// forward references
+void yyerror(AsmContext *, char *s);
+static char *opcodeName(AsmContext *, int);
+
+#line 225 "y.tab.c"
 
 #ifdef short
 # undef short
@@ -402,30 +418,6 @@ typedef int yy_state_fast_t;
 
 /* The parser invokes alloca or malloc; define the necessary symbols.  */
 
-# ifdef YYSTACK_USE_ALLOCA
-#  if YYSTACK_USE_ALLOCA
-#   ifdef __GNUC__
-#    define YYSTACK_ALLOC __builtin_alloca
-#   elif defined __BUILTIN_VA_ARG_INCR
-#    include <alloca.h> /* INFRINGES ON USER NAME SPACE */
-#   elif defined _AIX
-#    define YYSTACK_ALLOC __alloca
-#   elif defined _MSC_VER
-#    include <malloc.h> /* INFRINGES ON USER NAME SPACE */
-#    define alloca _alloca
-#   else
-#    define YYSTACK_ALLOC alloca
-#    if ! defined _ALLOCA_H && ! defined EXIT_SUCCESS
-#     include <stdlib.h> /* INFRINGES ON USER NAME SPACE */
-      /* Use EXIT_SUCCESS as a witness for stdlib.h.  */
-#     ifndef EXIT_SUCCESS
-#      define EXIT_SUCCESS 0
-#     endif
-#    endif
-#   endif
-#  endif
-# endif
-
 # ifdef YYSTACK_ALLOC
    /* Pacify GCC's 'empty if-body' warning.  */
 #  define YYSTACK_FREE(Ptr) do { /* empty */; } while (0)
@@ -526,21 +518,21 @@ union yyalloc
 #endif /* !YYCOPY_NEEDED */
 
 /* YYFINAL -- State number of the termination state.  */
-#define YYFINAL  11
+#define YYFINAL  12
 /* YYLAST -- Last index in YYTABLE.  */
-#define YYLAST   32
+#define YYLAST   40
 
 /* YYNTOKENS -- Number of terminals.  */
-#define YYNTOKENS  11
+#define YYNTOKENS  12
 /* YYNNTS -- Number of nonterminals.  */
-#define YYNNTS  7
+#define YYNNTS  8
 /* YYNRULES -- Number of rules.  */
-#define YYNRULES  20
+#define YYNRULES  23
 /* YYNSTATES -- Number of states.  */
-#define YYNSTATES  32
+#define YYNSTATES  36
 
 /* YYMAXUTOK -- Last valid token kind.  */
-#define YYMAXUTOK   265
+#define YYMAXUTOK   266
 
 
 /* YYTRANSLATE(TOKEN-NUM) -- Symbol number corresponding to TOKEN-NUM
@@ -580,16 +572,16 @@ static const yytype_int8 yytranslate[] =
        2,     2,     2,     2,     2,     2,     2,     2,     2,     2,
        2,     2,     2,     2,     2,     2,     2,     2,     2,     2,
        2,     2,     2,     2,     2,     2,     1,     2,     3,     4,
-       5,     6,     7,     8,     9,    10
+       5,     6,     7,     8,     9,    10,    11
 };
 
 #if YYDEBUG
 /* YYRLINE[YYN] -- Source line where rule number YYN was defined.  */
 static const yytype_uint8 yyrline[] =
 {
-       0,    54,    54,    58,    60,    65,    69,    73,    79,    83,
-      90,    97,   103,   110,   117,   125,   133,   141,   150,   159,
-     168
+       0,    77,    77,    81,    83,    88,    92,    96,   104,   108,
+     115,   126,   130,   137,   143,   150,   157,   165,   173,   181,
+     190,   199,   212,   217
 };
 #endif
 
@@ -605,9 +597,10 @@ static const char *yysymbol_name (yysymbol_kind_t yysymbol) YY_ATTRIBUTE_UNUSED;
    First, the terminals, then, starting at YYNTOKENS, nonterminals.  */
 static const char *const yytname[] =
 {
-  "\"end of file\"", "error", "\"invalid token\"", "ID", "INT_CONST",
-  "REG", "EOL", "COLON", "COMMA", "LPAREN", "RPAREN", "$accept", "program",
-  "stmt_list", "stmt", "label", "instruction", "opcode", YY_NULLPTR
+  "\"end of file\"", "error", "\"invalid token\"", "ID", "OPCODE",
+  "INT_CONST", "REG", "EOL", "COLON", "COMMA", "LPAREN", "RPAREN",
+  "$accept", "program", "stmt_list", "stmt", "label", "name",
+  "instruction", "opcode", YY_NULLPTR
 };
 
 static const char *
@@ -617,12 +610,12 @@ yysymbol_name (yysymbol_kind_t yysymbol)
 }
 #endif
 
-#define YYPACT_NINF (-1)
+#define YYPACT_NINF (-11)
 
 #define yypact_value_is_default(Yyn) \
   ((Yyn) == YYPACT_NINF)
 
-#define YYTABLE_NINF (-4)
+#define YYTABLE_NINF (-13)
 
 #define yytable_value_is_error(Yyn) \
   0
@@ -631,10 +624,10 @@ yysymbol_name (yysymbol_kind_t yysymbol)
    STATE-NUM.  */
 static const yytype_int8 yypact[] =
 {
-       1,    10,     8,    -1,    17,     0,     2,    12,     6,    -1,
-      -1,    -1,    -1,     0,    -1,    -1,    13,    -1,    -1,    -1,
-      14,    -1,    -1,     9,    -1,    11,    15,    16,    21,    18,
-      -1,    -1
+       6,    -4,    -2,    21,   -11,    14,   -11,     8,    22,     9,
+      15,   -11,   -11,     1,   -11,   -11,   -11,    25,   -11,   -11,
+     -11,   -11,   -11,    26,   -11,   -11,   -11,    20,    23,    27,
+     -11,    28,    24,    29,   -11,   -11
 };
 
 /* YYDEFACT[STATE-NUM] -- Default reduction number in state STATE-NUM.
@@ -642,22 +635,22 @@ static const yytype_int8 yypact[] =
    means the default is an error.  */
 static const yytype_int8 yydefact[] =
 {
-       0,     0,    20,     8,     0,     0,     0,     0,    11,     9,
-      10,     1,     2,     0,    20,     7,     0,     6,    12,    19,
-      13,     4,     5,     0,    15,    14,    16,     0,     0,     0,
-      18,    17
+       0,     0,    23,    22,     8,     0,     3,     0,     0,     0,
+      13,     9,     1,     0,    23,    22,     7,     0,    10,     6,
+      11,    12,    21,    15,    14,     4,     5,     0,    16,    18,
+      17,     0,     0,     0,    20,    19
 };
 
 /* YYPGOTO[NTERM-NUM].  */
 static const yytype_int8 yypgoto[] =
 {
-      -1,    -1,    19,    25,    -1,    20,    -1
+     -11,   -11,   -11,    18,   -11,   -10,    30,   -11
 };
 
 /* YYDEFGOTO[NTERM-NUM].  */
 static const yytype_int8 yydefgoto[] =
 {
-       0,     4,    12,    13,     6,     7,     8
+       0,     5,    13,     6,     7,     8,     9,    10
 };
 
 /* YYTABLE[YYPACT[STATE-NUM]] -- What to do in state STATE-NUM.  If
@@ -665,44 +658,46 @@ static const yytype_int8 yydefgoto[] =
    number is the opposite.  If YYTABLE_NINF, syntax error.  */
 static const yytype_int8 yytable[] =
 {
-      -3,     1,     1,     2,     2,    14,     3,     3,    15,    18,
-      19,    20,    24,    25,    26,    10,     9,    11,    17,    22,
-      27,    29,    23,    28,    30,     5,    16,     0,    31,     0,
-       0,     0,    21
+      24,    -2,     1,    11,     2,     3,   -11,     1,     4,     2,
+       3,    14,    15,     4,    12,    16,    19,    30,    20,    21,
+      22,    23,    34,    20,    21,    28,    29,    20,    21,   -12,
+      18,    25,    26,    31,    33,    27,    32,    17,     0,     0,
+      35
 };
 
 static const yytype_int8 yycheck[] =
 {
-       0,     1,     1,     3,     3,     3,     6,     6,     6,     3,
-       4,     5,     3,     4,     5,     7,     6,     0,     6,     6,
-       9,     5,     8,     8,     3,     0,     6,    -1,    10,    -1,
-      -1,    -1,    13
+      10,     0,     1,     7,     3,     4,     8,     1,     7,     3,
+       4,     3,     4,     7,     0,     7,     7,    27,     3,     4,
+       5,     6,    32,     3,     4,     5,     6,     3,     4,     8,
+       8,    13,     7,    10,     6,     9,     9,     7,    -1,    -1,
+      11
 };
 
 /* YYSTOS[STATE-NUM] -- The symbol kind of the accessing symbol of
    state STATE-NUM.  */
 static const yytype_int8 yystos[] =
 {
-       0,     1,     3,     6,    12,    14,    15,    16,    17,     6,
-       7,     0,    13,    14,     3,     6,    16,     6,     3,     4,
-       5,    13,     6,     8,     3,     4,     5,     9,     8,     5,
-       3,    10
+       0,     1,     3,     4,     7,    13,    15,    16,    17,    18,
+      19,     7,     0,    14,     3,     4,     7,    18,     8,     7,
+       3,     4,     5,     6,    17,    15,     7,     9,     5,     6,
+      17,    10,     9,     6,    17,    11
 };
 
 /* YYR1[RULE-NUM] -- Symbol kind of the left-hand side of rule RULE-NUM.  */
 static const yytype_int8 yyr1[] =
 {
-       0,    11,    12,    13,    13,    14,    14,    14,    14,    14,
-      15,    16,    16,    16,    16,    16,    16,    16,    16,    16,
-      17
+       0,    12,    13,    14,    14,    15,    15,    15,    15,    15,
+      16,    17,    17,    18,    18,    18,    18,    18,    18,    18,
+      18,    18,    19,    19
 };
 
 /* YYR2[RULE-NUM] -- Number of symbols on the right-hand side of rule RULE-NUM.  */
 static const yytype_int8 yyr2[] =
 {
        0,     2,     2,     0,     2,     3,     2,     2,     1,     2,
-       2,     1,     2,     2,     4,     4,     4,     7,     6,     2,
-       1
+       2,     1,     1,     1,     2,     2,     4,     4,     4,     7,
+       6,     2,     1,     1
 };
 
 
@@ -731,7 +726,7 @@ enum { YYENOMEM = -2 };
       }                                                           \
     else                                                          \
       {                                                           \
-        yyerror (YY_("syntax error: cannot back up")); \
+        yyerror (ctx, YY_("syntax error: cannot back up")); \
         YYERROR;                                                  \
       }                                                           \
   while (0)
@@ -764,7 +759,7 @@ do {                                                                      \
     {                                                                     \
       YYFPRINTF (stderr, "%s ", Title);                                   \
       yy_symbol_print (stderr,                                            \
-                  Kind, Value); \
+                  Kind, Value, ctx); \
       YYFPRINTF (stderr, "\n");                                           \
     }                                                                     \
 } while (0)
@@ -776,10 +771,11 @@ do {                                                                      \
 
 static void
 yy_symbol_value_print (FILE *yyo,
-                       yysymbol_kind_t yykind, YYSTYPE const * const yyvaluep)
+                       yysymbol_kind_t yykind, YYSTYPE const * const yyvaluep, AsmContext *ctx)
 {
   FILE *yyoutput = yyo;
   YY_USE (yyoutput);
+  YY_USE (ctx);
   if (!yyvaluep)
     return;
   YY_IGNORE_MAYBE_UNINITIALIZED_BEGIN
@@ -794,12 +790,12 @@ yy_symbol_value_print (FILE *yyo,
 
 static void
 yy_symbol_print (FILE *yyo,
-                 yysymbol_kind_t yykind, YYSTYPE const * const yyvaluep)
+                 yysymbol_kind_t yykind, YYSTYPE const * const yyvaluep, AsmContext *ctx)
 {
   YYFPRINTF (yyo, "%s %s (",
              yykind < YYNTOKENS ? "token" : "nterm", yysymbol_name (yykind));
 
-  yy_symbol_value_print (yyo, yykind, yyvaluep);
+  yy_symbol_value_print (yyo, yykind, yyvaluep, ctx);
   YYFPRINTF (yyo, ")");
 }
 
@@ -833,7 +829,7 @@ do {                                                            \
 
 static void
 yy_reduce_print (yy_state_t *yyssp, YYSTYPE *yyvsp,
-                 int yyrule)
+                 int yyrule, AsmContext *ctx)
 {
   int yylno = yyrline[yyrule];
   int yynrhs = yyr2[yyrule];
@@ -846,7 +842,7 @@ yy_reduce_print (yy_state_t *yyssp, YYSTYPE *yyvsp,
       YYFPRINTF (stderr, "   $%d = ", yyi + 1);
       yy_symbol_print (stderr,
                        YY_ACCESSING_SYMBOL (+yyssp[yyi + 1 - yynrhs]),
-                       &yyvsp[(yyi + 1) - (yynrhs)]);
+                       &yyvsp[(yyi + 1) - (yynrhs)], ctx);
       YYFPRINTF (stderr, "\n");
     }
 }
@@ -854,7 +850,7 @@ yy_reduce_print (yy_state_t *yyssp, YYSTYPE *yyvsp,
 # define YY_REDUCE_PRINT(Rule)          \
 do {                                    \
   if (yydebug)                          \
-    yy_reduce_print (yyssp, yyvsp, Rule); \
+    yy_reduce_print (yyssp, yyvsp, Rule, ctx); \
 } while (0)
 
 /* Nonzero means print parse trace.  It is left uninitialized so that
@@ -883,6 +879,35 @@ int yydebug;
 #ifndef YYMAXDEPTH
 # define YYMAXDEPTH 10000
 #endif
+/* Parser data structure.  */
+struct yypstate
+  {
+    /* Number of syntax errors so far.  */
+    int yynerrs;
+
+    yy_state_fast_t yystate;
+    /* Number of tokens to shift before error messages enabled.  */
+    int yyerrstatus;
+
+    /* Refer to the stacks through separate pointers, to allow yyoverflow
+       to reallocate them elsewhere.  */
+
+    /* Their size.  */
+    YYPTRDIFF_T yystacksize;
+
+    /* The state stack: array, bottom, top.  */
+    yy_state_t yyssa[YYINITDEPTH];
+    yy_state_t *yyss;
+    yy_state_t *yyssp;
+
+    /* The semantic value stack: array, bottom, top.  */
+    YYSTYPE yyvsa[YYINITDEPTH];
+    YYSTYPE *yyvs;
+    YYSTYPE *yyvsp;
+    /* Whether this instance has not started parsing yet.
+     * If 2, it corresponds to a finished parsing.  */
+    int yynew;
+  };
 
 
 
@@ -895,9 +920,10 @@ int yydebug;
 
 static void
 yydestruct (const char *yymsg,
-            yysymbol_kind_t yykind, YYSTYPE *yyvaluep)
+            yysymbol_kind_t yykind, YYSTYPE *yyvaluep, AsmContext *ctx)
 {
   YY_USE (yyvaluep);
+  YY_USE (ctx);
   if (!yymsg)
     yymsg = "Deleting";
   YY_SYMBOL_PRINT (yymsg, yykind, yyvaluep, yylocationp);
@@ -908,43 +934,86 @@ yydestruct (const char *yymsg,
 }
 
 
-/* Lookahead token kind.  */
-int yychar;
 
-/* The semantic value of the lookahead symbol.  */
-YYSTYPE yylval;
-/* Number of syntax errors so far.  */
-int yynerrs;
 
 
+#define yynerrs yyps->yynerrs
+#define yystate yyps->yystate
+#define yyerrstatus yyps->yyerrstatus
+#define yyssa yyps->yyssa
+#define yyss yyps->yyss
+#define yyssp yyps->yyssp
+#define yyvsa yyps->yyvsa
+#define yyvs yyps->yyvs
+#define yyvsp yyps->yyvsp
+#define yystacksize yyps->yystacksize
 
+/* Initialize the parser data structure.  */
+static void
+yypstate_clear (yypstate *yyps)
+{
+  yynerrs = 0;
+  yystate = 0;
+  yyerrstatus = 0;
 
-/*----------.
-| yyparse.  |
-`----------*/
+  yyssp = yyss;
+  yyvsp = yyvs;
 
-int
-yyparse (void)
+  /* Initialize the state stack, in case yypcontext_expected_tokens is
+     called before the first call to yyparse. */
+  *yyssp = 0;
+  yyps->yynew = 1;
+}
+
+/* Initialize the parser data structure.  */
+yypstate *
+yypstate_new (void)
 {
-    yy_state_fast_t yystate = 0;
-    /* Number of tokens to shift before error messages enabled.  */
-    int yyerrstatus = 0;
+  yypstate *yyps;
+  yyps = YY_CAST (yypstate *, YYMALLOC (sizeof *yyps));
+  if (!yyps)
+    return YY_NULLPTR;
+  yystacksize = YYINITDEPTH;
+  yyss = yyssa;
+  yyvs = yyvsa;
+  yypstate_clear (yyps);
+  return yyps;
+}
 
-    /* Refer to the stacks through separate pointers, to allow yyoverflow
-       to reallocate them elsewhere.  */
+void
+yypstate_delete (yypstate *yyps)
+{
+  if (yyps)
+    {
+#ifndef yyoverflow
+      /* If the stack was reallocated but the parse did not complete, then the
+         stack still needs to be freed.  */
+      if (yyss != yyssa)
+        YYSTACK_FREE (yyss);
+#endif
+      YYFREE (yyps);
+    }
+}
 
-    /* Their size.  */
-    YYPTRDIFF_T yystacksize = YYINITDEPTH;
 
-    /* The state stack: array, bottom, top.  */
-    yy_state_t yyssa[YYINITDEPTH];
-    yy_state_t *yyss = yyssa;
-    yy_state_t *yyssp = yyss;
 
-    /* The semantic value stack: array, bottom, top.  */
-    YYSTYPE yyvsa[YYINITDEPTH];
-    YYSTYPE *yyvs = yyvsa;
-    YYSTYPE *yyvsp = yyvs;
+/*---------------.
+| yypush_parse.  |
+`---------------*/
+
+int
+yypush_parse (yypstate *yyps,
+              int yypushed_char, YYSTYPE const *yypushed_val, AsmContext *ctx)
+{
+/* Lookahead token kind.  */
+int yychar;
+
+
+/* The semantic value of the lookahead symbol.  */
+/* Default value used for initialization, for pacifying older GCCs
+   or non-GCC compilers.  */
+YY_INITIAL_VALUE (static YYSTYPE yyval_default;)
+YYSTYPE yylval YY_INITIAL_VALUE (= yyval_default);
 
   int yyn;
   /* The return value of yyparse.  */
@@ -963,6 +1032,20 @@ yyparse (void)
      Keep to zero when no symbol should be popped.  */
   int yylen = 0;
 
+  switch (yyps->yynew)
+    {
+    case 0:
+      yyn = yypact[yystate];
+      goto yyread_pushed_token;
+
+    case 2:
+      yypstate_clear (yyps);
+      break;
+
+    default:
+      break;
+    }
+
   YYDPRINTF ((stderr, "Starting parse\n"));
 
   yychar = YYEMPTY; /* Cause a token to be read.  */
@@ -1077,8 +1160,18 @@ yybackup:
   /* YYCHAR is either empty, or end-of-input, or a valid lookahead.  */
   if (yychar == YYEMPTY)
     {
+      if (!yyps->yynew)
+        {
+          YYDPRINTF ((stderr, "Return for a new token:\n"));
+          yyresult = YYPUSH_MORE;
+          goto yypushreturn;
+        }
+      yyps->yynew = 0;
+yyread_pushed_token:
       YYDPRINTF ((stderr, "Reading a token\n"));
-      yychar = yylex ();
+      yychar = yypushed_char;
+      if (yypushed_val)
+        yylval = *yypushed_val;
     }
 
   if (yychar <= YYEOF)
@@ -1166,161 +1259,189 @@ yyreduce:
   switch (yyn)
     {
   case 5: /* stmt: label instruction EOL  */
-#line 66 "parse.y"
+#line 89 "parse.y"
           {
-             assemble((yyvsp[-2].y_str), (yyvsp[-1].y_instr));
+             assemble(ctx, (yyvsp[-2].y_str), (yyvsp[-1].y_instr));
           }
-#line 1174 "y.tab.c"
+#line 1267 "y.tab.c"
     break;
 
   case 6: /* stmt: instruction EOL  */
-#line 70 "parse.y"
+#line 93 "parse.y"
           {
-             assemble(NULL, (yyvsp[-1].y_instr));
+             assemble(ctx, NULL, (yyvsp[-1].y_instr));
           }
-#line 1182 "y.tab.c"
+#line 1275 "y.tab.c"
     break;
 
   case 7: /* stmt: label EOL  */
-#line 74 "parse.y"
+#line 97 "parse.y"
           {
              INSTR nullInstr;
              nullInstr.format = 0;
-             assemble((yyvsp[-1].y_str), nullInstr);
+             nullInstr.opcode = OPCODE_NONE;
+             nullInstr.mnemonic = NULL;
+             assemble(ctx, (yyvsp[-1].y_str), nullInstr);
           }
-#line 1192 "y.tab.c"
+#line 1287 "y.tab.c"
     break;
 
   case 8: /* stmt: EOL  */
-#line 80 "parse.y"
+#line 105 "parse.y"
           {
              // no action
           }
-#line 1200 "y.tab.c"
+#line 1295 "y.tab.c"
     break;
 
   case 9: /* stmt: error EOL  */
-#line 84 "parse.y"
+#line 109 "parse.y"
           {
              // error recovery - sync with end-of-line
           }
-#line 1208 "y.tab.c"
+#line 1303 "y.tab.c"
     break;
 
-  case 10: /* label: ID COLON  */
-#line 91 "parse.y"
+  case 10: /* label: name COLON  */
+#line 116 "parse.y"
           {
              (yyval.y_str) = (yyvsp[-1].y_str);
           }
-#line 1216 "y.tab.c"
+#line 1311 "y.tab.c"
+    break;
+
+  case 11: /* name: ID  */
+#line 127 "parse.y"
+          {
+             (yyval.y_str) = (yyvsp[0].y_str);
+          }
+#line 1319 "y.tab.c"
+    break;
+
+  case 12: /* name: OPCODE  */
+#line 131 "parse.y"
+          {
+             (yyval.y_str) = opcodeName(ctx, (yyvsp[0].y_int));
+          }
+#line 1327 "y.tab.c"
     break;
 
-  case 11: /* instruction: opcode  */
-#line 98 "parse.y"
+  case 13: /* instruction: opcode  */
+#line 138 "parse.y"
           {
+             (yyval.y_instr) = (yyvsp[0].y_instr);
              (yyval.y_instr).format = 1;
-             (yyval.y_instr).opcode = (yyvsp[0].y_str);
           }
-#line 1225 "y.tab.c"
+#line 1336 "y.tab.c"
     break;
 
-  case 12: /* instruction: opcode ID  */
-#line 104 "parse.y"
+  case 14: /* instruction: opcode name  */
+#line 144 "parse.y"
           {
+             (yyval.y_instr) = (yyvsp[-1].y_instr);
              (yyval.y_instr).format = 2;
-             (yyval.y_instr).opcode = (yyvsp[-1].y_str);
              (yyval.y_instr).u.format2.addr = (yyvsp[0].y_str);
           }
-#line 1235 "y.tab.c"
+#line 1346 "y.tab.c"
     break;
 
-  case 13: /* instruction: opcode REG  */
-#line 111 "parse.y"
+  case 15: /* instruction: opcode REG  */
+#line 151 "parse.y"
           {
+             (yyval.y_instr) = (yyvsp[-1].y_instr);
              (yyval.y_instr).format = 3;
-             (yyval.y_instr).opcode = (yyvsp[-1].y_str);
              (yyval.y_instr).u.format3.reg = (yyvsp[0].y_reg);
           }
-#line 1245 "y.tab.c"
+#line 1356 "y.tab.c"
     break;
 
-  case 14: /* instruction: opcode REG COMMA INT_CONST  */
-#line 118 "parse.y"
+  case 16: /* instruction: opcode REG COMMA INT_CONST  */
+#line 158 "parse.y"
           {
+             (yyval.y_instr) = (yyvsp[-3].y_instr);
              (yyval.y_instr).format = 4;
-             (yyval.y_instr).opcode = (yyvsp[-3].y_str);
              (yyval.y_instr).u.format4.reg = (yyvsp[-2].y_reg);
              (yyval.y_instr).u.format4.constant = (yyvsp[0].y_int);
           }
-#line 1256 "y.tab.c"
+#line 1367 "y.tab.c"
     break;
 
-  case 15: /* instruction: opcode REG COMMA ID  */
-#line 126 "parse.y"
+  case 17: /* instruction: opcode REG COMMA name  */
+#line 166 "parse.y"
           {
+             (yyval.y_instr) = (yyvsp[-3].y_instr);
              (yyval.y_instr).format = 5;
-             (yyval.y_instr).opcode = (yyvsp[-3].y_str);
              (yyval.y_instr).u.format5.reg = (yyvsp[-2].y_reg);
              (yyval.y_instr).u.format5.addr = (yyvsp[0].y_str);
           }
-#line 1267 "y.tab.c"
+#line 1378 "y.tab.c"
     break;
 
-  case 16: /* instruction: opcode REG COMMA REG  */
-#line 134 "parse.y"
+  case 18: /* instruction: opcode REG COMMA REG  */
+#line 174 "parse.y"
           {
+             (yyval.y_instr) = (yyvsp[-3].y_instr);
              (yyval.y_instr).format = 6;
-             (yyval.y_instr).opcode = (yyvsp[-3].y_str);
              (yyval.y_instr).u.format6.reg1 = (yyvsp[-2].y_reg);
              (yyval.y_instr).u.format6.reg2 = (yyvsp[0].y_reg);
           }
-#line 1278 "y.tab.c"
+#line 1389 "y.tab.c"
     break;
 
-  case 17: /* instruction: opcode REG COMMA INT_CONST LPAREN REG RPAREN  */
-#line 142 "parse.y"
+  case 19: /* instruction: opcode REG COMMA INT_CONST LPAREN REG RPAREN  */
+#line 182 "parse.y"
           {
+             (yyval.y_instr) = (yyvsp[-6].y_instr);
              (yyval.y_instr).format = 7;
-             (yyval.y_instr).opcode = (yyvsp[-6].y_str);
              (yyval.y_instr).u.format7.reg1 = (yyvsp[-5].y_reg);
              (yyval.y_instr).u.format7.offset = (yyvsp[-3].y_int);
              (yyval.y_instr).u.format7.reg2 = (yyvsp[-1].y_reg);
           }
-#line 1290 "y.tab.c"
+#line 1401 "y.tab.c"
     break;
 
-  case 18: /* instruction: opcode REG COMMA REG COMMA ID  */
-#line 151 "parse.y"
+  case 20: /* instruction: opcode REG COMMA REG COMMA name  */
+#line 191 "parse.y"
           {
+             (yyval.y_instr) = (yyvsp[-5].y_instr);
              (yyval.y_instr).format = 8;
-             (yyval.y_instr).opcode = (yyvsp[-5].y_str);
              (yyval.y_instr).u.format8.reg1 = (yyvsp[-4].y_reg);
              (yyval.y_instr).u.format8.reg2 = (yyvsp[-2].y_reg);
              (yyval.y_instr).u.format8.addr = (yyvsp[0].y_str);
           }
-#line 1302 "y.tab.c"
+#line 1413 "y.tab.c"
     break;
 
-  case 19: /* instruction: opcode INT_CONST  */
-#line 160 "parse.y"
+  case 21: /* instruction: opcode INT_CONST  */
+#line 200 "parse.y"
           {
+             (yyval.y_instr) = (yyvsp[-1].y_instr);
              (yyval.y_instr).format = 9;
-             (yyval.y_instr).opcode = (yyvsp[-1].y_str);
              (yyval.y_instr).u.format9.constant = (yyvsp[0].y_int);
           }
-#line 1312 "y.tab.c"
+#line 1423 "y.tab.c"
     break;
 
-  case 20: /* opcode: ID  */
-#line 169 "parse.y"
+  case 22: /* opcode: OPCODE  */
+#line 213 "parse.y"
           {
-             (yyval.y_str) = (yyvsp[0].y_str);
+             (yyval.y_instr).opcode = (yyvsp[0].y_int);
+             (yyval.y_instr).mnemonic = NULL;
           }
-#line 1320 "y.tab.c"
+#line 1432 "y.tab.c"
+    break;
+
+  case 23: /* opcode: ID  */
+#line 218 "parse.y"
+          {
+             (yyval.y_instr).opcode = OPCODE_UNKNOWN;
+             (yyval.y_instr).mnemonic = (yyvsp[0].y_str);
+          }
+#line 1441 "y.tab.c"
     break;
 
 
-#line 1324 "y.tab.c"
+#line 1445 "y.tab.c"
 
       default: break;
     }
@@ -1367,7 +1488,7 @@ yyerrlab:
   if (!yyerrstatus)
     {
       ++yynerrs;
-      yyerror (YY_("syntax error"));
+      yyerror (ctx, YY_("syntax error"));
     }
 
   if (yyerrstatus == 3)
@@ -1384,7 +1505,7 @@ yyerrlab:
       else
         {
           yydestruct ("Error: discarding",
-                      yytoken, &yylval);
+                      yytoken, &yylval, ctx);
           yychar = YYEMPTY;
         }
     }
@@ -1440,7 +1561,7 @@ yyerrlab1:
 
 
       yydestruct ("Error: popping",
-                  YY_ACCESSING_SYMBOL (yystate), yyvsp);
+                  YY_ACCESSING_SYMBOL (yystate), yyvsp, ctx);
       YYPOPSTACK (1);
       yystate = *yyssp;
       YY_STACK_PRINT (yyss, yyssp);
@@ -1478,7 +1599,7 @@ yyabortlab:
 | yyexhaustedlab -- YYNOMEM (memory exhaustion) comes here.  |
 `-----------------------------------------------------------*/
 yyexhaustedlab:
-  yyerror (YY_("memory exhausted"));
+  yyerror (ctx, YY_("memory exhausted"));
   yyresult = 2;
   goto yyreturnlab;
 
@@ -1493,7 +1614,7 @@ yyreturnlab:
          user semantic actions for why this is necessary.  */
       yytoken = YYTRANSLATE (yychar);
       yydestruct ("Cleanup: discarding lookahead",
-                  yytoken, &yylval);
+                  yytoken, &yylval, ctx);
     }
   /* Do not reclaim the symbols of the rule whose action triggered
      this YYABORT or YYACCEPT.  */
@@ -1502,27 +1623,84 @@ yyreturnlab:
   while (yyssp != yyss)
     {
       yydestruct ("Cleanup: popping",
-                  YY_ACCESSING_SYMBOL (+*yyssp), yyvsp);
+                  YY_ACCESSING_SYMBOL (+*yyssp), yyvsp, ctx);
       YYPOPSTACK (1);
     }
-#ifndef yyoverflow
-  if (yyss != yyssa)
-    YYSTACK_FREE (yyss);
-#endif
+  yyps->yynew = 2;
+  goto yypushreturn;
+
+
+/*-------------------------.
+| yypushreturn -- return.  |
+`-------------------------*/
+yypushreturn:
 
   return yyresult;
 }
+#undef yynerrs
+#undef yystate
+#undef yyerrstatus
+#undef yyssa
+#undef yyss
+#undef yyssp
+#undef yyvsa
+#undef yyvs
+#undef yyvsp
+#undef yystacksize
+#line 224 "parse.y"
+
+
+// parseInput
+//
+// run the parser over the input the context's scanner was opened on
+//
+// returns 0 if the whole input was parsed
+//
+int parseInput(AsmContext *ctx)
+{
+  yypstate *ps;
+  YYSTYPE lval;
+  int token;
+  int status;
+
+  if ((ps = yypstate_new()) == NULL)
+  {
+    fatal(ctx, "out of memory creating parser");
+  }
+  do
+  {
+    token = yylex(&lval, ctx->scanner);
+    status = yypush_parse(ps, token, &lval, ctx);
+  } while (status == YYPUSH_MORE);
+  yypstate_delete(ps);
+  return status;
+}
 
-#line 174 "parse.y"
+// opcodeName
+//
+// the interned name of an opcode used as a label, so that it is the same
+// string as the scanner would have given for any other name
+//
+static char *opcodeName(AsmContext *ctx, int op)
+{
+  const char *mnemonic = opcodeTable[op].mnemonic;
+  const char *p;
 
+  p = internString(ctx->intern, mnemonic, strlen(mnemonic));
+  if (p == NULL)
+  {
+    fatal(ctx, "out of memory in opcodeName");
+  }
+  return (char *) p;
+}
 
 // yyerror
 //
 // yacc created parser will call this when syntax error occurs
 // (to get line number right we must call special "message" routine)
 //
-void yyerror(char *s)
+void yyerror(AsmContext *ctx, char *s)
 {
-  parseErrorCount += 1;
-  parseError(s); 
+  ctx->parseErrorCount += 1;
+  parseError(ctx, s); 
 }
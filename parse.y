@@ -4,20 +4,41 @@
 //
 //
 
+%code requires {
+#include "defs.h"
+
+// the reentrant scanner produced by flex
+#ifndef YY_TYPEDEF_YY_SCANNER_T
+#define YY_TYPEDEF_YY_SCANNER_T
+typedef void* yyscan_t;
+#endif
+}
+
 %{
 #include <stddef.h>
 #include <stdio.h>
-#include "defs.h"
+#include <string.h>
+#include "intern.h"
+%}
 
-extern unsigned int parseErrorCount;
+//
+//      the parser is a pure push parser: parseInput takes each token from
+//      the context's scanner and pushes it, so the first pass is done on
+//      the input as it arrives, and the assembler context is passed along
+//      with each token
+//
+%define api.pure full
+%define api.push-pull push
+%parse-param {AsmContext *ctx}
 
+%code {
 // scanner produced by flex
-int yylex(void);
+int yylex(YYSTYPE *, yyscan_t);
 
-// forward reference
-void yyerror(char *s);
-
-%}
+// forward references
+void yyerror(AsmContext *, char *s);
+static char *opcodeName(AsmContext *, int);
+}
 
 //
 //      this types the semantic stack
@@ -33,6 +54,7 @@ void yyerror(char *s);
 //        terminal symbols
 //
 %token <y_str> ID
+%token <y_int> OPCODE
 %token <y_int> INT_CONST
 %token <y_reg> REG
 %token EOL
@@ -44,8 +66,9 @@ void yyerror(char *s);
 //
 //      typed non-terminal symbols
 //
-%type         <y_str>        opcode
+%type         <y_instr>      opcode
 %type         <y_str>        label
+%type         <y_str>        name
 %type         <y_instr>      instruction
 
 %%
@@ -57,24 +80,26 @@ program
 stmt_list
         : // null derive
 
-        | stmt stmt_list
+        | stmt_list stmt
 
         ;
 
 stmt
         : label instruction EOL
           {
-             assemble($1, $2);
+             assemble(ctx, $1, $2);
           }
         | instruction EOL
           {
-             assemble(NULL, $1);
+             assemble(ctx, NULL, $1);
           }
         | label EOL
           {
              INSTR nullInstr;
              nullInstr.format = 0;
-             assemble($1, nullInstr);
+             nullInstr.opcode = OPCODE_NONE;
+             nullInstr.mnemonic = NULL;
+             assemble(ctx, $1, nullInstr);
           }
         | EOL
           {
@@ -87,70 +112,85 @@ stmt
         ;
 
 label
-        : ID COLON
+        : name COLON
+          {
+             $$ = $1;
+          }
+        ;
+
+//
+//      a label may be spelled like an opcode; it is a name wherever the
+//      grammar expects one
+//
+name
+        : ID
           {
              $$ = $1;
           }
+        | OPCODE
+          {
+             $$ = opcodeName(ctx, $1);
+          }
         ;
 
 instruction
         : opcode
           {
+             $$ = $1;
              $$.format = 1;
-             $$.opcode = $1;
           }
         |
-          opcode ID
+          opcode name
           {
+             $$ = $1;
              $$.format = 2;
-             $$.opcode = $1;
              $$.u.format2.addr = $2;
           }
         |
           opcode REG
           {
+             $$ = $1;
              $$.format = 3;
-             $$.opcode = $1;
              $$.u.format3.reg = $2;
           }
         |
           opcode REG COMMA INT_CONST
           {
+             $$ = $1;
              $$.format = 4;
-             $$.opcode = $1;
              $$.u.format4.reg = $2;
              $$.u.format4.constant = $4;
           }
         |
-          opcode REG COMMA ID
+          opcode REG COMMA name
           {
+             $$ = $1;
              $$.format = 5;
-             $$.opcode = $1;
              $$.u.format5.reg = $2;
              $$.u.format5.addr = $4;
           }
         |
           opcode REG COMMA REG
           {
+             $$ = $1;
              $$.format = 6;
-             $$.opcode = $1;
              $$.u.format6.reg1 = $2;
              $$.u.format6.reg2 = $4;
           }
         |
           opcode REG COMMA INT_CONST LPAREN REG RPAREN
           {
+             $$ = $1;
              $$.format = 7;
-             $$.opcode = $1;
              $$.u.format7.reg1 = $2;
              $$.u.format7.offset = $4;
              $$.u.format7.reg2 = $6;
           }
         |
-          opcode REG COMMA REG COMMA ID
+          opcode REG COMMA REG COMMA name
           {
+             $$ = $1;
              $$.format = 8;
-             $$.opcode = $1;
              $$.u.format8.reg1 = $2;
              $$.u.format8.reg2 = $4;
              $$.u.format8.addr = $6;
@@ -158,28 +198,82 @@ instruction
         |
           opcode INT_CONST
           {
+             $$ = $1;
              $$.format = 9;
-             $$.opcode = $1;
              $$.u.format9.constant = $2;
           }
         ;
 
+//
+//      the scanner recognizes the mnemonics in the opcode table; any other
+//      name in their place is kept so it can be reported
+//
 opcode
-        : ID
+        : OPCODE
           {
-             $$ = $1;
+             $$.opcode = $1;
+             $$.mnemonic = NULL;
+          }
+        | ID
+          {
+             $$.opcode = OPCODE_UNKNOWN;
+             $$.mnemonic = $1;
           }
         ;
 
 %%
 
+// parseInput
+//
+// run the parser over the input the context's scanner was opened on
+//
+// returns 0 if the whole input was parsed
+//
+int parseInput(AsmContext *ctx)
+{
+  yypstate *ps;
+  YYSTYPE lval;
+  int token;
+  int status;
+
+  if ((ps = yypstate_new()) == NULL)
+  {
+    fatal(ctx, "out of memory creating parser");
+  }
+  do
+  {
+    token = yylex(&lval, ctx->scanner);
+    status = yypush_parse(ps, token, &lval, ctx);
+  } while (status == YYPUSH_MORE);
+  yypstate_delete(ps);
+  return status;
+}
+
+// opcodeName
+//
+// the interned name of an opcode used as a label, so that it is the same
+// string as the scanner would have given for any other name
+//
+static char *opcodeName(AsmContext *ctx, int op)
+{
+  const char *mnemonic = opcodeTable[op].mnemonic;
+  const char *p;
+
+  p = internString(ctx->intern, mnemonic, strlen(mnemonic));
+  if (p == NULL)
+  {
+    fatal(ctx, "out of memory in opcodeName");
+  }
+  return (char *) p;
+}
+
 // yyerror
 //
 // yacc created parser will call this when syntax error occurs
 // (to get line number right we must call special "message" routine)
 //
-void yyerror(char *s)
+void yyerror(AsmContext *ctx, char *s)
 {
-  parseErrorCount += 1;
-  parseError(s); 
+  ctx->parseErrorCount += 1;
+  parseError(ctx, s); 
 }
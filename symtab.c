@@ -3,23 +3,64 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
-
-typedef struct node {
-  char *symbol; // Key
+#include <stdint.h>
+#include <pthread.h>
+#include <sched.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// Characters of a symbol kept in its slot, as many as an object file
+// keeps of a name
+#define SLOT_KEY 16
+
+// Bytes a shard of a concurrent table is aligned to, a cache line
+#define SHARD_ALIGN 64
+
+// Each slot of the table holds a (symbol, data) pair itself. The table
+// is open addressed with robin hood probing: a symbol is put in the
+// first free slot after the one its hash picks, but takes the place of
+// any symbol it finds that is closer to its own, so every symbol stays
+// within a few slots of where its hash puts it.
+//
+// The first 16 characters of the symbol are kept in the slot too, so
+// most symbols, which are no longer than that, are compared there in
+// one go without reading the copy the slot points to.
+typedef struct slot {
+  char key[SLOT_KEY]; // First characters of the symbol, zero padded
+  char *symbol; // Key, NULL if the slot is empty
   void *data; // data
-  struct node *next; // Pointer to next node
-} node_t;
-
+  unsigned int hash; // Full hash of the key, mixed
+  unsigned int distance : 31; // Slots from the one the hash picks
+  unsigned int spilled : 1; // The symbol is longer than key
+} slot_t;
+
+
+// In arena mode the copies of the symbols and the BST nodes are bumped
+// out of a list of blocks, and all of them are freed with the blocks
+typedef struct block {
+  struct block *next;
+  size_t size; // Bytes in data
+  char data[];
+} block_t;
+
+typedef struct arena {
+  block_t *blocks; // Newest block first
+  char *next; // Free space in the newest block
+  char *end;
+} arena_t;
 
 typedef struct control {
-  int symtab_size; // Table size
-  node_t **table; // Pointer to an array of linked list heads
+  slot_t *table; // Array of slots, a power of 2 of them
+  unsigned int mask; // Number of slots - 1
+  unsigned int count; // Symbols installed
+  bool arena; // Symbols and BST nodes come from memory
+  arena_t memory; // The blocks, in arena mode
 } control_t; 
 
 typedef struct iterator {
-  node_t *symbol_node; // Node holding current symbol in iterator
   control_t *control_pointer; // Pointer to control structure
-  int index; // Current index iterator is at in the symtab
+  unsigned int index; // Slot of the next symbol, or past the end
 } iterator_t;
 
 typedef struct bst_node {
@@ -28,24 +69,206 @@ typedef struct bst_node {
   struct bst_node *parent; // Parent
   char *symbol; // Key
   void *data; // Data
-  bool visited; 
 } bst_node_t;
 
+// The handle symtabCreateBST returns
+typedef struct bst {
+  bst_node_t *root; // NULL if the table was empty
+  control_t *control; // Table whose arena the nodes are in, else NULL
+  arena_t mark; // The arena as it was before the BST was built
+  char *top; // Where the arena's free space started once it was built
+} bst_t;
+
+// An entry of a sorted view
+typedef struct sorted_entry {
+  const char *symbol; // Key, the table's copy
+  void *data; // Data
+} sorted_entry_t;
+
+typedef struct sorted_view {
+  unsigned int count; // Entries
+  sorted_entry_t entries[]; // In order of their symbols
+} sorted_view_t;
+
+// An index is an adaptive radix tree over a sorted view. Each node
+// stands for the symbols that share the characters on the path to it,
+// which are a run of the view's entries, and has one child for each
+// character that comes next in them (0 for the one that ends there).
+// The characters all of them share past that are kept once, as the
+// node's prefix. A node has room for only as many children as it has
+// (4, 16, 48 or 256), and a child that stands for one symbol is its
+// entry in the view, tagged in the low bit.
+typedef struct art_node {
+  uint8_t type; // ART_NODE4 ... ART_NODE256
+  uint16_t count; // Children
+  uint32_t prefix_length; // Characters all its symbols share past its depth
+  const char *prefix; // Those characters, in one of its symbols
+  uint32_t first; // Its symbols are the view's entries from first
+  uint32_t size; // and how many
+} art_node_t;
+
+// Children in order of their characters
+typedef struct art_node4 {
+  art_node_t header;
+  uint8_t keys[4];
+  void *children[4];
+} art_node4_t;
+
+typedef struct art_node16 {
+  art_node_t header;
+  uint8_t keys[16];
+  void *children[16];
+} art_node16_t;
+
+// The child for a character is children[index[character] - 1]
+typedef struct art_node48 {
+  art_node_t header;
+  uint8_t index[256]; // 0 if there is none
+  void *children[48];
+} art_node48_t;
+
+typedef struct art_node256 {
+  art_node_t header;
+  void *children[256]; // NULL if there is none
+} art_node256_t;
+
+typedef struct art_index {
+  sorted_view_t *view; // The entries, in order
+  arena_t memory; // The nodes
+  void *root; // NULL if the table was empty
+} art_index_t;
+
+// The entries a range or prefix query found, from the index's view
+typedef struct art_range {
+  sorted_view_t *view;
+  unsigned int next; // Entry to return next
+  unsigned int end; // Entry after the last
+} art_range_t;
+
+// A concurrent table is split into shards by the top bits of the hash,
+// each its own robin hood table with a lock that installs take. Lookups
+// take no lock: the symbol's entry never moves once installed, and a
+// lookup that misses while an install was moving slots around tries
+// again, which the shard's sequence number, odd during an install, tells
+// it. A table a shard outgrows is kept until the table is deleted, in
+// case a lookup is still reading it.
+typedef struct shard_entry {
+  void *data; // Data
+  char symbol[]; // Key
+} shard_entry_t;
+
+typedef struct shard_slot {
+  shard_entry_t *entry; // NULL if the slot is empty
+  unsigned int hash; // Full hash of the key, mixed
+  unsigned int distance; // Slots from the one the hash picks
+} shard_slot_t;
+
+typedef struct shard_table {
+  struct shard_table *retired; // The table this one replaced
+  unsigned int mask; // Number of slots - 1
+  shard_slot_t slots[];
+} shard_table_t;
+
+typedef struct shard {
+  pthread_mutex_t lock; // Held by a thread installing in the shard
+  unsigned int sequence; // Odd while an install is changing the slots
+  unsigned int count; // Symbols installed
+  shard_table_t *table; // Current table
+  arena_t memory; // The entries
+} shard_t;
+
+// Each shard on cache lines of its own, so threads in different shards
+// don't slow each other down
+typedef union padded_shard {
+  shard_t shard;
+  char padding[(sizeof(shard_t) + SHARD_ALIGN - 1) / SHARD_ALIGN * SHARD_ALIGN];
+} padded_shard_t;
+
+typedef struct concurrent {
+  unsigned int shard_bits; // log2 of the number of shards
+  padded_shard_t *shards;
+} concurrent_t;
+
+// Walking the tree only reads it, so any number of iterators can walk
+// it at once, from any threads
 typedef struct bst_iterator {
-  bst_node_t *current; 
+  bst_node_t *current; // Node to return next, NULL past the end
 } bst_iterator_t;
 
 
 //---------------PROTOTYPES---------------
 
 // Lookup helper 
-static node_t* lookup_helper(void *symtabHandle, const char *symbol);
+static slot_t *lookup_helper(control_t *control, const char *symbol, unsigned int h);
+
+// The key a slot would hold for a symbol; returns whether it spills
+static bool slot_key(const char *symbol, char key[SLOT_KEY]);
+
+// Whether a slot's key is the one given
+static bool same_key(const slot_t *slot, const char key[SLOT_KEY]);
+
+// Put a symbol that is not installed in the table
+static slot_t *insert_slot(control_t *control, slot_t entry);
+
+// Double the number of slots
+static int grow_table(control_t *control);
+
+// Index of the first symbol at or after a slot
+static unsigned int next_used(control_t *control, unsigned int index);
+
+// Spread the bits of a symbol's hash for the table
+static unsigned int mix(unsigned int hash);
+
+// Make room in the arena
+static void *arena_alloc(arena_t *arena, size_t size);
+
+// Free the blocks newer than a given one
+static void free_blocks(arena_t *arena, block_t *keep);
+
+// Sort entries on their symbols from a given character on
+static void radix_sort(sorted_entry_t *entries, sorted_entry_t *tmp, unsigned int count, size_t depth);
+
+// Sort a few entries the same way
+static void insertion_sort(sorted_entry_t *entries, unsigned int count, size_t depth);
+
+// Build the part of an index for a run of the view's entries
+static void *art_build(art_index_t *index, unsigned int first, unsigned int size, size_t depth);
 
-// Hash function
-static unsigned int hash(const char *str);
+// The child of a node for a character, or NULL
+static void *art_find_child(art_node_t *node, unsigned char c);
+
+// The child of a node for the next character after one, or NULL
+static void *art_next_child(art_node_t *node, unsigned char c);
+
+// The first entry a child stands for
+static unsigned int art_first(art_index_t *index, void *child);
+
+// The first entry whose symbol is not less than a key
+static unsigned int art_lower_bound(art_index_t *index, const char *key);
+
+// Make a range query's result
+static void *art_range(art_index_t *index, unsigned int first, unsigned int end);
+
+// The shard of a concurrent table a hash picks
+static shard_t *shard_of(concurrent_t *concurrent, unsigned int h);
+
+// Find a symbol in a shard without taking its lock
+static shard_entry_t *shard_find(shard_t *shard, const char *symbol, unsigned int h);
+
+// Wait a little for an install to finish before looking again
+static void shard_wait(unsigned int spins);
+
+// Install a symbol that is not in a shard, holding its lock
+static shard_entry_t *shard_insert(shard_t *shard, const char *symbol, unsigned int h, void *data);
+
+// Put an entry in a shard's table, holding its lock
+static void shard_place(shard_table_t *table, shard_slot_t entry);
+
+// Make a table for a shard with a given number of slots
+static shard_table_t *shard_table(unsigned int slots);
 
 // Create a new node
-static bst_node_t *create_node(char *symbol, void *data);
+static bst_node_t *create_node(control_t *control, char *symbol, void *data);
 
 // Add new node into BST
 static bst_node_t *insert_node(bst_node_t *root, bst_node_t *node);
@@ -54,6 +277,42 @@ static bst_node_t *insert_node(bst_node_t *root, bst_node_t *node);
 static void free_nodes(bst_node_t *node);
 
 
+// The table is grown before it is more than MAX_LOAD_NUM / MAX_LOAD_DEN
+// full, so probes stay short
+#define MAX_LOAD_NUM 3
+#define MAX_LOAD_DEN 4
+
+// Fewest slots a table has
+#define MIN_SLOTS 16
+
+// Size of the first arena block
+#define INITIAL_BLOCK 16384
+
+// Fewer entries than this are sorted by insertion rather than by radix
+#define SORT_CUTOFF 32
+
+// Most shards a concurrent table has, and how many it has by default
+#define MAX_SHARD_BITS 10
+#define DEFAULT_SHARD_BITS 6
+
+// Times a lookup waits for an install with a pause before it yields the
+// processor, in case the installing thread is waiting for it
+#define SPINS_BEFORE_YIELD 64
+
+// Kinds of index node
+#define ART_NODE4 0
+#define ART_NODE16 1
+#define ART_NODE48 2
+#define ART_NODE256 3
+
+// A child of an index node that is an entry of the view
+#define ART_IS_LEAF(child) (((uintptr_t)(child) & 1) != 0)
+#define ART_LEAF(child) ((sorted_entry_t *)((uintptr_t)(child) - 1))
+
+// Everything in the arena is kept aligned for a pointer
+#define ARENA_ALIGN sizeof(void *)
+
+
 //---------------FUNCTIONS---------------
 
 void *symtabCreate(int sizeHint) {
@@ -64,93 +323,215 @@ void *symtabCreate(int sizeHint) {
     return NULL;
   }
 
-  // Store size of symbol table in the control struct
-  control->symtab_size = sizeHint;
+  // Enough slots for the hinted number of symbols without growing
+  unsigned int slots = MIN_SLOTS;
+  while(sizeHint > 0 && (unsigned int) sizeHint * MAX_LOAD_DEN > slots * MAX_LOAD_NUM) {
+    slots *= 2;
+  }
 
-  // Allocate memory for the array of linked lists
-  control->table = malloc(sizeHint * sizeof(node_t *));
+  // Allocate memory for the slots, all empty
+  control->table = calloc(slots, sizeof(slot_t));
   if(control->table == NULL) {
     free(control);
     return NULL;
   }
+  control->mask = slots - 1;
+  control->count = 0;
+  control->arena = false;
+  control->memory.blocks = NULL;
+  control->memory.next = NULL;
+  control->memory.end = NULL;
+
+  // Return void pointer to the control structure
+  return (void*)control;
+}
+
+void *symtabCreateArena(int sizeHint) {
 
-  // Initialize the table entries to NULL
-  for (int i = 0; i < sizeHint; i++) {
-    control->table[i] = NULL;
+  control_t *control = symtabCreate(sizeHint);
+  if(control != NULL) {
+    control->arena = true;
   }
 
-  // Return void pointer to the control structure
   return (void*)control;
 }
 
 int symtabInstall(void *symtabHandle, const char *symbol, void *data) {
 
+  void **slot = symtabLookupOrInsert(symtabHandle, symbol, symtabHash(symbol));
+  if(slot == NULL) {
+    return 0;
+  }
+
+  *slot = data;
+  return 1;
+}
+
+void **symtabLookupOrInsert(void *symtabHandle, const char *symbol, unsigned int hash) {
+
   // Store symtab handle in a control struct
   control_t *control = symtabHandle;
 
-  // Check if node exists
-  node_t *node = lookup_helper(control, symbol);
+  unsigned int h = mix(hash);
 
-  if(node != NULL) {
-    node->data = data;
-  } else {
+  // Check if symbol exists
+  slot_t *slot = lookup_helper(control, symbol, h);
 
-    node_t *new_node = malloc(sizeof(node_t));
-    if(new_node == NULL) {
-      free(new_node);
-      return 0;
-    }
+  if(slot != NULL) {
+    return &slot->data;
+  }
 
-    new_node->symbol = malloc(strlen(symbol) + 1);
-    if(new_node->symbol == NULL) {
-      free(new_node);
-      return 0;
+  // Grow first, so the new symbol only has to be placed once
+  if((control->count + 1) * MAX_LOAD_DEN > (control->mask + 1) * MAX_LOAD_NUM &&
+     !grow_table(control)) {
+    return NULL;
+  }
+
+  // The copy has the characters past the end of a short symbol as 0s,
+  // so it can be used as a fixed field of SLOT_KEY characters
+  slot_t entry;
+  size_t length = strlen(symbol) + 1;
+  size_t size = length > SLOT_KEY ? length : SLOT_KEY + 1;
+  entry.symbol = control->arena ? arena_alloc(&control->memory, size) : malloc(size);
+  if(entry.symbol == NULL) {
+    return NULL;
+  }
+
+  memcpy(entry.symbol, symbol, length);
+  memset(entry.symbol + length, 0, size - length);
+  entry.spilled = slot_key(symbol, entry.key);
+  entry.data = NULL;
+  entry.hash = h;
+
+  slot = insert_slot(control, entry);
+  control->count++;
+
+  return &slot->data;
+}
+
+static slot_t *lookup_helper(control_t *control, const char *symbol, unsigned int h) {
+
+  char key[SLOT_KEY];
+  bool spilled = slot_key(symbol, key);
+
+  unsigned int index = h & control->mask;
+
+  for(unsigned int distance = 0; ; distance++) {
+
+    slot_t *slot = &control->table[index];
+
+    // A symbol would have taken the place of one closer to its own slot,
+    // so it can't be any further on
+    if(slot->symbol == NULL || slot->distance < distance) {
+      return NULL;
     }
 
-    strcpy(new_node->symbol, symbol);
-    new_node->data = data;
+    // Only the characters past the key are left to compare, and only
+    // for a long symbol
+    if(slot->hash == h && same_key(slot, key) && slot->spilled == spilled &&
+       (!spilled || strcmp(slot->symbol + SLOT_KEY, symbol + SLOT_KEY) == 0)) {
+      return slot;
+    }
 
-    int index = hash(symbol) % control->symtab_size;
+    index = (index + 1) & control->mask;
+  }
+}
 
-    new_node->next = control->table[index];
+static bool slot_key(const char *symbol, char key[SLOT_KEY]) {
 
-    control->table[index] = new_node;
+  // The symbol may end anywhere, so it is copied a character at a time
+  // rather than read 16 at once
+  int i = 0;
+  while(i < SLOT_KEY && symbol[i] != '\0') {
+    key[i] = symbol[i];
+    i++;
   }
+  memset(key + i, 0, SLOT_KEY - i);
 
-  return 1;
+  return i == SLOT_KEY && symbol[SLOT_KEY] != '\0';
 }
 
-static node_t* lookup_helper(void *symtabHandle, const char *symbol) {
+static bool same_key(const slot_t *slot, const char key[SLOT_KEY]) {
 
-  control_t *control = symtabHandle;
+#ifdef __SSE2__
+  __m128i a = _mm_loadu_si128((const __m128i *)slot->key);
+  __m128i b = _mm_loadu_si128((const __m128i *)key);
+  return _mm_movemask_epi8(_mm_cmpeq_epi8(a, b)) == 0xffff;
+#else
+  return memcmp(slot->key, key, SLOT_KEY) == 0;
+#endif
+}
+
+// Returns the slot the symbol ends up in
+static slot_t *insert_slot(control_t *control, slot_t entry) {
 
-  int index = hash(symbol) % control->symtab_size;
+  unsigned int index = entry.hash & control->mask;
+  slot_t *placed = NULL;
+  entry.distance = 0;
 
-  node_t *head = control->table[index];
+  for(;;) {
 
+    slot_t *slot = &control->table[index];
 
-  while(head != NULL) {
+    if(slot->symbol == NULL) {
+      *slot = entry;
+      return placed != NULL ? placed : slot;
+    }
 
-    if(strcmp(head->symbol, symbol) == 0) {
-      return head;
+    // Take the place of a symbol closer to its own slot, and carry on
+    // placing that one instead
+    if(slot->distance < entry.distance) {
+      slot_t displaced = *slot;
+      *slot = entry;
+      entry = displaced;
+      if(placed == NULL) {
+        placed = slot;
+      }
     }
 
-    head = head->next;
+    index = (index + 1) & control->mask;
+    entry.distance++;
   }
+}
 
-  // If symbol is not found
-  return NULL;
+static int grow_table(control_t *control) {
+
+  slot_t *old_table = control->table;
+  unsigned int old_slots = control->mask + 1;
+
+  control->table = calloc(old_slots * 2, sizeof(slot_t));
+  if(control->table == NULL) {
+    control->table = old_table;
+    return 0;
+  }
+  control->mask = old_slots * 2 - 1;
+
+  // The hashes are kept, so the symbols are placed again without
+  // hashing them again
+  for(unsigned int i = 0; i < old_slots; i++) {
+    if(old_table[i].symbol != NULL) {
+      insert_slot(control, old_table[i]);
+    }
+  }
+
+  free(old_table);
+  return 1;
 }
 
 void *symtabLookup(void *symtabHandle, const char *symbol) {
 
+  return symtabLookupHash(symtabHandle, symbol, symtabHash(symbol));
+}
+
+void *symtabLookupHash(void *symtabHandle, const char *symbol, unsigned int hash) {
+
   control_t *control = symtabHandle;
 
-  node_t *node = lookup_helper(control, symbol);
+  slot_t *slot = lookup_helper(control, symbol, mix(hash));
 
   // Symbol found
-  if(node != NULL) {
-    return node->data;
+  if(slot != NULL) {
+    return slot->data;
 
   // Symbol not found
   } else {
@@ -162,18 +543,15 @@ void symtabDelete(void *symtabHandle) {
 
   control_t *control = symtabHandle;
 
-  // Free all nodes and symbols in symtab
-  for(int i = 0; i < control->symtab_size; i++) {
-
-    node_t *current_node = control->table[i];
-
-    while(current_node != NULL) {
-      node_t *prev_node = current_node;
-      current_node = current_node->next;
-      free(prev_node->symbol);
-      free(prev_node);
+  // Free all symbols in symtab, which in arena mode are in the blocks
+  // along with any BSTs not yet deleted
+  if(control->arena) {
+    free_blocks(&control->memory, NULL);
+  } else {
+    for(unsigned int i = 0; i <= control->mask; i++) {
+      free(control->table[i].symbol);
     }
-  } 
+  }
 
   // Free our symtab
   free(control->table);
@@ -193,68 +571,41 @@ void *symtabCreateIterator(void *symtabHandle) {
 
   iterator->control_pointer = control;
 
-  // POSSIBLY DONT NEED: FOR DEBUGGING PURPOSES
-  iterator->index = 0;
-  iterator->symbol_node = NULL;
-
-  // Find first index
-  for(int i = 0; i < control->symtab_size; i++) {
-
-    if(control->table[i] != NULL) {
-
-      iterator->index = i;
-      //node_t *first_node = control->table[i];
-      iterator->symbol_node = control->table[i];
-      return (void*) iterator;
-    }
-  }
+  // Find first symbol
+  iterator->index = next_used(control, 0);
 
-  
-  iterator->control_pointer->table = NULL;
-  
   return (void*) iterator;
 }
 
 const char *symtabNext(void *iteratorHandle, void **returnData) {
 
-
   iterator_t *iterator = iteratorHandle;
+  control_t *control = iterator->control_pointer;
 
-  // Get the node containing iterators current symbol
-  node_t *node = iterator->symbol_node;
-
-  // Validate node is not null
-  if(node == NULL) {
+  // Validate there is a symbol left
+  if(iterator->index > control->mask) {
     return NULL;
   }
-  
-  // Store the nodes data in output parameter
-  *returnData = node->data;
 
-  // Search for next node 
-  if(node->next != NULL) {
-    iterator->symbol_node = node->next; // Node found in same linked list
-  
-  // Node not found so we must increase our index and search the rest of the table
-  } else {
+  slot_t *slot = &control->table[iterator->index];
 
-    iterator->index++;
+  // Store the slot's data in output parameter
+  *returnData = slot->data;
 
-    while (iterator->index < iterator->control_pointer->symtab_size && iterator->control_pointer->table[iterator->index] == NULL) {
+  // Search for next symbol
+  iterator->index = next_used(control, iterator->index + 1);
 
-      iterator->index++;
-    }
+  // Return new symbol
+  return slot->symbol;
+}
 
-    if(iterator->index < iterator->control_pointer->symtab_size) {
-      // Store next symbol in iterator
-      iterator->symbol_node = iterator->control_pointer->table[iterator->index];
-    } else {
-      iterator->symbol_node = NULL;
-    }
-    
+static unsigned int next_used(control_t *control, unsigned int index) {
+
+  while(index <= control->mask && control->table[index].symbol == NULL) {
+    index++;
   }
-  // Return new symbol
-  return node->symbol;
+
+  return index;
 }
 
 void symtabDeleteIterator(void *iteratorHandle) {
@@ -266,56 +617,92 @@ void symtabDeleteIterator(void *iteratorHandle) {
 
 void *symtabCreateBST(void *iteratorHandle) {
 
-  bst_node_t *root = NULL;
-
   char *symbol;
   void *data;
 
   // Get our iterator 
   iterator_t *iterator = iteratorHandle;
+  control_t *control = iterator->control_pointer;
+
+  // Note where the arena was, so deleting the BST can give its nodes back
+  bst_t *tree;
+  if(control->arena) {
+    arena_t mark = control->memory;
+
+    tree = arena_alloc(&control->memory, sizeof(bst_t));
+    if(tree == NULL) {
+      return NULL;
+    }
+    tree->control = control;
+    tree->mark = mark;
+  } else {
+    tree = malloc(sizeof(bst_t));
+    if(tree == NULL) {
+      return NULL;
+    }
+    tree->control = NULL;
+  }
+  tree->root = NULL;
 
   // Install all symbols into the BST
   while ((symbol = (char *)symtabNext(iterator, &data)) != NULL) {
 
-    //printf("Symbol: %s\n", symbol);
-
     // Create our new node
-    bst_node_t *new_node = create_node(symbol, data);
+    bst_node_t *new_node = create_node(control, symbol, data);
+    if(new_node == NULL) {
+      tree->top = control->memory.next;
+      symtabBSTDelete(tree);
+      return NULL;
+    }
 
     // Insert the new node into the tree
-    if (root == NULL) {
+    if (tree->root == NULL) {
       // If root is NULL, assign it to the new node
-      root = new_node;
+      tree->root = new_node;
 
     } else {
       // Otherwise, insert the new node into the existing tree
-      insert_node(root, new_node);
+      insert_node(tree->root, new_node);
     }
   } 
 
-  // Return pointer to BST root
-  return (void *)root;
+  tree->top = control->memory.next;
+
+  // Return the BST
+  return (void *)tree;
 }
 
-static bst_node_t *create_node(char *symbol, void *data) {
+static bst_node_t *create_node(control_t *control, char *symbol, void *data) {
   
-  bst_node_t *new_node = malloc(sizeof(bst_node_t));
-  if(new_node == NULL) {
-    return NULL;
+  bst_node_t *new_node;
+
+  // A node in the arena lives no longer than the table, so it can share
+  // the table's copy of the symbol
+  if(control->arena) {
+    new_node = arena_alloc(&control->memory, sizeof(bst_node_t));
+    if(new_node == NULL) {
+      return NULL;
+    }
+    new_node->symbol = symbol;
+
+  } else {
+    new_node = malloc(sizeof(bst_node_t));
+    if(new_node == NULL) {
+      return NULL;
+    }
+
+    new_node->symbol = malloc(strlen(symbol) + 1); // Add one for null character
+    if(new_node->symbol == NULL) {
+      free(new_node);
+      return NULL;
+    }
+
+    strcpy(new_node->symbol, symbol); // Copy char string 
   }
 
   new_node->left = NULL;
   new_node->right = NULL;
   new_node->parent = NULL; // We set to null right now because we do not yet know who the parent is. We will update once we insert into BST
-  new_node->visited = false;
-
-  new_node->symbol = malloc(strlen(symbol) + 1); // Add one for null character
-  if(new_node->symbol == NULL) {
-    free(new_node);
-    return NULL;
-  }
-
-  strcpy(new_node->symbol, symbol); // Copy char string 
   new_node->data = data; // Store data
 
   return new_node;
@@ -362,10 +749,11 @@ static bst_node_t *insert_node(bst_node_t *root, bst_node_t *new_node) {
 
 void *symtabCreateBSTIterator(void *BSTRoot) {
 
-  bst_node_t *root = (bst_node_t *)BSTRoot;
-  if (root == NULL) {
+  bst_t *tree = (bst_t *)BSTRoot;
+  if (tree == NULL || tree->root == NULL) {
     return NULL;
   }
+  bst_node_t *root = tree->root;
 
   bst_iterator_t *iter = malloc(sizeof(bst_iterator_t));
   if (iter == NULL) {
@@ -384,55 +772,71 @@ void *symtabCreateBSTIterator(void *BSTRoot) {
 const char *symtabBSTNext(void *BSTiteratorNode, void **returnData) {
 
   bst_iterator_t *iter = (bst_iterator_t *)BSTiteratorNode;
+
+  // An empty tree has no iterator
+  if (iter == NULL) {
+    return NULL;
+  }
+
   bst_node_t *curr_node = iter->current;
-  
+
+  // End of tree
   if (curr_node == NULL) {
     return NULL;
   }
 
-  while (curr_node != NULL) {
-    if (curr_node->left != NULL && !curr_node->left->visited) {
-      curr_node = curr_node->left;
-    } 
-    else if (!curr_node->visited) {
-      // Visit current node
-      *returnData = curr_node->data;
-      curr_node->visited = true;
-      
-      // Update iterator state before returning
-      iter->current = curr_node;
-      return curr_node->symbol;
-    } 
-    else if (curr_node->right != NULL && !curr_node->right->visited) {
-      curr_node = curr_node->right;
+  *returnData = curr_node->data;
 
-      // Then move as far left as possible
-      while (curr_node->left != NULL) {
-        curr_node = curr_node->left;
-      }
-    } 
-    else {
-      // Both subtrees visited so move up to the parent
-      curr_node = curr_node->parent;
+  // The next node is the leftmost of the right subtree, if there is one
+  if (curr_node->right != NULL) {
+    bst_node_t *next = curr_node->right;
+    while (next->left != NULL) {
+      next = next->left;
     }
+    iter->current = next;
+
+  // Otherwise it is the first parent reached from its left subtree
+  } else {
+    bst_node_t *child = curr_node;
+    bst_node_t *next = curr_node->parent;
+    while (next != NULL && next->right == child) {
+      child = next;
+      next = next->parent;
+    }
+    iter->current = next;
   }
 
-  // End of tree
-  iter->current = NULL;
-  return NULL;
+  return curr_node->symbol;
 }
 
 void symtabDeleteBSTIterator(void *BSTiteratorHandle) {
 
-  bst_node_t *bst_iterator = BSTiteratorHandle;
+  bst_iterator_t *bst_iterator = BSTiteratorHandle;
   free(bst_iterator);
 }
 
 void symtabBSTDelete(void *BSTRoot) {
-  bst_node_t *root = (bst_node_t *)BSTRoot;
 
-    free_nodes(root);
+  bst_t *tree = (bst_t *)BSTRoot;
+  if (tree == NULL) {
+    return;
+  }
+
+  if (tree->control == NULL) {
+    free_nodes(tree->root);
+    free(tree);
+    return;
+  }
+
+  // If nothing has come out of the arena since the BST was built, put it
+  // back as it was. Otherwise the nodes stay until the table is deleted.
+  control_t *control = tree->control;
+  if (control->memory.next == tree->top) {
+    arena_t mark = tree->mark;
 
+    free_blocks(&control->memory, mark.blocks);
+    control->memory = mark;
+  }
 }
 
 static void free_nodes(bst_node_t *node) {
@@ -450,16 +854,880 @@ static void free_nodes(bst_node_t *node) {
   free(node);
 }
 
-static unsigned int hash(const char *str) {
+void *symtabSortedView(void *symtabHandle) {
+
+  control_t *control = symtabHandle;
+
+  sorted_view_t *view = malloc(sizeof(sorted_view_t) + control->count * sizeof(sorted_entry_t));
+  if(view == NULL) {
+    return NULL;
+  }
+  view->count = 0;
+
+  // Collect the entries in table order
+  for(unsigned int i = 0; i <= control->mask; i++) {
+    if(control->table[i].symbol != NULL) {
+      view->entries[view->count].symbol = control->table[i].symbol;
+      view->entries[view->count].data = control->table[i].data;
+      view->count++;
+    }
+  }
+
+  if(view->count >= SORT_CUTOFF) {
+    sorted_entry_t *tmp = malloc(view->count * sizeof(sorted_entry_t));
+    if(tmp == NULL) {
+      free(view);
+      return NULL;
+    }
+    radix_sort(view->entries, tmp, view->count, 0);
+    free(tmp);
+  } else {
+    insertion_sort(view->entries, view->count, 0);
+  }
+
+  return (void*)view;
+}
+
+int symtabSortedCount(void *viewHandle) {
+
+  sorted_view_t *view = viewHandle;
+  return view->count;
+}
+
+const char *symtabSortedEntry(void *viewHandle, int index, void **returnData) {
+
+  sorted_view_t *view = viewHandle;
+
+  if(index < 0 || (unsigned int) index >= view->count) {
+    return NULL;
+  }
+
+  *returnData = view->entries[index].data;
+  return view->entries[index].symbol;
+}
+
+void symtabDeleteSortedView(void *viewHandle) {
+
+  free(viewHandle);
+}
+
+// Most significant character first: the entries are put into buckets by
+// their character at depth, and then each bucket is sorted on the
+// characters after it. The order is strcmp's, since it compares the
+// characters as unsigned char and a symbol that ends sorts first.
+static void radix_sort(sorted_entry_t *entries, sorted_entry_t *tmp, unsigned int count, size_t depth) {
+
+  for(;;) {
+
+    if(count < SORT_CUTOFF) {
+      insertion_sort(entries, count, depth);
+      return;
+    }
+
+    unsigned int counts[256] = {0};
+    for(unsigned int i = 0; i < count; i++) {
+      counts[(unsigned char) entries[i].symbol[depth]]++;
+    }
+
+    // All of them have the same character here, so go on to the next
+    // without moving anything
+    unsigned char first = entries[0].symbol[depth];
+    if(counts[first] == count) {
+      if(first == '\0') {
+        return;
+      }
+      depth++;
+      continue;
+    }
+
+    unsigned int starts[256];
+    unsigned int next[256];
+    unsigned int start = 0;
+    for(int c = 0; c < 256; c++) {
+      starts[c] = next[c] = start;
+      start += counts[c];
+    }
+
+    for(unsigned int i = 0; i < count; i++) {
+      tmp[next[(unsigned char) entries[i].symbol[depth]]++] = entries[i];
+    }
+    memcpy(entries, tmp, count * sizeof(sorted_entry_t));
+
+    // The symbols that end here are in bucket 0 and need no more sorting.
+    // The largest of the others is sorted by going round again, so the
+    // recursion is only as deep as the number of times a bucket halves.
+    int largest = 1;
+    for(int c = 2; c < 256; c++) {
+      if(counts[c] > counts[largest]) {
+        largest = c;
+      }
+    }
+    for(int c = 1; c < 256; c++) {
+      if(c != largest && counts[c] > 1) {
+        radix_sort(entries + starts[c], tmp, counts[c], depth + 1);
+      }
+    }
+
+    entries += starts[largest];
+    count = counts[largest];
+    depth++;
+  }
+}
+
+static void insertion_sort(sorted_entry_t *entries, unsigned int count, size_t depth) {
+
+  for(unsigned int i = 1; i < count; i++) {
+    sorted_entry_t entry = entries[i];
+    unsigned int j = i;
+    while(j > 0 && strcmp(entries[j - 1].symbol + depth, entry.symbol + depth) > 0) {
+      entries[j] = entries[j - 1];
+      j--;
+    }
+    entries[j] = entry;
+  }
+}
+
+void *symtabCreateIndex(void *symtabHandle) {
+
+  art_index_t *index = malloc(sizeof(art_index_t));
+  if(index == NULL) {
+    return NULL;
+  }
+
+  index->view = symtabSortedView(symtabHandle);
+  if(index->view == NULL) {
+    free(index);
+    return NULL;
+  }
+  index->memory.blocks = NULL;
+  index->memory.next = NULL;
+  index->memory.end = NULL;
+  index->root = NULL;
+
+  if(index->view->count > 0) {
+    index->root = art_build(index, 0, index->view->count, 0);
+    if(index->root == NULL) {
+      symtabDeleteIndex(index);
+      return NULL;
+    }
+  }
+
+  return (void*)index;
+}
+
+// The entries are in order, so the characters the run's symbols all
+// share are the ones its first and last share, and the symbols for each
+// child are a run of their own
+static void *art_build(art_index_t *index, unsigned int first, unsigned int size, size_t depth) {
+
+  sorted_entry_t *entries = index->view->entries;
+
+  if(size == 1) {
+    return (void*)((uintptr_t)&entries[first] | 1);
+  }
+
+  // No two symbols are the same, so the first and last differ before
+  // either of them ends
+  const char *low = entries[first].symbol + depth;
+  const char *high = entries[first + size - 1].symbol + depth;
+  uint32_t prefix_length = 0;
+  while(low[prefix_length] == high[prefix_length]) {
+    prefix_length++;
+  }
+  depth += prefix_length;
+
+  unsigned int count = 1;
+  for(unsigned int i = first + 1; i < first + size; i++) {
+    if(entries[i].symbol[depth] != entries[i - 1].symbol[depth]) {
+      count++;
+    }
+  }
+
+  art_node_t *node;
+  if(count <= 4) {
+    node = arena_alloc(&index->memory, sizeof(art_node4_t));
+    if(node != NULL) {
+      node->type = ART_NODE4;
+    }
+  } else if(count <= 16) {
+    node = arena_alloc(&index->memory, sizeof(art_node16_t));
+    if(node != NULL) {
+      node->type = ART_NODE16;
+    }
+  } else if(count <= 48) {
+    node = arena_alloc(&index->memory, sizeof(art_node48_t));
+    if(node != NULL) {
+      node->type = ART_NODE48;
+      memset(((art_node48_t *)node)->index, 0, 256);
+    }
+  } else {
+    node = arena_alloc(&index->memory, sizeof(art_node256_t));
+    if(node != NULL) {
+      node->type = ART_NODE256;
+      memset(((art_node256_t *)node)->children, 0, 256 * sizeof(void *));
+    }
+  }
+  if(node == NULL) {
+    return NULL;
+  }
+  node->count = count;
+  node->prefix_length = prefix_length;
+  node->prefix = low;
+  node->first = first;
+  node->size = size;
+
+  // Build a child for each run of symbols with the same next character
+  unsigned int child = 0;
+  unsigned int start = first;
+  while(start < first + size) {
+
+    unsigned char c = entries[start].symbol[depth];
+    unsigned int end = start + 1;
+    while(end < first + size && (unsigned char)entries[end].symbol[depth] == c) {
+      end++;
+    }
+
+    void *built = art_build(index, start, end - start, depth + 1);
+    if(built == NULL) {
+      return NULL;
+    }
+
+    switch(node->type) {
+    case ART_NODE4:
+      ((art_node4_t *)node)->keys[child] = c;
+      ((art_node4_t *)node)->children[child] = built;
+      break;
+    case ART_NODE16:
+      ((art_node16_t *)node)->keys[child] = c;
+      ((art_node16_t *)node)->children[child] = built;
+      break;
+    case ART_NODE48:
+      ((art_node48_t *)node)->index[c] = child + 1;
+      ((art_node48_t *)node)->children[child] = built;
+      break;
+    default:
+      ((art_node256_t *)node)->children[c] = built;
+      break;
+    }
+
+    child++;
+    start = end;
+  }
+
+  return (void*)node;
+}
+
+void *symtabIndexLookup(void *indexHandle, const char *symbol) {
+
+  art_index_t *index = indexHandle;
+  void *child = index->root;
+  size_t depth = 0;
+
+  while(child != NULL) {
+
+    if(ART_IS_LEAF(child)) {
+      sorted_entry_t *entry = ART_LEAF(child);
+      return strcmp(entry->symbol, symbol) == 0 ? entry->data : NULL;
+    }
+
+    // The prefix has no 0 in it, so this stops where the symbol ends
+    art_node_t *node = child;
+    for(uint32_t i = 0; i < node->prefix_length; i++) {
+      if(symbol[depth + i] != node->prefix[i]) {
+        return NULL;
+      }
+    }
+    depth += node->prefix_length;
+
+    // A symbol that ends here is the child for 0, and a leaf
+    child = art_find_child(node, symbol[depth]);
+    depth++;
+  }
+
+  return NULL;
+}
+
+void *symtabIndexPrefix(void *indexHandle, const char *prefix) {
+
+  art_index_t *index = indexHandle;
+  void *child = index->root;
+  size_t depth = 0;
+
+  while(child != NULL) {
+
+    if(ART_IS_LEAF(child)) {
+      sorted_entry_t *entry = ART_LEAF(child);
+      unsigned int i = entry - index->view->entries;
+      if(strncmp(entry->symbol, prefix, strlen(prefix)) == 0) {
+        return art_range(index, i, i + 1);
+      }
+      break;
+    }
+
+    // The prefix ending on the way to the node, or at it, means every
+    // symbol under the node has it
+    art_node_t *node = child;
+    for(uint32_t i = 0; i < node->prefix_length; i++) {
+      if(prefix[depth + i] == '\0') {
+        return art_range(index, node->first, node->first + node->size);
+      }
+      if(prefix[depth + i] != node->prefix[i]) {
+        return art_range(index, 0, 0);
+      }
+    }
+    depth += node->prefix_length;
+
+    if(prefix[depth] == '\0') {
+      return art_range(index, node->first, node->first + node->size);
+    }
+
+    child = art_find_child(node, prefix[depth]);
+    depth++;
+  }
+
+  return art_range(index, 0, 0);
+}
+
+void *symtabIndexRange(void *indexHandle, const char *low, const char *high) {
+
+  art_index_t *index = indexHandle;
+
+  unsigned int first = low != NULL ? art_lower_bound(index, low) : 0;
+  unsigned int end = high != NULL ? art_lower_bound(index, high) : index->view->count;
+
+  return art_range(index, first, end < first ? first : end);
+}
+
+// A subtree's symbols are a run of the view's entries, so a key that
+// sorts before or after everything under a node is placed without going
+// further down
+static unsigned int art_lower_bound(art_index_t *index, const char *key) {
+
+  void *child = index->root;
+  size_t depth = 0;
+
+  if(child == NULL) {
+    return 0;
+  }
+
+  for(;;) {
+
+    if(ART_IS_LEAF(child)) {
+      sorted_entry_t *entry = ART_LEAF(child);
+      unsigned int i = entry - index->view->entries;
+      return strcmp(entry->symbol, key) >= 0 ? i : i + 1;
+    }
+
+    art_node_t *node = child;
+    for(uint32_t i = 0; i < node->prefix_length; i++) {
+      unsigned char k = key[depth + i];
+      unsigned char p = node->prefix[i];
+      if(k < p) {
+        return node->first;
+      }
+      if(k > p) {
+        return node->first + node->size;
+      }
+    }
+    depth += node->prefix_length;
+
+    unsigned char c = key[depth];
+    void *next = art_find_child(node, c);
+    if(next != NULL) {
+      child = next;
+      depth++;
+      continue;
+    }
+
+    // The key comes before the symbols of the next child after its
+    // character, or after all of the node's
+    next = art_next_child(node, c);
+    return next != NULL ? art_first(index, next) : node->first + node->size;
+  }
+}
+
+static void *art_find_child(art_node_t *node, unsigned char c) {
+
+  switch(node->type) {
+
+  case ART_NODE4: {
+    art_node4_t *node4 = (art_node4_t *)node;
+    for(int i = 0; i < node->count; i++) {
+      if(node4->keys[i] == c) {
+        return node4->children[i];
+      }
+    }
+    return NULL;
+  }
+
+  case ART_NODE16: {
+    art_node16_t *node16 = (art_node16_t *)node;
+#ifdef __SSE2__
+    __m128i keys = _mm_loadu_si128((const __m128i *)node16->keys);
+    int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(keys, _mm_set1_epi8(c)));
+    mask &= (1 << node->count) - 1;
+    return mask != 0 ? node16->children[__builtin_ctz(mask)] : NULL;
+#else
+    for(int i = 0; i < node->count; i++) {
+      if(node16->keys[i] == c) {
+        return node16->children[i];
+      }
+    }
+    return NULL;
+#endif
+  }
+
+  case ART_NODE48: {
+    art_node48_t *node48 = (art_node48_t *)node;
+    return node48->index[c] != 0 ? node48->children[node48->index[c] - 1] : NULL;
+  }
+
+  default:
+    return ((art_node256_t *)node)->children[c];
+  }
+}
+
+static void *art_next_child(art_node_t *node, unsigned char c) {
+
+  switch(node->type) {
+
+  case ART_NODE4: {
+    art_node4_t *node4 = (art_node4_t *)node;
+    for(int i = 0; i < node->count; i++) {
+      if(node4->keys[i] > c) {
+        return node4->children[i];
+      }
+    }
+    return NULL;
+  }
+
+  case ART_NODE16: {
+    art_node16_t *node16 = (art_node16_t *)node;
+    for(int i = 0; i < node->count; i++) {
+      if(node16->keys[i] > c) {
+        return node16->children[i];
+      }
+    }
+    return NULL;
+  }
+
+  case ART_NODE48: {
+    art_node48_t *node48 = (art_node48_t *)node;
+    for(int k = c + 1; k < 256; k++) {
+      if(node48->index[k] != 0) {
+        return node48->children[node48->index[k] - 1];
+      }
+    }
+    return NULL;
+  }
+
+  default: {
+    art_node256_t *node256 = (art_node256_t *)node;
+    for(int k = c + 1; k < 256; k++) {
+      if(node256->children[k] != NULL) {
+        return node256->children[k];
+      }
+    }
+    return NULL;
+  }
+  }
+}
+
+static unsigned int art_first(art_index_t *index, void *child) {
+
+  if(ART_IS_LEAF(child)) {
+    return ART_LEAF(child) - index->view->entries;
+  }
+  return ((art_node_t *)child)->first;
+}
+
+static void *art_range(art_index_t *index, unsigned int first, unsigned int end) {
+
+  art_range_t *range = malloc(sizeof(art_range_t));
+  if(range == NULL) {
+    return NULL;
+  }
+
+  range->view = index->view;
+  range->next = first;
+  range->end = end;
+  return (void*)range;
+}
+
+const char *symtabIndexNext(void *rangeHandle, void **returnData) {
+
+  art_range_t *range = rangeHandle;
+
+  if(range->next >= range->end) {
+    return NULL;
+  }
+
+  sorted_entry_t *entry = &range->view->entries[range->next++];
+  *returnData = entry->data;
+  return entry->symbol;
+}
+
+void symtabDeleteRange(void *rangeHandle) {
+
+  free(rangeHandle);
+}
+
+void symtabDeleteIndex(void *indexHandle) {
+
+  art_index_t *index = indexHandle;
+
+  free_blocks(&index->memory, NULL);
+  symtabDeleteSortedView(index->view);
+  free(index);
+}
+
+void *symtabCreateConcurrent(int sizeHint, int shards) {
+
+  concurrent_t *concurrent = malloc(sizeof(concurrent_t));
+  if(concurrent == NULL) {
+    return NULL;
+  }
+
+  // A power of 2 shards, at least as many as asked for
+  concurrent->shard_bits = 0;
+  if(shards <= 0) {
+    concurrent->shard_bits = DEFAULT_SHARD_BITS;
+  }
+  while((1 << concurrent->shard_bits) < shards && concurrent->shard_bits < MAX_SHARD_BITS) {
+    concurrent->shard_bits++;
+  }
+  unsigned int count = 1u << concurrent->shard_bits;
+
+  if(posix_memalign((void **)&concurrent->shards, SHARD_ALIGN, count * sizeof(padded_shard_t)) != 0) {
+    free(concurrent);
+    return NULL;
+  }
+
+  // Enough slots in each shard for its share of the hinted symbols
+  unsigned int slots = MIN_SLOTS;
+  while(sizeHint > 0 && (unsigned int) sizeHint * MAX_LOAD_DEN > slots * MAX_LOAD_NUM * count) {
+    slots *= 2;
+  }
+
+  for(unsigned int i = 0; i < count; i++) {
+    shard_t *shard = &concurrent->shards[i].shard;
+    shard->table = shard_table(slots);
+    if(shard->table == NULL) {
+      while(i-- > 0) {
+        free(concurrent->shards[i].shard.table);
+        pthread_mutex_destroy(&concurrent->shards[i].shard.lock);
+      }
+      free(concurrent->shards);
+      free(concurrent);
+      return NULL;
+    }
+    pthread_mutex_init(&shard->lock, NULL);
+    shard->sequence = 0;
+    shard->count = 0;
+    shard->memory.blocks = NULL;
+    shard->memory.next = NULL;
+    shard->memory.end = NULL;
+  }
+
+  return (void*)concurrent;
+}
+
+void symtabDeleteConcurrent(void *concurrentHandle) {
+
+  concurrent_t *concurrent = concurrentHandle;
+
+  for(unsigned int i = 0; i < 1u << concurrent->shard_bits; i++) {
+    shard_t *shard = &concurrent->shards[i].shard;
+    shard_table_t *table = shard->table;
+    while(table != NULL) {
+      shard_table_t *retired = table->retired;
+      free(table);
+      table = retired;
+    }
+    free_blocks(&shard->memory, NULL);
+    pthread_mutex_destroy(&shard->lock);
+  }
+
+  free(concurrent->shards);
+  free(concurrent);
+}
+
+int symtabConcurrentInstall(void *concurrentHandle, const char *symbol, void *data) {
+
+  unsigned int h = mix(symtabHash(symbol));
+  shard_t *shard = shard_of(concurrentHandle, h);
+
+  shard_entry_t *entry = shard_find(shard, symbol, h);
+  if(entry == NULL) {
+    pthread_mutex_lock(&shard->lock);
+    entry = shard_insert(shard, symbol, h, data);
+    pthread_mutex_unlock(&shard->lock);
+    if(entry == NULL) {
+      return 0;
+    }
+  }
+
+  __atomic_store_n(&entry->data, data, __ATOMIC_RELEASE);
+  return 1;
+}
+
+void *symtabConcurrentLookupOrInsert(void *concurrentHandle, const char *symbol,
+                                     unsigned int hash, void *data) {
+
+  unsigned int h = mix(hash);
+  shard_t *shard = shard_of(concurrentHandle, h);
+
+  shard_entry_t *entry = shard_find(shard, symbol, h);
+  if(entry == NULL) {
+    pthread_mutex_lock(&shard->lock);
+    entry = shard_insert(shard, symbol, h, data);
+    pthread_mutex_unlock(&shard->lock);
+    if(entry == NULL) {
+      return NULL;
+    }
+  }
+
+  return __atomic_load_n(&entry->data, __ATOMIC_ACQUIRE);
+}
+
+void *symtabConcurrentLookup(void *concurrentHandle, const char *symbol) {
+
+  return symtabConcurrentLookupHash(concurrentHandle, symbol, symtabHash(symbol));
+}
+
+void *symtabConcurrentLookupHash(void *concurrentHandle, const char *symbol, unsigned int hash) {
+
+  unsigned int h = mix(hash);
+  shard_entry_t *entry = shard_find(shard_of(concurrentHandle, h), symbol, h);
+
+  if(entry == NULL) {
+    return NULL;
+  }
+  return __atomic_load_n(&entry->data, __ATOMIC_ACQUIRE);
+}
+
+static shard_t *shard_of(concurrent_t *concurrent, unsigned int h) {
+
+  // The slots use the low bits, so the shards use the top ones
+  return &concurrent->shards[(uint64_t) h >> (32 - concurrent->shard_bits)].shard;
+}
+
+// Finding the symbol's entry is right whatever an install was doing at
+// the time, since the entry only ever holds that symbol. Not finding it
+// is only right if no install changed the slots while they were read.
+static shard_entry_t *shard_find(shard_t *shard, const char *symbol, unsigned int h) {
+
+  unsigned int spins = 0;
+
+  for(;;) {
+
+    unsigned int sequence = __atomic_load_n(&shard->sequence, __ATOMIC_ACQUIRE);
+    if(sequence & 1) {
+      shard_wait(++spins);
+      continue;
+    }
+
+    shard_table_t *table = __atomic_load_n(&shard->table, __ATOMIC_ACQUIRE);
+    unsigned int index = h & table->mask;
+
+    // Slots read halfway through an install may not make sense, so the
+    // probe stops after going round the table once
+    for(unsigned int distance = 0; distance <= table->mask; distance++) {
+
+      shard_slot_t *slot = &table->slots[index];
+      shard_entry_t *entry = __atomic_load_n(&slot->entry, __ATOMIC_ACQUIRE);
+
+      if(entry == NULL || __atomic_load_n(&slot->distance, __ATOMIC_RELAXED) < distance) {
+        break;
+      }
+
+      if(__atomic_load_n(&slot->hash, __ATOMIC_RELAXED) == h && strcmp(entry->symbol, symbol) == 0) {
+        return entry;
+      }
+
+      index = (index + 1) & table->mask;
+    }
+
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if(__atomic_load_n(&shard->sequence, __ATOMIC_RELAXED) == sequence) {
+      return NULL;
+    }
+  }
+}
+
+// Loading the sequence again at once would take its cache line from the
+// thread installing, which has to write it once more to finish
+static void shard_wait(unsigned int spins) {
+
+  if(spins % SPINS_BEFORE_YIELD == 0) {
+    sched_yield();
+    return;
+  }
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_ia32_pause();
+#elif defined(__aarch64__)
+  __asm__ __volatile__("yield");
+#endif
+}
+
+// Another thread may have installed the symbol between the caller's
+// lookup and its taking the lock, so it is looked for again first
+static shard_entry_t *shard_insert(shard_t *shard, const char *symbol, unsigned int h, void *data) {
+
+  shard_table_t *table = shard->table;
+  unsigned int index = h & table->mask;
+
+  for(unsigned int distance = 0; ; distance++) {
+    shard_slot_t *slot = &table->slots[index];
+    if(slot->entry == NULL || slot->distance < distance) {
+      break;
+    }
+    if(slot->hash == h && strcmp(slot->entry->symbol, symbol) == 0) {
+      return slot->entry;
+    }
+    index = (index + 1) & table->mask;
+  }
+
+  size_t size = strlen(symbol) + 1;
+  shard_entry_t *entry = arena_alloc(&shard->memory, sizeof(shard_entry_t) + size);
+  if(entry == NULL) {
+    return NULL;
+  }
+  entry->data = data;
+  memcpy(entry->symbol, symbol, size);
+
+  // A bigger table is filled before lookups can see it, and the old one
+  // is left as it was for any lookup still reading it
+  if((shard->count + 1) * MAX_LOAD_DEN > (table->mask + 1) * MAX_LOAD_NUM) {
+    shard_table_t *grown = shard_table((table->mask + 1) * 2);
+    if(grown == NULL) {
+      return NULL;
+    }
+    for(unsigned int i = 0; i <= table->mask; i++) {
+      if(table->slots[i].entry != NULL) {
+        shard_place(grown, table->slots[i]);
+      }
+    }
+    grown->retired = table;
+    table = grown;
+  }
+
+  // Lookups that start from here until the install is done try again
+  unsigned int sequence = shard->sequence;
+  __atomic_store_n(&shard->sequence, sequence + 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+
+  __atomic_store_n(&shard->table, table, __ATOMIC_RELEASE);
+
+  shard_slot_t slot;
+  slot.entry = entry;
+  slot.hash = h;
+  shard_place(table, slot);
+  shard->count++;
+
+  __atomic_store_n(&shard->sequence, sequence + 2, __ATOMIC_RELEASE);
+
+  return entry;
+}
+
+static void shard_place(shard_table_t *table, shard_slot_t entry) {
+
+  unsigned int index = entry.hash & table->mask;
+  entry.distance = 0;
+
+  for(;;) {
+
+    shard_slot_t *slot = &table->slots[index];
+    shard_slot_t displaced = *slot;
+
+    // Take the place of a symbol closer to its own slot, and carry on
+    // placing that one instead
+    if(displaced.entry == NULL || displaced.distance < entry.distance) {
+      __atomic_store_n(&slot->hash, entry.hash, __ATOMIC_RELAXED);
+      __atomic_store_n(&slot->distance, entry.distance, __ATOMIC_RELAXED);
+      __atomic_store_n(&slot->entry, entry.entry, __ATOMIC_RELEASE);
+      if(displaced.entry == NULL) {
+        return;
+      }
+      entry = displaced;
+    }
+
+    index = (index + 1) & table->mask;
+    entry.distance++;
+  }
+}
+
+static shard_table_t *shard_table(unsigned int slots) {
+
+  shard_table_t *table = calloc(1, sizeof(shard_table_t) + slots * sizeof(shard_slot_t));
+  if(table == NULL) {
+    return NULL;
+  }
+
+  table->retired = NULL;
+  table->mask = slots - 1;
+  return table;
+}
+
+static void *arena_alloc(arena_t *arena, size_t size) {
+
+  size = (size + (ARENA_ALIGN - 1)) & ~(ARENA_ALIGN - 1);
+
+  if(arena->next == NULL || (size_t)(arena->end - arena->next) < size) {
+
+    // Each new block doubles the last, and is always big enough
+    size_t block_size = arena->blocks ? arena->blocks->size * 2 : INITIAL_BLOCK;
+    while(block_size < size) {
+      block_size *= 2;
+    }
+
+    block_t *block = malloc(sizeof(block_t) + block_size);
+    if(block == NULL) {
+      return NULL;
+    }
+    block->size = block_size;
+    block->next = arena->blocks;
+    arena->blocks = block;
+    arena->next = block->data;
+    arena->end = block->data + block_size;
+  }
+
+  void *p = arena->next;
+  arena->next += size;
+  return p;
+}
+
+static void free_blocks(arena_t *arena, block_t *keep) {
+
+  block_t *block = arena->blocks;
+  while(block != keep) {
+    block_t *next = block->next;
+    free(block);
+    block = next;
+  }
+  arena->blocks = keep;
+  if(keep == NULL) {
+    arena->next = NULL;
+    arena->end = NULL;
+  }
+}
+
+// FNV-1a, the same as intern.c works out when it interns a string
+unsigned int symtabHash(const char *str) {
 
   const unsigned int p = 16777619;
   unsigned int hash = 2166136261u;
 
   while (*str) {
-  hash = (hash ^ *str) * p;
+  hash = (hash ^ (unsigned char) *str) * p;
   str += 1;
   }
 
+  return hash;
+}
+
+static unsigned int mix(unsigned int hash) {
+
   hash += hash << 13;
   hash ^= hash >> 7;
   hash += hash << 3;
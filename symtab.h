@@ -9,10 +9,20 @@
 
 void *symtabCreate(int sizeHint);
   // Creates a symbol table.
+  // The first 16 characters of each symbol are kept with it in the
+  //   table, so symbols no longer than that are compared without
+  //   looking at the copy of the symbol.
   // If successful, returns a handle for the new table.
   // If memory cannot be allocated for the table, returns NULL.
   // The parameter is a hint as to the expected number of (symbol, data)
-  //   pairs to be stored in the table.
+  //   pairs to be stored in the table. The table grows past it as
+  //   needed, so lookups stay as fast however many pairs it holds.
+
+void *symtabCreateArena(int sizeHint);
+  // Creates a symbol table in arena mode, otherwise as symtabCreate.
+  // The copies of the symbols and the nodes of its BSTs are taken from
+  //   large blocks rather than allocated one at a time, and are all
+  //   freed together when the table is deleted.
 
 void symtabDelete(void *symtabHandle);
   // Deletes a symbol table.
@@ -45,6 +55,69 @@ void *symtabLookup(void *symtabHandle, const char *symbol);
   //   in. If not a valid handle, then the behavior is undefined (but
   //   probably bad).
 
+unsigned int symtabHash(const char *symbol);
+  // Returns the hash of a symbol that symtabLookupOrInsert and
+  //   symtabLookupHash take: FNV-1a over its characters, as intern.h's
+  //   internHash gives for an interned string. A caller that already has
+  //   it can pass it in, and the symbol is not hashed again.
+
+void **symtabLookupOrInsert(void *symtabHandle, const char *symbol,
+                            unsigned int hash);
+  // Find the symbol, installing it with NULL data if it is not installed.
+  // The hash must be symtabHash(symbol).
+  // If successful, returns a pointer to the data item stored with the
+  //   symbol, which can be read or set. A NULL data item means the
+  //   symbol has just been installed, and the caller should set it.
+  // The pointer is only good until the next symbol is installed.
+  // If memory cannot be allocated for a new symbol, returns NULL.
+  // Note that no validation is made of the symbol table handle passed
+  //   in. If not a valid handle, then the behavior is undefined (but
+  //   probably bad).
+
+void *symtabLookupHash(void *symtabHandle, const char *symbol,
+                       unsigned int hash);
+  // The same as symtabLookup, for a symbol whose symtabHash is known.
+
+void *symtabCreateConcurrent(int sizeHint, int shards);
+  // Creates a symbol table that any number of threads can install
+  //   symbols in and look them up in at the same time.
+  // If successful, returns a handle for the new table, which only the
+  //   symtabConcurrent functions below take.
+  // If memory cannot be allocated for the table, returns NULL.
+  // The table is split into shards, each with a lock that installs in it
+  //   take; lookups take no lock. The number of shards is the second
+  //   parameter rounded up to a power of 2 (at most 1024), or 64 if it
+  //   is 0. More shards let more threads install at once.
+  // The first parameter is a hint as for symtabCreate.
+
+void symtabDeleteConcurrent(void *concurrentHandle);
+  // Deletes a concurrent symbol table, as symtabDelete.
+  // No other thread may be using the table.
+
+int symtabConcurrentInstall(void *concurrentHandle, const char *symbol, void *data);
+  // Install a (symbol, data) pair in a concurrent table, as symtabInstall.
+
+void *symtabConcurrentLookup(void *concurrentHandle, const char *symbol);
+  // Return the data item stored with the given symbol, as symtabLookup.
+  // A symbol another thread is installing at the same time may or may
+  //   not be found, but a symbol whose install has returned always is.
+
+void *symtabConcurrentLookupHash(void *concurrentHandle, const char *symbol,
+                                 unsigned int hash);
+  // The same as symtabConcurrentLookup, for a symbol whose symtabHash is
+  //   known.
+
+void *symtabConcurrentLookupOrInsert(void *concurrentHandle, const char *symbol,
+                                     unsigned int hash, void *data);
+  // Find the symbol, installing it with the given data if it is not
+  //   installed, all in one step: when several threads do this for the
+  //   same symbol at once, the data of just one of them is installed.
+  // The hash must be symtabHash(symbol).
+  // If successful, returns the data item now stored with the symbol,
+  //   which is the data passed in if this call installed it.
+  // If memory cannot be allocated for a new symbol, returns NULL, so
+  //   the data should not be NULL.
+
 void *symtabCreateIterator(void *symtabHandle);
   // Create an iterator for the contents of the symbol table.
   // If successful, a handle to the iterator is returned which can be
@@ -77,17 +150,106 @@ void symtabDeleteIterator(void *iteratorHandle);
   //   probably bad).
 
 
+void *symtabSortedView(void *symtabHandle);
+  // Create a view of the contents of the symbol table in the order of
+  //   their symbols, as strcmp orders them.
+  // If successful, returns a handle for the view, whose entries can be
+  //   read with symtabSortedEntry as many times and in any order as
+  //   needed.
+  // If memory cannot be allocated for the view, returns NULL.
+  // The view is sorted once, when it is created, with a radix sort on
+  //   the characters of the symbols, so it takes as long to make however
+  //   the symbols are ordered in the table.
+  // Note that no validation is made of the symbol table handle passed
+  //   in. If not a valid handle, then the behavior is undefined (but
+  //   probably bad).
+  // Also note that if there has been a symtabInstall call since the
+  //   view was created, the view does not show it, and a symbol table
+  //   that has been deleted must not be viewed.
+
+int symtabSortedCount(void *viewHandle);
+  // Returns the number of (symbol, data) pairs in the view.
+
+const char *symtabSortedEntry(void *viewHandle, int index, void **returnData);
+  // Returns the (symbol, data) pair at the given position of the view,
+  //   counting from 0.
+  // The symbol is returned as the return value and the data item
+  // is placed in the location indicated by the third parameter.
+  // If the index is past the end of the view then NULL is returned and
+  //   the location indicated by the third parameter is not modified.
+  // The symbol is the table's copy, which has at least 16 characters,
+  //   the ones past the end of the symbol all 0s, so its first 16 can be
+  //   copied as they are into a fixed 16 character field.
+
+void symtabDeleteSortedView(void *viewHandle);
+  // Delete the view indicated by the only parameter.
+  // Reclaims all memory used by the view.
+
+void *symtabCreateIndex(void *symtabHandle);
+  // Create an index of the contents of the symbol table, which can find
+  //   a symbol, the symbols in a range or the symbols with a prefix in
+  //   time that grows with the length of the key, not with the number of
+  //   symbols, and return them in order.
+  // If successful, returns a handle for the index.
+  // If memory cannot be allocated for the index, returns NULL.
+  // The index is an adaptive radix tree built over a sorted view of the
+  //   table (see symtabSortedView), and like the view it only shows the
+  //   table as it was when the index was created.
+  // Note that no validation is made of the symbol table handle passed
+  //   in. If not a valid handle, then the behavior is undefined (but
+  //   probably bad).
+
+void *symtabIndexLookup(void *indexHandle, const char *symbol);
+  // Return the data item stored with the given symbol, as symtabLookup.
+
+void *symtabIndexPrefix(void *indexHandle, const char *prefix);
+  // Find the symbols that start with the given prefix ("" for all of
+  //   them).
+  // If successful, returns a handle which can be repeatedly passed to
+  //   symtabIndexNext to get them in order.
+  // If memory cannot be allocated for the handle, returns NULL.
+
+void *symtabIndexRange(void *indexHandle, const char *low, const char *high);
+  // Find the symbols from low up to but not including high, as strcmp
+  //   orders them. A NULL low or high leaves that end of the range open.
+  // If successful, returns a handle which can be repeatedly passed to
+  //   symtabIndexNext to get them in order.
+  // If memory cannot be allocated for the handle, returns NULL.
+
+const char *symtabIndexNext(void *rangeHandle, void **returnData);
+  // Returns the next (symbol, data) pair a prefix or range query found.
+  // The symbol is returned as the return value and the data item
+  // is placed in the location indicated by the second parameter.
+  // If all of them have already been returned then NULL is returned
+  //   and the location indicated by the second paramter is not modified.
+
+void symtabDeleteRange(void *rangeHandle);
+  // Delete the handle a prefix or range query returned.
+  // Reclaims all memory used by the handle.
+
+void symtabDeleteIndex(void *indexHandle);
+  // Delete the index indicated by the only parameter.
+  // Reclaims all memory used by the index.
+  // Handles from prefix and range queries on it must be deleted first.
+
 void *symtabCreateBST(void *iteratorHandle);
   // Creates a BST from a hash table filled with symbols using the handle 
   // to the iterator passed to it. 
-  // Returns a pointer to the root of the BST created
+  // Returns a handle for the BST created.
+  // If memory cannot be allocated for the BST, returns NULL.
+  // A BST of an arena mode table must not be used after the table is
+  //   deleted.
   
 void *symtabCreateBSTIterator(void *BSTRoot);
   // Create an iterator for the BST symbol table.
   // If successful, a handle to the leftmost leaf noder is returned which can be
   // repeatedly passed to symtabBSTNext to iterate over the contents
   // of the BST one node at a time.
-  // If memory cannot be allocated for the iterator, returns NULL.
+  // Iterating does not change the BST, so it can be walked any number of
+  //   times, and by several iterators at once, from different threads
+  //   too.
+  // If memory cannot be allocated for the iterator, or the BST is empty,
+  //   returns NULL, which symtabBSTNext takes as an iterator at the end.
   // Note that no validation is made of the root passed
   //   in. If not a valid root, then the behavior is undefined (but
   //   probably bad).
@@ -109,6 +271,9 @@ void symtabDeleteBSTIterator(void *BSTiteratorHandle);
 void symtabBSTDelete(void *BSTRoot);
   // Deletes a BST.
   // Reclaims all memory used by the table.
+  // For a table in arena mode the memory is reclaimed at once only if
+  //   nothing has been installed and no other BST built since this one
+  //   that is still there; otherwise it is reclaimed with the table.
   // Note that the memory associate with data items is not reclaimed since
   //   the symbol table does not know the actual type of the data. It only
   //   manipulates pointers to the data.
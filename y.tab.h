@@ -44,6 +44,18 @@
 #if YYDEBUG
 extern int yydebug;
 #endif
+/* "%code requires" blocks.  */
+#line 7 "parse.y"
+
+#include "defs.h"
+
+// the reentrant scanner produced by flex
+#ifndef YY_TYPEDEF_YY_SCANNER_T
+#define YY_TYPEDEF_YY_SCANNER_T
+typedef void* yyscan_t;
+#endif
+
+#line 59 "y.tab.h"
 
 /* Token kinds.  */
 #ifndef YYTOKENTYPE
@@ -55,35 +67,23 @@ extern int yydebug;
     YYerror = 256,                 /* error  */
     YYUNDEF = 257,                 /* "invalid token"  */
     ID = 258,                      /* ID  */
-    INT_CONST = 259,               /* INT_CONST  */
-    REG = 260,                     /* REG  */
-    EOL = 261,                     /* EOL  */
-    COLON = 262,                   /* COLON  */
-    COMMA = 263,                   /* COMMA  */
-    LPAREN = 264,                  /* LPAREN  */
-    RPAREN = 265                   /* RPAREN  */
+    OPCODE = 259,                  /* OPCODE  */
+    INT_CONST = 260,               /* INT_CONST  */
+    REG = 261,                     /* REG  */
+    EOL = 262,                     /* EOL  */
+    COLON = 263,                   /* COLON  */
+    COMMA = 264,                   /* COMMA  */
+    LPAREN = 265,                  /* LPAREN  */
+    RPAREN = 266                   /* RPAREN  */
   };
   typedef enum yytokentype yytoken_kind_t;
 #endif
-/* Token kinds.  */
-#define YYEMPTY -2
-#define YYEOF 0
-#define YYerror 256
-#define YYUNDEF 257
-#define ID 258
-#define INT_CONST 259
-#define REG 260
-#define EOL 261
-#define COLON 262
-#define COMMA 263
-#define LPAREN 264
-#define RPAREN 265
 
 /* Value type.  */
 #if ! defined YYSTYPE && ! defined YYSTYPE_IS_DECLARED
 union YYSTYPE
 {
-#line 25 "parse.y"
+#line 46 "parse.y"
 
         char *       y_str;
         unsigned int y_reg;
@@ -100,10 +100,21 @@ typedef union YYSTYPE YYSTYPE;
 #endif
 
 
-extern YYSTYPE yylval;
 
 
-int yyparse (void);
+#ifndef YYPUSH_MORE_DEFINED
+# define YYPUSH_MORE_DEFINED
+enum { YYPUSH_MORE = 4 };
+#endif
+
+typedef struct yypstate yypstate;
+
+
+int yypush_parse (yypstate *ps,
+                  int pushed_char, YYSTYPE const *pushed_val, AsmContext *ctx);
+
+yypstate *yypstate_new (void);
+void yypstate_delete (yypstate *ps);
 
 
 #endif /* !YY_YY_Y_TAB_H_INCLUDED  */